@@ -0,0 +1,270 @@
+#include "CubeBehaviour.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+/**
+ * This constructor frees every program in the pool and sets a budget of
+ * 8 instructions
+ */
+CubeBehaviours::CubeBehaviours(CubeEngine &engine, CubeBehaviour *pool, byte poolSize) {
+    this->engine   = &engine;
+    this->pool     = pool;
+    this->poolSize = poolSize;
+    this->budget   = 8;
+
+    for (byte i = 0; i < poolSize; i++) {
+        this->pool[i].program = NULL;
+    }
+}
+
+/*
+ * Sets how many instructions each sprite may run per tick
+ */
+void CubeBehaviours::setBudget(byte instructions) {
+    this->budget = (instructions == 0) ? 1 : instructions;
+}
+
+/*
+ * Starts a program on a sprite
+ *
+ * 'program' must be in PROGMEM. Returns the slot used, or NO_BEHAVIOUR if
+ * the pool is full.
+ */
+byte CubeBehaviours::start(int spriteNum, const byte *program) {
+
+    if (program == NULL) {
+        return this->NO_BEHAVIOUR;
+    }
+
+    this->stop(spriteNum);
+
+    for (byte i = 0; i < this->poolSize; i++) {
+        CubeBehaviour &vm = this->pool[i];
+
+        if (vm.program == NULL) {
+            vm.program = program;
+            vm.sprite  = spriteNum;
+            vm.pc      = 0;
+            vm.counter = 0;
+            vm.wait    = 0;
+            return i;
+        }
+    }
+
+    return this->NO_BEHAVIOUR;
+}
+
+/*
+ * Stops the program running on a sprite
+ */
+void CubeBehaviours::stop(int spriteNum) {
+    for (byte i = 0; i < this->poolSize; i++) {
+        if (this->pool[i].program != NULL && this->pool[i].sprite == spriteNum) {
+            this->pool[i].program = NULL;
+        }
+    }
+}
+
+/*
+ * Returns true if a program is running on the sprite
+ */
+bool CubeBehaviours::isRunning(int spriteNum) {
+    for (byte i = 0; i < this->poolSize; i++) {
+        if (this->pool[i].program != NULL && this->pool[i].sprite == spriteNum) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Runs every program for one tick
+ */
+void CubeBehaviours::step() {
+    for (byte i = 0; i < this->poolSize; i++) {
+        if (this->pool[i].program != NULL) {
+            this->run(this->pool[i]);
+        }
+    }
+}
+
+/*
+ * Runs one program until it yields or uses up its budget
+ */
+void CubeBehaviours::run(CubeBehaviour &vm) {
+
+    if (vm.wait > 0) {
+        vm.wait -= 1;
+        return;
+    }
+
+    CubeEngine *engine = this->engine;
+    int sprite = vm.sprite;
+
+    for (byte used = 0; used < this->budget; used++) {
+
+        byte op = this->fetch(vm);
+
+        if (op == this->OP_END) {
+            vm.program = NULL;
+            return;
+
+        } else if (op == this->OP_YIELD) {
+            return;
+
+        } else if (op == this->OP_WAIT) {
+            vm.wait = this->fetch(vm);
+            return;
+
+        } else if (op == this->OP_GOTO) {
+            vm.pc = this->fetch(vm);
+
+        } else if (op == this->OP_COUNT) {
+            vm.counter = this->fetch(vm);
+
+        } else if (op == this->OP_LOOP) {
+            byte address = this->fetch(vm);
+            vm.counter  -= 1;
+            if (vm.counter != 0) {
+                vm.pc = address;
+            }
+
+        } else if (op == this->OP_MOVE) {
+            engine->moveSprite(sprite, this->fetch(vm));
+
+        } else if (op == this->OP_STEP) {
+            engine->moveSprite(sprite, engine->getSpriteAttribute(sprite, engine->AN_DIRECTION));
+
+        } else if (op == this->OP_SET) {
+            byte name = this->fetch(vm);
+            engine->setSpriteAttribute(sprite, name, this->fetch(vm));
+
+        } else if (op == this->OP_FACE) {
+            engine->setSpriteAttribute(sprite, engine->AN_DIRECTION, this->fetch(vm));
+
+        } else if (op == this->OP_REVERSE) {
+
+            // Straight directions pair up as 0/1, 2/3 and 4/5, and the
+            // diagonals are mirrored around the middle of 6-13
+            byte index = engine->getSpriteAttribute(sprite, engine->AN_DIRECTION) >> 3;
+            index = (index < 6) ? (index ^ 1) : (19 - index);
+            engine->setSpriteAttribute(sprite, engine->AN_DIRECTION, index << 3);
+
+        } else if (op == this->OP_RANDOM_DIR) {
+            engine->setRandomSpriteDirection(sprite);
+
+        } else if (op == this->OP_IF_BLOCKED || op == this->OP_IF_EDGE) {
+            byte address = this->fetch(vm);
+            if (this->checkAhead(sprite, op == this->OP_IF_BLOCKED)) {
+                vm.pc = address;
+            }
+
+        } else if (op == this->OP_IF_RANDOM) {
+            byte chance  = this->fetch(vm);
+            byte address = this->fetch(vm);
+            if (this->engine->getRandom(256) < chance) {
+                vm.pc = address;
+            }
+
+        } else if (op == this->OP_CHASE || op == this->OP_IF_NEAR) {
+            byte target = this->fetch(vm);
+
+            int x, y, z, tx, ty, tz;
+            this->getPosition(sprite, &x, &y, &z);
+            this->getPosition(target, &tx, &ty, &tz);
+
+            int dx = tx - x;
+            int dy = ty - y;
+            int dz = tz - z;
+            int ax = abs(dx);
+            int ay = abs(dy);
+            int az = abs(dz);
+
+            if (op == this->OP_IF_NEAR) {
+                byte distance = this->fetch(vm);
+                byte address  = this->fetch(vm);
+                if (ax <= distance && ay <= distance && az <= distance) {
+                    vm.pc = address;
+                }
+
+            // Face along the axis with the biggest gap
+            } else if (ax >= ay && ax >= az && ax > 0) {
+                engine->setSpriteAttribute(sprite, engine->AN_DIRECTION, (dx > 0) ? engine->AV_RIGHT : engine->AV_LEFT);
+            } else if (ay >= az && ay > 0) {
+                engine->setSpriteAttribute(sprite, engine->AN_DIRECTION, (dy > 0) ? engine->AV_UP : engine->AV_DOWN);
+            } else if (az > 0) {
+                engine->setSpriteAttribute(sprite, engine->AN_DIRECTION, (dz > 0) ? engine->AV_BACK : engine->AV_FRONT);
+            }
+
+        // Bad instructions stop the program rather than run off into flash
+        } else {
+            vm.program = NULL;
+            return;
+        }
+    }
+}
+
+/*
+ * Reads the next byte of a program
+ */
+byte CubeBehaviours::fetch(CubeBehaviour &vm) {
+    byte value = pgm_read_byte(vm.program + vm.pc);
+    vm.pc += 1;
+    return value;
+}
+
+/*
+ * Checks the LED one step ahead of a sprite
+ *
+ * Returns true if the step leaves the cube. With 'testLit' a sprite that
+ * wraps is only stopped by lit LEDs, and one that doesn't is also stopped
+ * by the walls.
+ */
+bool CubeBehaviours::checkAhead(int spriteNum, bool testLit) {
+
+    CubeEngine *engine = this->engine;
+
+    int x, y, z;
+    this->getPosition(spriteNum, &x, &y, &z);
+
+    byte steps = CubeEngine::getDirectionSteps(engine->getSpriteAttribute(spriteNum, engine->AN_DIRECTION));
+    int columns = 6 * engine->getCubeCount();
+
+    x += ((steps >> 4) & B00000011) - 1;
+    y += ((steps >> 2) & B00000011) - 1;
+    z += (steps & B00000011) - 1;
+
+    bool edge = x < 0 || x > 5 || y < 0 || y > 5 || z < 0 || z >= columns;
+
+    if (!testLit) {
+        return edge;
+    }
+
+    if (edge) {
+        if (engine->getSpriteAttribute(spriteNum, engine->AN_WRAP) == engine->AV_NOWRAP) {
+            return true;
+        }
+
+        x = (x + 6) % 6;
+        y = (y + 6) % 6;
+        z = (z + columns) % columns;
+    }
+
+    return engine->getLED(x, y, z) != engine->AV_OFF;
+}
+
+/*
+ * Gets a sprite's position, with z counted across chained cubes
+ */
+void CubeBehaviours::getPosition(int spriteNum, int *x, int *y, int *z) {
+    CubeEngine *engine = this->engine;
+
+    *x = engine->getSpriteAttribute(spriteNum, engine->AN_X);
+    *y = engine->getSpriteAttribute(spriteNum, engine->AN_Y);
+    *z = engine->getSpriteAttribute(spriteNum, engine->AN_Z) +
+         (6 * engine->getSpriteAttribute(spriteNum, engine->AN_CUBE));
+}
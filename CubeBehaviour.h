@@ -0,0 +1,92 @@
+/*
+* CubeBehaviour.h - Bytecode sprite behaviours for the CubeEngine library.
+*
+* A behaviour is a small program in flash, normally written with the
+* assembler in extras/cubeasm.py, e.g.
+*
+*   patrol: STEP
+*           IF_BLOCKED turn
+*           WAIT 2
+*           GOTO patrol
+*   turn:   REVERSE
+*           GOTO patrol
+*
+* Programs are at most 256 bytes and address their own bytes, so the same
+* program can drive any number of sprites.
+*/
+#ifndef CubeBehaviour_h
+#define CubeBehaviour_h
+
+#include "Arduino.h"
+#include "CubeEngine.h"
+
+// A running program, kept in the sketch's pool, e.g. CubeBehaviour vms[8];
+struct CubeBehaviour
+{
+    const byte *program; // in PROGMEM, NULL when the slot is free
+    int sprite;
+    byte pc;             // offset of the next instruction
+    byte counter;        // for COUNT and LOOP
+    byte wait;           // ticks left to wait
+};
+
+class CubeBehaviours
+{
+    public:
+
+        // Instructions and their operands
+        // extras/cubeasm.py uses the same numbers
+        static const byte OP_END        = 0x00; // stop the program
+        static const byte OP_YIELD      = 0x01; // carry on next tick
+        static const byte OP_WAIT       = 0x02; // ticks
+        static const byte OP_GOTO       = 0x03; // address
+        static const byte OP_COUNT      = 0x04; // count, sets the counter
+        static const byte OP_LOOP       = 0x05; // address, jumps while --counter != 0
+        static const byte OP_MOVE       = 0x06; // AV_ direction, moves once that way
+        static const byte OP_STEP       = 0x07; // moves once in the sprite's direction
+        static const byte OP_SET        = 0x08; // AN_ name, value
+        static const byte OP_FACE       = 0x09; // AV_ direction, sets the sprite's direction
+        static const byte OP_REVERSE    = 0x0A; // faces the opposite way
+        static const byte OP_RANDOM_DIR = 0x0B; // faces a random direction
+        static const byte OP_IF_BLOCKED = 0x0C; // address, if the next LED ahead is lit or a wall
+        static const byte OP_IF_EDGE    = 0x0D; // address, if the next step ahead leaves the cube
+        static const byte OP_IF_RANDOM  = 0x0E; // chance (of 256), address
+        static const byte OP_CHASE      = 0x0F; // sprite, faces along the axis with the biggest gap
+        static const byte OP_IF_NEAR    = 0x10; // sprite, distance, address
+
+        // Returned when the pool is full
+        static const byte NO_BEHAVIOUR = 0xFF;
+
+        // Behaviour engine constructor
+        CubeBehaviours(CubeEngine &engine, CubeBehaviour *pool, byte poolSize);
+
+        // Sets how many instructions each sprite may run per tick
+        // A program that doesn't yield in time carries on next tick, so the
+        // worst case for a tick is the budget times the number of programs.
+        void setBudget(byte instructions);
+
+        // Program functions
+        // Starting a program on a sprite replaces the one it was running
+        byte start(int spriteNum, const byte *program);
+        void stop(int spriteNum);
+        bool isRunning(int spriteNum);
+
+        // Runs every program for one tick
+        // With CubeLoop call this from the logic callback
+        void step();
+
+    private:
+
+        CubeEngine *engine;
+        CubeBehaviour *pool;
+        byte poolSize;
+        byte budget;
+
+        // Interpreter functions
+        void run(CubeBehaviour &vm);
+        byte fetch(CubeBehaviour &vm);
+        bool checkAhead(int spriteNum, bool testLit);
+        void getPosition(int spriteNum, int *x, int *y, int *z);
+};
+
+#endif
@@ -0,0 +1,358 @@
+#include "CubeBitboard.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+/*
+ * Splits a data array byte (four 2-bit LED codes) into bit-planes
+ *
+ * The low bits of the four codes go to bits 0-3 and the high bits to
+ * bits 4-7.
+ */
+static const byte BITBOARD_SPLIT[256] PROGMEM = {
+    0x00, 0x01, 0x10, 0x11, 0x02, 0x03, 0x12, 0x13,
+    0x20, 0x21, 0x30, 0x31, 0x22, 0x23, 0x32, 0x33,
+    0x04, 0x05, 0x14, 0x15, 0x06, 0x07, 0x16, 0x17,
+    0x24, 0x25, 0x34, 0x35, 0x26, 0x27, 0x36, 0x37,
+    0x40, 0x41, 0x50, 0x51, 0x42, 0x43, 0x52, 0x53,
+    0x60, 0x61, 0x70, 0x71, 0x62, 0x63, 0x72, 0x73,
+    0x44, 0x45, 0x54, 0x55, 0x46, 0x47, 0x56, 0x57,
+    0x64, 0x65, 0x74, 0x75, 0x66, 0x67, 0x76, 0x77,
+    0x08, 0x09, 0x18, 0x19, 0x0A, 0x0B, 0x1A, 0x1B,
+    0x28, 0x29, 0x38, 0x39, 0x2A, 0x2B, 0x3A, 0x3B,
+    0x0C, 0x0D, 0x1C, 0x1D, 0x0E, 0x0F, 0x1E, 0x1F,
+    0x2C, 0x2D, 0x3C, 0x3D, 0x2E, 0x2F, 0x3E, 0x3F,
+    0x48, 0x49, 0x58, 0x59, 0x4A, 0x4B, 0x5A, 0x5B,
+    0x68, 0x69, 0x78, 0x79, 0x6A, 0x6B, 0x7A, 0x7B,
+    0x4C, 0x4D, 0x5C, 0x5D, 0x4E, 0x4F, 0x5E, 0x5F,
+    0x6C, 0x6D, 0x7C, 0x7D, 0x6E, 0x6F, 0x7E, 0x7F,
+    0x80, 0x81, 0x90, 0x91, 0x82, 0x83, 0x92, 0x93,
+    0xA0, 0xA1, 0xB0, 0xB1, 0xA2, 0xA3, 0xB2, 0xB3,
+    0x84, 0x85, 0x94, 0x95, 0x86, 0x87, 0x96, 0x97,
+    0xA4, 0xA5, 0xB4, 0xB5, 0xA6, 0xA7, 0xB6, 0xB7,
+    0xC0, 0xC1, 0xD0, 0xD1, 0xC2, 0xC3, 0xD2, 0xD3,
+    0xE0, 0xE1, 0xF0, 0xF1, 0xE2, 0xE3, 0xF2, 0xF3,
+    0xC4, 0xC5, 0xD4, 0xD5, 0xC6, 0xC7, 0xD6, 0xD7,
+    0xE4, 0xE5, 0xF4, 0xF5, 0xE6, 0xE7, 0xF6, 0xF7,
+    0x88, 0x89, 0x98, 0x99, 0x8A, 0x8B, 0x9A, 0x9B,
+    0xA8, 0xA9, 0xB8, 0xB9, 0xAA, 0xAB, 0xBA, 0xBB,
+    0x8C, 0x8D, 0x9C, 0x9D, 0x8E, 0x8F, 0x9E, 0x9F,
+    0xAC, 0xAD, 0xBC, 0xBD, 0xAE, 0xAF, 0xBE, 0xBF,
+    0xC8, 0xC9, 0xD8, 0xD9, 0xCA, 0xCB, 0xDA, 0xDB,
+    0xE8, 0xE9, 0xF8, 0xF9, 0xEA, 0xEB, 0xFA, 0xFB,
+    0xCC, 0xCD, 0xDC, 0xDD, 0xCE, 0xCF, 0xDE, 0xDF,
+    0xEC, 0xED, 0xFC, 0xFD, 0xEE, 0xEF, 0xFE, 0xFF
+};
+
+/*
+ * Spreads four plane bits back out to the even bits of a byte
+ */
+static const byte BITBOARD_SPREAD[16] PROGMEM = {
+    0x00, 0x01, 0x04, 0x05, 0x10, 0x11, 0x14, 0x15,
+    0x40, 0x41, 0x44, 0x45, 0x50, 0x51, 0x54, 0x55
+};
+
+/*
+ * Reverses the six bits of a row
+ */
+static const byte BITBOARD_REVERSE[64] PROGMEM = {
+    0x00, 0x20, 0x10, 0x30, 0x08, 0x28, 0x18, 0x38,
+    0x04, 0x24, 0x14, 0x34, 0x0C, 0x2C, 0x1C, 0x3C,
+    0x02, 0x22, 0x12, 0x32, 0x0A, 0x2A, 0x1A, 0x3A,
+    0x06, 0x26, 0x16, 0x36, 0x0E, 0x2E, 0x1E, 0x3E,
+    0x01, 0x21, 0x11, 0x31, 0x09, 0x29, 0x19, 0x39,
+    0x05, 0x25, 0x15, 0x35, 0x0D, 0x2D, 0x1D, 0x3D,
+    0x03, 0x23, 0x13, 0x33, 0x0B, 0x2B, 0x1B, 0x3B,
+    0x07, 0x27, 0x17, 0x37, 0x0F, 0x2F, 0x1F, 0x3F
+};
+
+/**
+ * This constructor starts with an empty bitboard
+ */
+CubeBitboard::CubeBitboard(CubeEngine &engine) {
+    this->engine = &engine;
+    this->clear();
+}
+
+/*
+ * Copies the data array into the bitboard
+ *
+ * Every three data array bytes hold twelve LEDs, which is two rows.
+ */
+void CubeBitboard::load() {
+
+    byte *data = this->engine->data;
+
+    for (byte row = 0; row < 36; row += 2) {
+
+        byte split0 = pgm_read_byte(&BITBOARD_SPLIT[data[0]]);
+        byte split1 = pgm_read_byte(&BITBOARD_SPLIT[data[1]]);
+        byte split2 = pgm_read_byte(&BITBOARD_SPLIT[data[2]]);
+
+        unsigned int low  = (split0 & 0x0F) | ((split1 & 0x0F) << 4) | ((unsigned int) (split2 & 0x0F) << 8);
+        unsigned int high = (split0 >> 4) | (split1 & 0xF0) | ((unsigned int) (split2 >> 4) << 8);
+
+        this->low[row]      = low & B00111111;
+        this->low[row + 1]  = low >> 6;
+        this->high[row]     = high & B00111111;
+        this->high[row + 1] = high >> 6;
+
+        data += 3;
+    }
+}
+
+/*
+ * Copies the bitboard back into the data array
+ */
+void CubeBitboard::store() {
+
+    CubeEngine *engine = this->engine;
+    byte index = 0;
+
+    for (byte row = 0; row < 36; row += 2) {
+
+        unsigned int low  = this->low[row] | ((unsigned int) this->low[row + 1] << 6);
+        unsigned int high = this->high[row] | ((unsigned int) this->high[row + 1] << 6);
+
+        for (byte i = 0; i < 3; i++) {
+            engine->writeData(engine->data, index,
+                              pgm_read_byte(&BITBOARD_SPREAD[low & 0x0F])
+                              | (pgm_read_byte(&BITBOARD_SPREAD[high & 0x0F]) << 1));
+            low  = low >> 4;
+            high = high >> 4;
+            index += 1;
+        }
+
+    }
+}
+
+/*
+ * Turns every LED of the bitboard off
+ */
+void CubeBitboard::clear() {
+    for (int i = 35; i >= 0; i--) {
+        this->low[i]  = 0;
+        this->high[i] = 0;
+    }
+}
+
+/*
+ * Returns the lit LEDs of a row, whatever their colour
+ */
+byte CubeBitboard::getRow(byte x, byte y) {
+    byte row = (x * 6) + y;
+    return this->low[row] | this->high[row];
+}
+
+/*
+ * Sets the LEDs of a row to one AV_ colour, turning the rest off
+ */
+void CubeBitboard::setRow(byte x, byte y, byte bits, byte colour) {
+    byte row = (x * 6) + y;
+
+    bits &= B00111111;
+    this->low[row]  = (colour & B01000000) ? bits : 0;
+    this->high[row] = (colour & B10000000) ? bits : 0;
+}
+
+/*
+ * Moves the whole frame along an axis
+ *
+ * A positive amount moves LEDs towards higher coordinates. LEDs pushed
+ * off the edge come back on the other side when wrapping and are lost
+ * otherwise.
+ */
+void CubeBitboard::shift(byte axis, int amount, bool wrap) {
+
+    // Only shift by less than a whole cube
+    amount = amount % 6;
+    if (amount == 0) {
+        return;
+    }
+
+    this->shiftPlane(this->low, axis, amount, wrap);
+    this->shiftPlane(this->high, axis, amount, wrap);
+}
+
+/*
+ * Reflects the frame so coordinate n on an axis becomes 5 - n
+ */
+void CubeBitboard::mirror(byte axis) {
+    this->mirrorPlane(this->low, axis);
+    this->mirrorPlane(this->high, axis);
+}
+
+/*
+ * Turns the frame a quarter turn about an axis
+ *
+ * The turns follow the right-hand rule: about x, y moves to z; about y,
+ * z moves to x; about z, x moves to y.
+ */
+void CubeBitboard::rotate(byte axis) {
+    this->rotatePlane(this->low, axis);
+    this->rotatePlane(this->high, axis);
+}
+
+/*
+ * Shifts one plane
+ *
+ * Along z this is a shift of each row byte. Along x and y whole rows
+ * move, so they're copied through a buffer.
+ */
+void CubeBitboard::shiftPlane(byte *plane, byte axis, int amount, bool wrap) {
+
+    if (axis == this->AXIS_Z) {
+
+        byte left  = (amount > 0) ? amount : amount + 6;
+        byte right = 6 - left;
+
+        for (int i = 35; i >= 0; i--) {
+            byte row = plane[i];
+
+            if (wrap) {
+                plane[i] = ((row << left) | (row >> right)) & B00111111;
+            } else if (amount > 0) {
+                plane[i] = (row << left) & B00111111;
+            } else {
+                plane[i] = row >> right;
+            }
+        }
+
+        return;
+    }
+
+    byte buffer[36];
+    for (int i = 35; i >= 0; i--) {
+        buffer[i] = plane[i];
+    }
+
+    // Rows are six bytes apart along x and one byte apart along y
+    byte stride = (axis == this->AXIS_X) ? 6 : 1;
+
+    for (byte a = 0; a < 6; a++) {
+
+        // The row which moves into position a
+        int from = a - amount;
+        bool blank = false;
+        if (from < 0 || from > 5) {
+            from = (from + 6) % 6;
+            blank = !wrap;
+        }
+
+        for (byte b = 0; b < 6; b++) {
+
+            // b walks the other axis, which is one or six bytes apart
+            byte other = (stride == 6) ? b : b * 6;
+
+            plane[(a * stride) + other] = blank ? 0 : buffer[(from * stride) + other];
+        }
+    }
+}
+
+/*
+ * Mirrors one plane
+ */
+void CubeBitboard::mirrorPlane(byte *plane, byte axis) {
+
+    if (axis == this->AXIS_Z) {
+        for (int i = 35; i >= 0; i--) {
+            plane[i] = pgm_read_byte(&BITBOARD_REVERSE[plane[i]]);
+        }
+        return;
+    }
+
+    byte stride = (axis == this->AXIS_X) ? 6 : 1;
+
+    for (byte a = 0; a < 3; a++) {
+        for (byte b = 0; b < 6; b++) {
+            byte other = (stride == 6) ? b : b * 6;
+
+            byte first  = (a * stride) + other;
+            byte second = ((5 - a) * stride) + other;
+
+            byte row      = plane[first];
+            plane[first]  = plane[second];
+            plane[second] = row;
+        }
+    }
+}
+
+/*
+ * Rotates one plane
+ *
+ * A quarter turn is a transpose of each 6x6 slice plus a mirror. About z
+ * the slices are the row bytes themselves, so it's a byte permutation.
+ */
+void CubeBitboard::rotatePlane(byte *plane, byte axis) {
+
+    if (axis == this->AXIS_Z) {
+
+        byte buffer[36];
+        for (int i = 35; i >= 0; i--) {
+            buffer[i] = plane[i];
+        }
+
+        // (x, y) moves to (5 - y, x)
+        for (byte x = 0; x < 6; x++) {
+            for (byte y = 0; y < 6; y++) {
+                plane[((5 - y) * 6) + x] = buffer[(x * 6) + y];
+            }
+        }
+
+    } else if (axis == this->AXIS_X) {
+
+        // (y, z) moves to (5 - z, y)
+        for (byte x = 0; x < 6; x++) {
+            this->transpose(&plane[x * 6], 1);
+        }
+        this->mirrorPlane(plane, this->AXIS_Y);
+
+    } else {
+
+        // (z, x) moves to (5 - x, z)
+        this->mirrorPlane(plane, this->AXIS_X);
+        for (byte y = 0; y < 6; y++) {
+            this->transpose(&plane[y], 6);
+        }
+    }
+}
+
+/*
+ * Transposes a 6x6 bit matrix in place, so bit b of row a swaps with
+ * bit a of row b
+ *
+ * The rows are 'stride' bytes apart. This is the 8x8 transpose from
+ * Hacker's Delight on two 32-bit words. That version numbers bits from
+ * the left, so the rows are loaded last to first, which pads the matrix
+ * with two empty rows and keeps our bit order.
+ */
+void CubeBitboard::transpose(byte *rows, byte stride) {
+
+    unsigned long x = ((unsigned int) rows[5 * stride] << 8) | rows[4 * stride];
+    unsigned long y = ((unsigned long) rows[3 * stride] << 24) | ((unsigned long) rows[2 * stride] << 16)
+                    | ((unsigned int) rows[stride] << 8) | rows[0];
+    unsigned long t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AAUL;
+    x = x ^ t ^ (t << 7);
+    t = (y ^ (y >> 7)) & 0x00AA00AAUL;
+    y = y ^ t ^ (t << 7);
+
+    t = (x ^ (x >> 14)) & 0x0000CCCCUL;
+    x = x ^ t ^ (t << 14);
+    t = (y ^ (y >> 14)) & 0x0000CCCCUL;
+    y = y ^ t ^ (t << 14);
+
+    t = (x & 0xF0F0F0F0UL) | ((y >> 4) & 0x0F0F0F0FUL);
+    y = ((x << 4) & 0xF0F0F0F0UL) | (y & 0x0F0F0F0FUL);
+    x = t;
+
+    rows[0]          = y;
+    rows[stride]     = y >> 8;
+    rows[2 * stride] = y >> 16;
+    rows[3 * stride] = y >> 24;
+    rows[4 * stride] = x;
+    rows[5 * stride] = x >> 8;
+}
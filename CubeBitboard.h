@@ -0,0 +1,56 @@
+/*
+* CubeBitboard.h - Whole-frame transforms for the CubeEngine library.
+*/
+#ifndef CubeBitboard_h
+#define CubeBitboard_h
+
+#include "Arduino.h"
+#include "CubeEngine.h"
+
+class CubeBitboard
+{
+    public:
+
+        // The axes, named after the sprite coordinates
+        static const byte AXIS_X = 0;
+        static const byte AXIS_Y = 1;
+        static const byte AXIS_Z = 2;
+
+        // Bitboard constructor
+        CubeBitboard(CubeEngine &engine);
+
+        // Framebuffer functions
+        // Transforms only change the bitboard until it's stored, so several
+        // can be chained for the cost of one load and one store.
+        void load();
+        void store();
+        void clear();
+
+        // Row access
+        // A row is the six LEDs along z at one (x, y), one bit per LED
+        byte getRow(byte x, byte y);
+        void setRow(byte x, byte y, byte bits, byte colour);
+
+        // Transform functions
+        void shift(byte axis, int amount, bool wrap);
+        void mirror(byte axis);
+        void rotate(byte axis);
+
+    private:
+
+        CubeEngine *engine;
+
+        // The frame as two bit-planes, one for each bit of the LED colour codes
+        // Byte (x * 6) + y holds the row along z in bits 0-5. Moving the planes
+        // together moves every colour.
+        byte low[36];
+        byte high[36];
+
+        // Plane transforms
+        void shiftPlane(byte *plane, byte axis, int amount, bool wrap);
+        void mirrorPlane(byte *plane, byte axis);
+        void rotatePlane(byte *plane, byte axis);
+        void transpose(byte *rows, byte stride);
+};
+
+#endif
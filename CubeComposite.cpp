@@ -0,0 +1,332 @@
+#include "CubeComposite.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+/*
+ * Spreads a 3-bit line of the shape into 2-bit LED masks
+ */
+static const byte COMPOSITE_LINE_MASKS[8] PROGMEM = {
+    B00000000, B00000011, B00001100, B00001111,
+    B00110000, B00110011, B00111100, B00111111
+};
+
+/**
+ * This constructor creates an empty, hidden, red composite at (0,0,0)
+ */
+CubeComposite::CubeComposite(CubeEngine &engine) {
+
+    this->engine  = &engine;
+    this->shape   = 0;
+    this->extentX = 0;
+    this->extentY = 0;
+    this->extentZ = 0;
+    this->x       = 0;
+    this->y       = 0;
+    this->z       = 0;
+    this->colour  = engine.AV_RED;
+    this->wrap    = false;
+    this->visible = false;
+}
+
+/*
+ * Returns the shape bit of one voxel of the 3x3x3 box
+ */
+unsigned long CubeComposite::voxel(byte dx, byte dy, byte dz) {
+    if (dx > 2 || dy > 2 || dz > 2) {
+        return 0;
+    }
+
+    return 1UL << ((dx * 9) + (dy * 3) + dz);
+}
+
+/*
+ * Changes the shape, keeping the anchor where it is
+ */
+void CubeComposite::setShape(unsigned long shape) {
+
+    if (this->visible) {
+        this->paint(this->x, this->y, this->z, 0);
+    }
+
+    this->shape   = shape;
+    this->extentX = 0;
+    this->extentY = 0;
+    this->extentZ = 0;
+
+    // Find how far the shape reaches along each axis
+    for (byte dx = 0; dx < 3; dx++) {
+        for (byte dy = 0; dy < 3; dy++) {
+            byte bits = (shape >> ((dx * 9) + (dy * 3))) & B00000111;
+
+            if (bits) {
+                this->extentX = dx;
+                if (dy > this->extentY) {
+                    this->extentY = dy;
+                }
+                if (bits > B00000011) {
+                    this->extentZ = 2;
+                } else if (bits > B00000001 && this->extentZ < 1) {
+                    this->extentZ = 1;
+                }
+            }
+        }
+    }
+
+    if (this->visible) {
+        this->paint(this->x, this->y, this->z, this->colour >> 6);
+    }
+}
+
+/*
+ * Sets the colour using the AV_ colour values
+ */
+void CubeComposite::setColour(byte colour) {
+    this->colour = colour;
+
+    if (this->visible) {
+        this->paint(this->x, this->y, this->z, this->colour >> 6);
+    }
+}
+
+/*
+ * Sets whether the composite wraps around the edges of the cube
+ */
+void CubeComposite::setWrap(bool wrap) {
+    this->wrap = wrap;
+}
+
+/*
+ * Draws the composite
+ *
+ * Showing doesn't check for collisions, so place the composite with
+ * setPosition() first if it matters.
+ */
+void CubeComposite::show() {
+    this->visible = true;
+    this->paint(this->x, this->y, this->z, this->colour >> 6);
+}
+
+/*
+ * Removes the composite from the display
+ */
+void CubeComposite::hide() {
+    if (this->visible) {
+        this->paint(this->x, this->y, this->z, 0);
+    }
+
+    this->visible = false;
+}
+
+byte CubeComposite::getX() {
+    return this->x;
+}
+
+byte CubeComposite::getY() {
+    return this->y;
+}
+
+byte CubeComposite::getZ() {
+    return this->z;
+}
+
+/*
+ * Moves the anchor to a new position
+ *
+ * Without wrap the whole shape has to fit inside the cube.
+ */
+bool CubeComposite::setPosition(byte x, byte y, byte z) {
+
+    if (x > 5 || y > 5 || z > 5) {
+        return false;
+    }
+
+    if (!this->wrap && (x + this->extentX > 5 || y + this->extentY > 5 || z + this->extentZ > 5)) {
+        return false;
+    }
+
+    // Hidden composites don't collide with anything
+    if (!this->visible) {
+        this->x = x;
+        this->y = y;
+        this->z = z;
+        return true;
+    }
+
+    // Take the composite off the display so it can't collide with itself
+    this->paint(this->x, this->y, this->z, 0);
+
+    if (this->overlaps(x, y, z)) {
+        this->paint(this->x, this->y, this->z, this->colour >> 6);
+        return false;
+    }
+
+    this->x = x;
+    this->y = y;
+    this->z = z;
+    this->paint(x, y, z, this->colour >> 6);
+
+    return true;
+}
+
+/*
+ * Moves the composite one step using the AV_ direction values
+ *
+ * Like moveSprite(), each axis moves on its own, so a diagonal move
+ * against a wall slides along it.
+ */
+bool CubeComposite::move(byte direction) {
+
+    byte steps = CubeEngine::getDirectionSteps(direction);
+
+    byte newX = this->moveAxis(this->x, (steps >> 4) & 3, this->extentX);
+    byte newY = this->moveAxis(this->y, (steps >> 2) & 3, this->extentY);
+    byte newZ = this->moveAxis(this->z, steps & 3, this->extentZ);
+
+    if (newX == this->x && newY == this->y && newZ == this->z) {
+        return false;
+    }
+
+    return this->setPosition(newX, newY, newZ);
+}
+
+/*
+ * Returns true if the composite would overlap a lit LED at a position
+ */
+bool CubeComposite::collides(byte x, byte y, byte z) {
+
+    if (this->visible) {
+        this->paint(this->x, this->y, this->z, 0);
+    }
+
+    bool result = this->overlaps(x, y, z);
+
+    if (this->visible) {
+        this->paint(this->x, this->y, this->z, this->colour >> 6);
+    }
+
+    return result;
+}
+
+/*
+ * Writes the shape into the data array with a 2-bit colour code
+ */
+void CubeComposite::paint(byte x, byte y, byte z, byte code) {
+    this->apply(x, y, z, code, false);
+}
+
+/*
+ * Returns true if any voxel of the shape at a position is already lit
+ */
+bool CubeComposite::overlaps(byte x, byte y, byte z) {
+    return this->apply(x, y, z, 0, true);
+}
+
+/*
+ * Paints or tests the shape at a position
+ *
+ * Each line of the shape along z is at most three LEDs (six bits), so it
+ * is handled with one masked 16-bit read-modify-write instead of a
+ * setLED() call per LED. When testing, returns true as soon as a line
+ * overlaps a lit LED.
+ */
+bool CubeComposite::apply(byte x, byte y, byte z, byte code, bool test) {
+
+    // Repeat the code across every LED position of a word
+    unsigned int colours = code * 0x5555;
+
+    for (byte dx = 0; dx < 3; dx++) {
+        byte layer = x + dx;
+        if (layer > 5) {
+            if (!this->wrap) {
+                break;
+            }
+            layer -= 6;
+        }
+
+        for (byte dy = 0; dy < 3; dy++) {
+            byte row = y + dy;
+            if (row > 5) {
+                if (!this->wrap) {
+                    break;
+                }
+                row -= 6;
+            }
+
+            byte bits = (this->shape >> ((dx * 9) + (dy * 3))) & B00000111;
+            if (bits == 0) {
+                continue;
+            }
+
+            // Split the line where it runs off the end of the row
+            byte column = z;
+            byte fit    = 6 - z;
+            byte spill  = 0;
+            if (fit < 3) {
+                spill = bits >> fit;
+                bits &= (1 << fit) - 1;
+            }
+
+            while (true) {
+                int led           = (layer * 36) + (row * 6) + column;
+                byte index        = led >> 2;
+                byte shift        = (led & 3) << 1;
+                unsigned int mask = (unsigned int) pgm_read_byte(&COMPOSITE_LINE_MASKS[bits]) << shift;
+
+                unsigned int word = this->engine->data[index];
+                if (mask >> 8) {
+                    word |= this->engine->data[index + 1] << 8;
+                }
+
+                if (test) {
+                    if (word & mask) {
+                        return true;
+                    }
+
+                } else {
+                    word = (word & ~mask) | (colours & mask);
+
+                    this->engine->writeData(this->engine->data, index, word);
+                    if (mask >> 8) {
+                        this->engine->writeData(this->engine->data, index + 1, word >> 8);
+                    }
+                }
+
+                // Wrap the rest of the line to the start of the row
+                if (spill == 0 || !this->wrap) {
+                    break;
+                }
+                bits   = spill;
+                spill  = 0;
+                column = 0;
+            }
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Moves an anchor coordinate one step (0 = back, 1 = stay, 2 = forward)
+ */
+byte CubeComposite::moveAxis(byte pos, byte step, byte extent) {
+
+    if (step == 2) {
+        if (pos + extent < 5) {
+            return pos + 1;
+        } else if (this->wrap) {
+            return (pos == 5) ? 0 : pos + 1;
+        }
+
+    } else if (step == 0) {
+        if (pos > 0) {
+            return pos - 1;
+        } else if (this->wrap) {
+            return 5;
+        }
+    }
+
+    return pos;
+}
@@ -0,0 +1,63 @@
+/*
+* CubeComposite.h - Multi-LED sprites for the CubeEngine library.
+*/
+#ifndef CubeComposite_h
+#define CubeComposite_h
+
+#include "Arduino.h"
+#include "CubeEngine.h"
+
+class CubeComposite
+{
+    public:
+
+        // Composite sprite constructor
+        CubeComposite(CubeEngine &engine);
+
+        // Builds a shape one voxel at a time, e.g.
+        //   shape = voxel(0,0,0) | voxel(1,0,0) | voxel(0,1,0)
+        static unsigned long voxel(byte dx, byte dy, byte dz);
+
+        // Attribute functions
+        void setShape(unsigned long shape);
+        void setColour(byte colour);
+        void setWrap(bool wrap);
+        void show();
+        void hide();
+        byte getX();
+        byte getY();
+        byte getZ();
+
+        // Movement functions
+        // These return false, and leave the sprite where it was, if the
+        // new position would overlap a lit LED
+        bool setPosition(byte x, byte y, byte z);
+        bool move(byte direction);
+        bool collides(byte x, byte y, byte z);
+
+    private:
+
+        CubeEngine *engine;
+
+        // The shape is a 3x3x3 box of voxels relative to the anchor
+        // Bits (dx * 9) + (dy * 3) + 0-2 hold one line of the box along z,
+        // which is also the order LEDs are packed into the data array.
+        unsigned long shape;
+
+        // Largest offset used by the shape on each axis
+        byte extentX, extentY, extentZ;
+
+        // Anchor position and appearance
+        byte x, y, z;
+        byte colour;
+        bool wrap;
+        bool visible;
+
+        // Painting functions
+        void paint(byte x, byte y, byte z, byte code);
+        bool overlaps(byte x, byte y, byte z);
+        bool apply(byte x, byte y, byte z, byte code, bool test);
+        byte moveAxis(byte pos, byte step, byte extent);
+};
+
+#endif
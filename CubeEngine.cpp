@@ -1,10 +1,62 @@
 #include "CubeEngine.h" 
+#include "CubeInput.h"
+#include "CubeJournal.h"
+#include "CubePins.h"
 #if defined(ARDUINO) && ARDUINO >= 100
   #include "Arduino.h"
 #else
   #include "WProgram.h"
 #endif
 
+/*
+ * Axis steps for each direction
+ *
+ * Each entry packs the x, y and z steps as (step + 1) in bits 4-5, 2-3
+ * and 0-1. Entry n is the AV_ direction with value n << 3. This matches
+ * the moveX/moveY/moveZ calls made by moveSprite().
+ */
+static const byte MOVE_DIRECTION_STEPS[14] PROGMEM = {
+    B00011001, // up               ( 0, +1,  0)
+    B00010001, // down             ( 0, -1,  0)
+    B00000101, // left             (-1,  0,  0)
+    B00100101, // right            (+1,  0,  0)
+    B00010110, // back             ( 0,  0, +1)
+    B00010100, // front            ( 0,  0, -1)
+    B00001010, // back up left     (-1, +1, +1)
+    B00101010, // back up right    (+1, +1, +1)
+    B00000010, // back down left   (-1, -1, +1)
+    B00100010, // back down right  (+1, -1, +1)
+    B00001000, // front up left    (-1, +1, -1)
+    B00101000, // front up right   (+1, +1, -1)
+    B00000000, // front down left  (-1, -1, -1)
+    B00100000  // front down right (+1, -1, -1)
+};
+
+/*
+ * Frames in bit-reversed order
+ *
+ * Showing a pass on the frames whose entry is below n spreads the n
+ * frames evenly over the 16.
+ */
+static const byte REFRESH_FRAME_ORDER[16] PROGMEM = {
+    0,  8, 4, 12, 2, 10, 6, 14,
+    1,  9, 5, 13, 3, 11, 7, 15
+};
+
+/*
+ * Default equalisation table
+ *
+ * Frames in 16 that a pass is shown for each number of LEDs it lights.
+ * A full layer is shown every frame and an almost empty one on 10, which
+ * suits the cube's layer drivers. Measure a cube with a light meter and
+ * pass a table of its own to setEqualisation() for a closer match.
+ */
+const byte CubeEngine::EQUALISATION_DEFAULT[37] PROGMEM = {
+    10, 10, 10, 11, 11, 11, 11, 11, 12, 12,  // 0-9
+    12, 12, 12, 12, 13, 13, 13, 13, 13, 13,  // 10-19
+    14, 14, 14, 14, 14, 14, 15, 15, 15, 15,  // 20-29
+    15, 15, 16, 16, 16, 16, 16               // 30-36
+};
 
 /***********************************
  * BEGIN ENGINE SPECIFIC CODE
@@ -12,49 +64,152 @@
 
 /**
  * This constructor sets the Arduino pins and clears both the shift-registers and data array
+ *
+ * The default wiring (A1, A3, A2, 2-7) is driven with the compile-time pin
+ * map. Any other wiring works through the port registers looked up here,
+ * which is slower; use a CubePinMap from CubePins.h to keep full speed.
+ * Boards other than AVRs have no such registers, so every wiring there
+ * goes through digitalWrite().
  */
 CubeEngine::CubeEngine(int latchPin, int clockPin, int dataPin,
                       int layer0, int layer1, int layer2,
                       int layer3, int layer4, int layer5) {
 
-    // Set clases private members
-    this->latchPin = latchPin;
-    this->clockPin = clockPin;
-    this->dataPin  = dataPin;
-    this->layer0   = layer0;
-    this->layer1   = layer1;
-    this->layer2   = layer2;
-    this->layer3   = layer3;
-    this->layer4   = layer4;
-    this->layer5   = layer5;
-
-    //set pins to output
-    pinMode(this->latchPin, OUTPUT);
-    pinMode(this->clockPin, OUTPUT);
-    pinMode(this->dataPin, OUTPUT);
-
-    // Set register pins in known state
-    digitalWrite(this->clockPin, LOW);  
-    digitalWrite(this->latchPin, LOW); 
-    digitalWrite(this->dataPin, LOW);  
-
-    // Set layer pins to output
-    pinMode(this->layer0, OUTPUT);
-    pinMode(this->layer1, OUTPUT);
-    pinMode(this->layer2, OUTPUT);
-    pinMode(this->layer3, OUTPUT);
-    pinMode(this->layer4, OUTPUT);
-    pinMode(this->layer5, OUTPUT); 
+    int pins[9] = {latchPin, clockPin, dataPin,
+                   layer0, layer1, layer2, layer3, layer4, layer5};
+
+    // Set pins to output, all low
+    for (byte i = 0; i < 9; i++) {
+        pinMode(pins[i], OUTPUT);
+        digitalWrite(pins[i], LOW);
+    }
+
+#if CUBE_PORTS_SUPPORTED
+    // The parallel chains share the data pin's port
+    this->chainPort     = digitalPinToPort(dataPin);
+    this->chainReserved = 0;
+    for (byte i = 0; i < 2; i++) {
+        if (digitalPinToPort(pins[i]) == this->chainPort) {
+            this->chainReserved |= digitalPinToBitMask(pins[i]);
+        }
+    }
+#else
+    // Parallel chains need a port register
+    this->chainPort     = 0;
+    this->chainReserved = 0xFF;
+#endif
+
+    this->runtimePins    = NULL;
+    this->driveRegisters = NULL;
+
+#if CUBE_PINS_SUPPORTED
+    if (latchPin == A1 && clockPin == A3 && dataPin == A2 &&
+        layer0 == 2 && layer1 == 3 && layer2 == 4 &&
+        layer3 == 5 && layer4 == 6 && layer5 == 7) {
+        this->driveRegisters = &CubeEngine::drive<CubeDefaultPins>;
+    }
+#endif
+
+    // Any other wiring keeps its pins
+    if (this->driveRegisters == NULL) {
+        this->runtimePins    = new CubeRuntimePins(pins);
+        this->driveRegisters = &CubeEngine::drive<CubeRuntimePins>;
+    }
+
+    this->initialise();
+}
+
+/**
+ * This constructor runs the engine without a cube
+ *
+ * Nothing here touches a pin or a global, so each engine depends only on
+ * its host. Parallel chains need real pins, so setShiftChains() refuses
+ * them.
+ */
+CubeEngine::CubeEngine(CubeHost *host) {
+
+    this->runtimePins   = NULL;
+    this->chainPort     = 0;
+    this->chainReserved = 0xFF;
+
+    this->driveRegisters = &CubeEngine::driveHost;
+
+    this->initialise();
+    this->host = host;
+}
+
+/**
+ * This destructor gives back the runtime pins, if the engine made them
+ */
+CubeEngine::~CubeEngine() {
+    delete this->runtimePins;
+}
+
+/*
+ * RAM budget
+ *
+ * With the default 25 sprites an engine is 242 bytes on AVR, and each
+ * extra sprite adds 4:
+ *
+ *   sprites 100, automove timers 28, register driver 4, refresh
+ *   counters 4, lit counts 24, equalisation 3, attached managers, host
+ *   and particle overlay 8, runtime pins 2, register chains 12, frames 57
+ *
+ * The constants in the class are static and built into the code. A
+ * wiring only known at run time adds 27 bytes of ports and masks on the
+ * heap, and chained cubes keep their frames in the sketch's buffer.
+ *
+ * Other hosts have wider pointers and pad between members, so their
+ * sizes are checked by the host build's test_ram instead.
+ */
+void CubeEngine::checkRamBudget() {
+#if defined(__AVR__)
+    static_assert(sizeof(CubeEngine) <= 242 + ((CUBE_SPRITE_COUNT - 25) * 4),
+                  "CubeEngine is over its RAM budget");
+#endif
+}
+
+/*
+ * Puts the engine in its starting state once the pins are set up
+ */
+void CubeEngine::initialise() {
+
+    // Drive a single cube until told otherwise
+    this->cubeCount   = 1;
+    this->extraFrames = NULL;
 
     // set data array to off
     this->killDataArray();
 
+    // Nothing is lit, and equalisation is off until a table is given
+    for (byte layer = 0; layer < 6; layer++) {
+        this->litCounts[this->PASS_BLUE_GREEN][layer] = 0;
+        this->litCounts[this->PASS_RED][layer]        = 0;
+    }
+    this->brightnessTable = NULL;
+    this->refreshFrame    = 0;
+
+    // Clear the sprites, as an engine isn't always in zeroed memory
+    for (int i = 0; i < CUBE_SPRITE_COUNT; i++) {
+        this->sprites[i] = 0;
+    }
+
+    // No host yet, killRegisters() may already drive one
+    this->host = NULL;
+
     // set all registers to off
     this->killRegisters();
 
     // Ensure variables are properly defined
     this->layerCounter = 0;
     this->mplexCounter = 0;
+    this->input        = NULL;
+    this->journal      = NULL;
+    this->overlay      = NULL;
+
+    // Use the single register chain until told otherwise
+    this->shiftChains   = 1;
+    this->chainDataMask = 0;
         
 }
 
@@ -145,14 +300,22 @@ void CubeEngine::setSpriteAttribute(int spriteNum, byte name, byte value) {
         groupNum = 2;
         mask = B11000111;
 
+    // Set cube
+    } else if (name == this->AN_CUBE) {
+        groupNum = 3;
+        mask = B10001111;
+
+        // Shift value into cube position
+        value = value << 4;
+
     }
 
     // kill LED at current position is the attribute update is movement
-    if (name == this->AN_X || name == this->AN_Y || name == this->AN_Z) {
+    if (name == this->AN_X || name == this->AN_Y || name == this->AN_Z || name == this->AN_CUBE) {
       // Get current coordinates
       int x = getSpriteAttribute(spriteNum, this->AN_X);
       int y = getSpriteAttribute(spriteNum, this->AN_Y);
-      int z = getSpriteAttribute(spriteNum, this->AN_Z);
+      int z = getSpriteColumn(spriteNum);
   
       // Turn off current LED
       // This removes the need to manually sync the attribute and data arrays
@@ -186,6 +349,12 @@ void CubeEngine::writeSpriteAttribute(int spriteNum, int groupNum, byte group) {
     byte groupTwo   = this->getGroup(spriteNum, 2);
     byte groupThree = this->getGroup(spriteNum, 3);
 
+    // Every sprite change passes through here, so the journal sees the old
+    // group before it's overwritten
+    if (this->journal != NULL) {
+        this->journal->record(spriteNum, groupNum, this->getGroup(spriteNum, groupNum), group);
+    }
+
     // Overwrite group to be updated
     switch (groupNum) {
         case 0:
@@ -216,12 +385,12 @@ void CubeEngine::writeSpriteAttribute(int spriteNum, int groupNum, byte group) {
       (this->getSpriteAttribute(spriteNum, AN_STATE) == AV_LIVE)) {
          this->setLED(this->getSpriteAttribute(spriteNum, AN_X),
           this->getSpriteAttribute(spriteNum, AN_Y), 
-          this->getSpriteAttribute(spriteNum, AN_Z), 
+          this->getSpriteColumn(spriteNum), 
           this->getSpriteAttribute(spriteNum, AN_COLOUR));
       } else {
         this->setLED(this->getSpriteAttribute(spriteNum, AN_X),
           this->getSpriteAttribute(spriteNum, AN_Y), 
-          this->getSpriteAttribute(spriteNum, AN_Z), 
+          this->getSpriteColumn(spriteNum), 
           this->getSpriteAttribute(spriteNum, AN_COLOUR));
       }
 
@@ -288,12 +457,26 @@ byte CubeEngine::getSpriteAttribute(int spriteNum, byte name) {
     } else if (name == this->AN_ATTACK) {
         group = this->getAttribute(spriteNum, 2, B00111000, 0);
 
+    // Get cube
+    } else if (name == this->AN_CUBE) {
+        group = this->getAttribute(spriteNum, 3, B01110000, 4);
+
     }
 
     // Return the attribute value
     return group;
 }
 
+/*
+ * Returns the sprite's z-coordinate across all the cubes
+ *
+ * This is the column passed to setLED().
+ */
+int CubeEngine::getSpriteColumn(int spriteNum) {
+    return (this->getSpriteAttribute(spriteNum, this->AN_CUBE) * 6)
+        + this->getSpriteAttribute(spriteNum, this->AN_Z);
+}
+
 /**
  * Returns the requested sprite attribute
  */
@@ -323,7 +506,7 @@ byte CubeEngine::getAttribute(int spriteNum, int groupNum, byte mask, int shift)
 void CubeEngine::setRandomSpriteColour(int spriteNum) {
 
     // Used for switching so we can use the preset values
-    long switchVal = random(0,3);
+    long switchVal = this->getRandom(0,3);
 
     // Holds the selected colour
     byte colour;
@@ -348,9 +531,14 @@ void CubeEngine::setRandomSpriteColour(int spriteNum) {
  * Moves a sprite to a random position 
  */
 void CubeEngine::setRandomSpritePosition(int spriteNum) {
-    this->setSpriteAttribute(spriteNum, this->AN_X, random(0,5));
-    this->setSpriteAttribute(spriteNum, this->AN_Y, random(0,5));
-    this->setSpriteAttribute(spriteNum, this->AN_Z, random(0,5));
+    this->setSpriteAttribute(spriteNum, this->AN_X, this->getRandom(0,5));
+    this->setSpriteAttribute(spriteNum, this->AN_Y, this->getRandom(0,5));
+    this->setSpriteAttribute(spriteNum, this->AN_Z, this->getRandom(0,5));
+
+    // Pick a cube when several are chained
+    if (this->cubeCount > 1) {
+        this->setSpriteAttribute(spriteNum, this->AN_CUBE, this->getRandom(0, this->cubeCount));
+    }
 }
 
 /*
@@ -359,7 +547,7 @@ void CubeEngine::setRandomSpritePosition(int spriteNum) {
 void CubeEngine::setRandomSpriteDirection(int spriteNum) {
 
     // Used for switching so we can use the preset values
-    long switchVal = random(0,13);
+    long switchVal = this->getRandom(0,13);
 
     // Holds the selected direction
     byte direction;
@@ -527,13 +715,110 @@ void CubeEngine::moveSprite(int spriteNum, byte direction) {
 
 }
 
+/*
+ * Returns the packed x, y and z steps of a direction
+ *
+ * Use (steps >> 4) & 3, (steps >> 2) & 3 and steps & 3, each of which
+ * is the step plus one.
+ */
+byte CubeEngine::getDirectionSteps(byte direction) {
+    return pgm_read_byte(&MOVE_DIRECTION_STEPS[(direction >> 3) % 14]);
+}
+
 /*
  * Move sprite in direction of travel
  */
 void CubeEngine::autoMoveSprites() {
+    this->autoMoveSprites(this->getMillis());
+}
+
+/*
+ * Returns one of the automove timers, slowest first
+ *
+ * This lets the classes that save and send the game state walk the timers
+ * in a loop.
+ */
+unsigned long *CubeEngine::getMoveTimer(byte timer) {
+    switch (timer) {
+        case 0:  return &this->AM_SPEED0_PERIOD;
+        case 1:  return &this->AM_SPEED1_PERIOD;
+        case 2:  return &this->AM_SPEED2_PERIOD;
+        case 3:  return &this->AM_SPEED3_PERIOD;
+        case 4:  return &this->AM_SPEED4_PERIOD;
+        case 5:  return &this->AM_SPEED5_PERIOD;
+        default: return &this->AM_SPEED6_PERIOD;
+    }
+}
+
+/*
+ * Returns the milliseconds between moves for one of the automove timers
+ */
+unsigned int CubeEngine::getMoveDelay(byte timer) {
+    switch (timer) {
+        case 0:  return this->AM_SPEED0_DIF;
+        case 1:  return this->AM_SPEED1_DIF;
+        case 2:  return this->AM_SPEED2_DIF;
+        case 3:  return this->AM_SPEED3_DIF;
+        case 4:  return this->AM_SPEED4_DIF;
+        case 5:  return this->AM_SPEED5_DIF;
+        default: return this->AM_SPEED6_DIF;
+    }
+}
+
+/*
+ * Returns the milliseconds until autoMoveSprites() next moves a sprite
+ */
+unsigned long CubeEngine::getMillisToMove() {
+    return this->getMillisToMove(this->getMillis());
+}
+
+/*
+ * Returns the milliseconds from the given time until autoMoveSprites()
+ * next moves a sprite
+ *
+ * Only the speeds of sprites that are moving count. Returns 0 if a move
+ * is due now and 0xFFFFFFFF if nothing is moving.
+ */
+unsigned long CubeEngine::getMillisToMove(unsigned long curTimeStamp) {
+
+    // flags which speeds are in use, one bit per speed value
+    byte speeds = 0;
+    for (int i = SPRITE_SIZE; i >= 0; i--) {
+        if (this->getSpriteAttribute(i, this->AN_MOVE) != this->AV_NOMOVE) {
+            speeds |= 1 << this->getSpriteAttribute(i, this->AN_SPEED);
+        }
+    }
 
-    // get current time difference
-    unsigned long curTimeStamp = millis();
+    unsigned long next = 0xFFFFFFFF;
+
+    for (byte timer = 0; timer < 7; timer++) {
+        byte speed = (timer == 6) ? this->AV_SPEED6 : timer;
+        if ((speeds & (1 << speed)) == 0) {
+            continue;
+        }
+
+        // A speed moves once more than its delay has passed
+        unsigned long elapsed = curTimeStamp - *this->getMoveTimer(timer);
+        unsigned long delay   = this->getMoveDelay(timer);
+
+        if (elapsed > delay) {
+            return 0;
+        }
+        if (delay + 1 - elapsed < next) {
+            next = delay + 1 - elapsed;
+        }
+    }
+
+    return next;
+}
+
+/*
+ * Moves sprites with movement enabled, using the given time in milliseconds
+ *
+ * A tick driver passes its game time here so movement keeps pace with the
+ * game logic rather than the wall clock.
+ */
+void CubeEngine::autoMoveSprites(unsigned long curTimeStamp) {
 
     // flags which speeds can move
     bool canMove0 = curTimeStamp - this->AM_SPEED0_PERIOD > this->AM_SPEED0_DIF;
@@ -666,11 +951,21 @@ void CubeEngine::moveZ(int spriteNum, byte direction) {
     byte pos_z = this->getSpriteAttribute(spriteNum, this->AN_Z);
     byte wrap = this->getSpriteAttribute(spriteNum, this->AN_WRAP);
 
+    // Chained cubes continue each other along z
+    byte cube = this->getSpriteAttribute(spriteNum, this->AN_CUBE);
+    byte lastCube = this->cubeCount - 1;
+
     // move left
     if (direction == this->AV_FRONT) {
         if (pos_z > 0) {
             setSpriteAttribute(spriteNum, this->AN_Z, pos_z - 1);
+        } else if (cube > 0) {                                      // Cross into the previous cube
+            setSpriteAttribute(spriteNum, this->AN_CUBE, cube - 1);
+            setSpriteAttribute(spriteNum, this->AN_Z, 5);
         } else if (pos_z == 0 && wrap == this->AV_WRAP) {
+            if (lastCube > 0) {
+                setSpriteAttribute(spriteNum, this->AN_CUBE, lastCube);
+            }
             setSpriteAttribute(spriteNum, this->AN_Z, 5);
         }
 
@@ -678,7 +973,13 @@ void CubeEngine::moveZ(int spriteNum, byte direction) {
     } else if (direction == this->AV_BACK) {
         if (pos_z < 5) {
             setSpriteAttribute(spriteNum, this->AN_Z, pos_z + 1);
+        } else if (cube < lastCube) {                               // Cross into the next cube
+            setSpriteAttribute(spriteNum, this->AN_CUBE, cube + 1);
+            setSpriteAttribute(spriteNum, this->AN_Z, 0);
         } else if (pos_z == 5 && wrap == this->AV_WRAP) {
+            if (lastCube > 0) {
+                setSpriteAttribute(spriteNum, this->AN_CUBE, 0);
+            }
             setSpriteAttribute(spriteNum, this->AN_Z, 0);
         }
     }
@@ -704,16 +1005,26 @@ void CubeEngine::moveZ(int spriteNum, byte direction) {
  *
  * (y,z,x), where y = vertical, z = depth, x = horizontal
  *
+ * When cubes are chained the columns carry on into the next cube,
+ * so column 6 is column 0 of cube 1, and so on.
+ *
  * This is the only function which updates the data array
  * after it's beein initialized by setup.
  */
 void CubeEngine::setLED(int layerPos, int rowPos, int columnPos, byte colour) {
 
     // Do nothing for invalid co-ordinates
-    if (layerPos > 5 || rowPos > 5 || columnPos > 5) {
+    if (layerPos > 5 || rowPos > 5 || columnPos >= (6 * this->cubeCount)) {
         return;
     }
 
+    // Find which cube's data array holds the column
+    byte *frame = this->data;
+    if (columnPos > 5) {
+        frame     = this->getCubeData(columnPos / 6);
+        columnPos = columnPos % 6;
+    }
+
     /*
      * The below two formulas convert the cubes 3D structure (represented as
      * a three-point coordinate system) into the data arrays 2D structure.
@@ -730,7 +1041,7 @@ void CubeEngine::setLED(int layerPos, int rowPos, int columnPos, byte colour) {
     int offSet = ((rowPos * 12) + (columnPos * 2)) % 8;
 
     // Get the codes contained in data element
-    byte codes = this->data[index];
+    byte codes = frame[index];
     
     // Update the code
     switch (offSet) {
@@ -762,10 +1073,123 @@ void CubeEngine::setLED(int layerPos, int rowPos, int columnPos, byte colour) {
     }
 
     // Update the element with the new code
-    this->data[index] = codes;
+    this->writeData(frame, index, codes);
+
+    // Even in the same colour, the LED is no longer a particle's
+    this->releaseOverlay(frame, index, B00000011 << offSet);
 
 }
 
+/*
+ * Returns the colour of an LED
+ *
+ * This reads the data array the same way setLED() writes it, so it sees
+ * sprites and anything drawn directly.
+ */
+byte CubeEngine::getLED(int layerPos, int rowPos, int columnPos) {
+
+    // Nothing is lit outside the cube
+    if (layerPos < 0 || rowPos < 0 || columnPos < 0 ||
+        layerPos > 5 || rowPos > 5 || columnPos >= (6 * this->cubeCount)) {
+        return this->AV_OFF;
+    }
+
+    byte *frame = this->getCubeData(columnPos / 6);
+    columnPos   = columnPos % 6;
+
+    int index  = (((72 * layerPos) + (rowPos * 12) + (columnPos * 2))  / 8);
+    int offSet = ((rowPos * 12) + (columnPos * 2)) % 8;
+
+    // Move the code to the top bits, where the AV_ colours keep it
+    return ((frame[index] >> offSet) & B00000011) << 6;
+}
+
+/*
+ * A batch of LED writes under way
+ *
+ * Writes to one cube are sorted into a bucket for each of its 54 data
+ * bytes: the bits written so far and the codes written into them. Only
+ * when the batch moves to another cube, or ends, is each byte read,
+ * changed and stored once, with its lit counts, however the list was
+ * ordered. The buckets are 108 bytes of stack for the length of the call.
+ */
+struct CubeLEDBatch
+{
+    byte *frame;        // data array of the cube being written
+    unsigned int base;  // number of its first LED
+    byte masks[54];     // bits of each byte written
+    byte codes[54];     // codes written into those bits
+
+    CubeLEDBatch() {
+        this->frame = NULL;
+        this->base  = 0;
+
+        for (byte i = 0; i < 54; i++) {
+            this->masks[i] = 0;
+            this->codes[i] = 0;
+        }
+    }
+};
+
+/*
+ * Returns the batch number of an LED
+ *
+ * The co-ordinates aren't checked.
+ */
+unsigned int CubeEngine::getLEDNumber(int layerPos, int rowPos, int columnPos) {
+    return ((columnPos / 6) * 216) + (layerPos * 36) + (rowPos * 6) + (columnPos % 6);
+}
+
+/*
+ * Returns an LED's batch number packed with a colour
+ */
+unsigned int CubeEngine::getVoxel(int layerPos, int rowPos, int columnPos, byte colour) {
+    return getLEDNumber(layerPos, rowPos, columnPos) | ((unsigned int) colour << 8);
+}
+
+/*
+ * Sets a list of LEDs to one colour
+ */
+void CubeEngine::setLEDs(const unsigned int *leds, int count, byte colour) {
+
+    CubeLEDBatch batch;
+    byte code = colour >> 6;
+
+    for (int i = 0; i < count; i++) {
+        this->batchLED(batch, leds[i], code);
+    }
+
+    this->finishBatch(batch);
+}
+
+/*
+ * Sets a list of LEDs, each to its own colour
+ */
+void CubeEngine::setLEDs(const unsigned int *leds, const byte *colours, int count) {
+
+    CubeLEDBatch batch;
+
+    for (int i = 0; i < count; i++) {
+        this->batchLED(batch, leds[i], colours[i] >> 6);
+    }
+
+    this->finishBatch(batch);
+}
+
+/*
+ * Sets a list of voxels, each LED to the colour packed with it
+ */
+void CubeEngine::setLEDs(const unsigned int *voxels, int count) {
+
+    CubeLEDBatch batch;
+
+    for (int i = 0; i < count; i++) {
+        this->batchLED(batch, voxels[i] & 0x3FFF, voxels[i] >> 14);
+    }
+
+    this->finishBatch(batch);
+}
+
 /*
  * Multiplexes the LEDs
  *
@@ -774,6 +1198,8 @@ void CubeEngine::setLED(int layerPos, int rowPos, int columnPos, byte colour) {
  *
  * It favours direct port manipulation over digitalWrites
  * http://www.arduino.cc/en/Reference/PortManipulation
+ * The pin writes themselves are in drive() (CubePins.h), which is built
+ * for the cube's pin map so each one is a single instruction.
  *
  * Red LEDs can't coexist on the same layer as Blue and Green LEDs
  * at the same time so they must be displayed separately.
@@ -783,234 +1209,471 @@ void CubeEngine::mplex() {
     // Loop back to layer 0 if required
     if (this->layerCounter == 6) {
         this->layerCounter = 0;
+        this->refreshFrame = (this->refreshFrame + 1) & 0x0F;
+
+        // Let the input manager know a full frame has been shown
+        if (this->input != NULL) {
+            this->input->frameBoundary();
+        }
+    }
+
+    // Sample the buttons before shifting out the layer
+    if (this->input != NULL) {
+        this->input->sample();
     }
 
-    // Set which elements of the data array the LED codes are found in
-    int lower = (this->layerCounter * 72) / 8;
-    int upper = lower + 8;
+    // Shift out the layer and power it
+    // Blue/Green and Red alternate on each call
+    if (this->mplexCounter == 0) {
+        (this->*driveRegisters)(this->getRefreshPass(this->PASS_BLUE_GREEN));
+        this->mplexCounter = 1;
+    } else {
+        (this->*driveRegisters)(this->getRefreshPass(this->PASS_RED));
+        this->mplexCounter = 0;
+    }
 
-    // Turn off power to all layers (Digital Pins 2-7)
-    PORTD = B00000000;
+    // Move to the next layer
+    if (this->mplexCounter == 1) {
+        this->layerCounter += 1;
+    }
 
-    // Prepare registers for data
-    // Set latch pin (A1) to LOW
-    PORTC = PORTC & B11111101;
+}
 
-    // These variables are used to manipulate the bits which
-    // hold the colour codes in each byte
-    // Bit-shifting the data array directly mutates it, which results in buggy behaviour
-    byte colourCode, element;
+/*
+ * Register bit patterns for each LED colour code, in the order they're shifted
+ *
+ * Bit 2 goes out first. The registers are active low, so 1 is off.
+ */
+const byte CubeEngine::SHIFT_PATTERNS_BLUE_GREEN[4] PROGMEM = {
+    B00000111, // off
+    B00000111, // red, shown in the other pass
+    B00000101, // green
+    B00000011  // blue
+};
+
+const byte CubeEngine::SHIFT_PATTERNS_RED[4] PROGMEM = {
+    B00000111, // off
+    B00000110, // red
+    B00000111, // green, shown in the other pass
+    B00000111  // blue, shown in the other pass
+};
 
-    // Multiplex Green/Blue LEDs
-    if (this->mplexCounter == 0) {
+/*
+ * Splits the shift-register chain into parallel chains
+ *
+ * 'chains' must be 1, 2, 4 or 8, and 'dataPins' gives one data pin per
+ * chain. The pins must be on the same port as the cube's data pin (PORTC
+ * with the default wiring), without sharing the latch or clock bits, so
+ * the port must have a pin for every chain. PORTC on an ATmega328P has six
+ * pins, which leaves four next to the latch and clock of the default
+ * wiring; eight chains need a full port, as on a Mega. The shift is
+ * fastest when the clock is on that port too. Chain 0 takes the first
+ * 36 / chains LEDs of each layer (rounded up), which are the LEDs nearest
+ * the data pin in the single chain wiring, chain 1 the next, and so on.
+ *
+ * With chained cubes the layer is all the cubes' LEDs in chain order, so
+ * giving each cube its own chain means the data for every cube goes out
+ * at once.
+ *
+ * Returns false, and keeps the current mode, if the pins can't be used.
+ * Passing 1 goes back to the single chain on the data pin.
+ */
+bool CubeEngine::setShiftChains(byte chains, const int *dataPins) {
 
-        // Load Blue/Green LEDs into registers
-        for (int i = upper; i >= lower; i--) {
+    if (chains != 1 && chains != 2 && chains != 4 && chains != 8) {
+        return false;
+    }
 
-            // Get the current element
-            element = this->data[i];
+    // Check the port has a pin for every chain
+    byte spare = 0;
+    for (byte pin = 0; pin < NUM_DIGITAL_PINS && chains > 1; pin++) {
+        if (digitalPinToPort(pin) == this->chainPort &&
+            (digitalPinToBitMask(pin) & this->chainReserved) == 0) {
+            spare += 1;
+        }
+    }
 
-            // Cycle through the codes in each byte
-            // This cycles by 2 since the state of each LED is encoded in 2 bits
-            for (int j = 0; j < 8; j+=2) {
+    if (chains > 1 && chains > spare) {
+        return false;
+    }
 
-                // Get colour code
-                colourCode = element << j;
-                colourCode = colourCode >> 6;
+    // Check every data pin gets its own bit of the port
+    byte used = this->chainReserved;
+    byte masks[8];
 
-                // push Off LED instead of Red            
-                if (colourCode == this->REG_RED) {
+    for (byte k = 0; k < chains && chains > 1; k++) {
+        if (digitalPinToPort(dataPins[k]) != this->chainPort) {
+            return false;
+        }
 
-                    // Set data pin (A2) to high
-                    PORTC = PORTC | B00000100;
+        masks[k] = digitalPinToBitMask(dataPins[k]);
+        if (masks[k] & used) {
+            return false;
+        }
+        used |= masks[k];
+    }
 
-                    // Cycle clock pin (A3) three times
-                    PORTC = PORTC | B00001000; // HIGH
-                    PORTC = PORTC & B11110111; // LOW
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111; 
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111;
+    // Apply the new mode
+    this->shiftChains   = chains;
+    this->chainDataMask = 0;
 
-                // push Green LED
-                } else if (colourCode == this->REG_GREEN) {
+    for (byte k = 0; k < chains && chains > 1; k++) {
+        pinMode(dataPins[k], OUTPUT);
+        this->chainMasks[k]  = masks[k];
+        this->chainDataMask |= masks[k];
+    }
 
-                    // Set data pin (A2) to HIGH
-                    PORTC = PORTC | B00000100;
+    return true;
+}
 
-                    // Cycle clock pin (A3) one time 
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111;
+/*
+ * Chains several cubes into one display
+ *
+ * The cubes share the layer pins, clock and latch, and their registers
+ * follow each other on the data line (or are split across the parallel
+ * chains), with cube 0 nearest the data pin. They are placed side by side
+ * along z, so setLED() columns and sprite positions carry on from one
+ * cube into the next.
+ *
+ * Each refresh shifts the same layer of every cube before latching, so
+ * every cube stays lit for a sixth of the time, the same as a single cube.
+ *
+ * 'frames' holds the data arrays of cubes 1 and up, 54 bytes each. Cube 0
+ * keeps using the engine's own array. Returns false if 'cubes' is 0 or
+ * more than 8 (the most the AN_CUBE attribute can hold).
+ */
+bool CubeEngine::setCubeCount(byte cubes, byte *frames) {
 
-                    // Set data pin (A2) to LOW
-                    PORTC = PORTC & B11111011;
+    if (cubes == 0 || cubes > 8 || (cubes > 1 && frames == NULL)) {
+        return false;
+    }
 
-                    // Cycle clock pin (A3) one time 
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111;
+    this->cubeCount   = cubes;
+    this->extraFrames = (cubes > 1) ? frames : NULL;
 
-                    // Set data pin (A2) to HIGH
-                    PORTC = PORTC | B00000100;
+    // Start the new cubes blank
+    for (int i = (54 * (cubes - 1)) - 1; i >= 0; i--) {
+        frames[i] = 0;
+    }
 
-                    // Cycle clock pin (A3) one time 
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111;
+    // Only the first cube has anything lit now
+    this->recountLayers();
 
-                // push Blue LED
-                } else if (colourCode == this->REG_BLUE) {
+    this->killRegisters();
 
-                    // Set data pin (A2) to LOW
-                    PORTC = PORTC & B11111011;
+    return true;
+}
 
-                    // Cycle clock pin (A3) one time 
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111;
+/*
+ * Returns the number of chained cubes
+ */
+byte CubeEngine::getCubeCount() {
+    return this->cubeCount;
+}
 
-                    // Set data pin (A2) to HIGH
-                    PORTC = PORTC | B00000100;
+/*
+ * Returns the data array of one cube
+ */
+byte *CubeEngine::getCubeData(byte cube) {
+    if (cube == 0) {
+        return this->data;
+    }
 
-                    // Cycle clock pin (A3) two times
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111;
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111;
+    return this->extraFrames + ((cube - 1) * 54);
+}
 
-                // push Off LED
-                } else {
+/*
+ * Attaches a journal to record sprite changes
+ *
+ * Pass NULL to stop recording.
+ */
+void CubeEngine::attachJournal(CubeJournal *journal) {
+    this->journal = journal;
+}
 
-                    // Set data pin (A2) to high
-                    PORTC = PORTC | B00000100;
+/*
+ * Attaches an input manager to the refresh
+ *
+ * Pass NULL to stop sampling.
+ */
+void CubeEngine::attachInput(CubeInput *input) {
+    this->input = input;
+}
 
-                    // Cycle clock pin (A3) three times
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111;
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111; 
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111;
+/*
+ * Evens out the brightness of the layers
+ *
+ * The table has 37 entries in PROGMEM, one for each number of LEDs a pass
+ * of a layer can light in a cube. Each is how many frames in 16 the pass
+ * is shown, from 0 to 16. Sparse layers are brighter, so they get the
+ * lower numbers. Pass NULL to show every pass in every frame.
+ */
+void CubeEngine::setEqualisation(const byte *table) {
+    this->brightnessTable = table;
+}
 
-                }
-            }
-        }
+/*
+ * Returns how many LEDs a pass of a layer lights, over every cube
+ */
+unsigned int CubeEngine::getLitCount(byte layer, byte pass) {
+    if (layer > 5 || pass > this->PASS_RED) {
+        return 0;
+    }
 
-        // Multiplex Red
-        this->mplexCounter = 1;
+    return this->litCounts[pass][layer];
+}
+
+/*
+ * Gives the engine its own clock, random numbers and output
+ *
+ * Pass NULL to go back to the Arduino functions. An engine built with
+ * pins keeps driving them, so only its time and random numbers change.
+ */
+void CubeEngine::setHost(CubeHost *host) {
+    this->host = host;
+}
 
-    // Multiplex Red
-    } else if (this->mplexCounter == 1) {
+/*
+ * Returns milliseconds from the host's clock, or millis()
+ */
+unsigned long CubeEngine::getMillis() {
+    if (this->host != NULL && this->host->millis != NULL) {
+        return this->host->millis(this->host->context);
+    }
+
+    return millis();
+}
+
+/*
+ * Returns microseconds from the host's clock, or micros()
+ */
+unsigned long CubeEngine::getMicros() {
+    if (this->host != NULL && this->host->micros != NULL) {
+        return this->host->micros(this->host->context);
+    }
+
+    return micros();
+}
 
-        // Load Red LEDs into registers
-        for (int i = upper; i >= lower; i--) {
+/*
+ * Returns a random number from 0 to howBig - 1
+ */
+long CubeEngine::getRandom(long howBig) {
+    if (howBig <= 0) {
+        return 0;
+    }
 
-            // Get the current element
-            element = this->data[i];
+    if (this->host != NULL && this->host->random != NULL) {
+        return this->host->random(this->host->context, howBig);
+    }
 
-            // Cycle through the codes in each byte
-            for (int j = 0; j < 8; j+=2) {
+    return random(howBig);
+}
 
-                // Get colour code
-                colourCode = element << j;
-                colourCode = colourCode >> 6;
+/*
+ * Returns a random number from howSmall to howBig - 1
+ */
+long CubeEngine::getRandom(long howSmall, long howBig) {
+    if (howSmall >= howBig) {
+        return howSmall;
+    }
 
-                // Shift Red
-                if (colourCode == this->REG_RED) {
+    return howSmall + this->getRandom(howBig - howSmall);
+}
+
+/* 
+ * Ensures that the data array is set to 0 
+ *
+ * This sets all sprites to off
+ */
+void CubeEngine::killDataArray() {
+    for (int i = this->DATA_SIZE; i >= 0; i--) {
+        this->data[i] = 0;
+    }
+}
 
-                    // Set data pin (A2) to HIGH
-                    PORTC = PORTC | B00000100;
+/*
+ * Sets all registers to HIGH, which turns off the cube
+ *
+ * This pushes out 36 off LEDs for each cube
+ */
+void CubeEngine::killRegisters() {
+    (this->*driveRegisters)(this->PASS_BLANK);
+}
 
-                    // Cycle clock pin (A3) two times
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111;
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111; 
+/*
+ * Adds one LED's code to a batch
+ *
+ * Numbers past the last cube are ignored.
+ */
+void CubeEngine::batchLED(CubeLEDBatch &batch, unsigned int led, byte code) {
+
+    // Move to the LED's cube if it's another one, which is the only time
+    // a divide is needed
+    if (batch.frame == NULL || led - batch.base >= 216) {
+        unsigned int cube = led / 216;
+        if (cube >= this->cubeCount) {
+            return;
+        }
 
-                    // Set data pin (A2) to LOW
-                    PORTC = PORTC & B11111011;
+        this->finishBatch(batch);
+        batch.frame = this->getCubeData(cube);
+        batch.base  = cube * 216;
+    }
 
-                    // Cycle clock pin (A3) one time
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111;
+    unsigned int number = led - batch.base;
+    byte index = number >> 2;
+    byte shift = (number & 3) << 1;
+    byte mask  = B00000011 << shift;
 
-                // push Off for all Blue/Green LEDs
-                } else {
+    // Later writes to an LED replace earlier ones
+    batch.masks[index] |= mask;
+    batch.codes[index]  = (batch.codes[index] & ~mask) | (code << shift);
+}
 
-                    // Set data pin (A2) to high
-                    PORTC = PORTC | B00000100;
+/*
+ * Stores each byte of the cube a batch wrote to, once
+ */
+void CubeEngine::finishBatch(CubeLEDBatch &batch) {
 
-                    // Cycle clock pin (A3) three times
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111;
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111; 
-                    PORTC = PORTC | B00001000;
-                    PORTC = PORTC & B11110111;
+    if (batch.frame == NULL) {
+        return;
+    }
 
-                }
-            }
+    for (byte index = 0; index < 54; index++) {
+        byte mask = batch.masks[index];
+        if (mask == 0) {
+            continue;
         }
 
-        // Multiplex Blue/Green LEDs
-        this->mplexCounter = 0;
+        // Every LED written is the game's now, even in a particle's colour
+        this->writeData(batch.frame, index, (batch.frame[index] & ~mask) | batch.codes[index]);
+        this->releaseOverlay(batch.frame, index, mask);
+
+        batch.masks[index] = 0;
+        batch.codes[index] = 0;
     }
+}
 
-    // Signal end of data
-    // Set latch pin (A1) to HIGH
-    PORTC = PORTC | B00000010;
+/*
+ * Stores a byte of a data array and keeps the lit counts up to date
+ *
+ * Every write to a data array goes through here, so the counts are
+ * changed by the difference between the old and new byte and the frame
+ * never has to be counted again. Each layer is 9 bytes of a cube's array.
+ */
+void CubeEngine::writeData(byte *frame, int index, byte codes) {
 
-    // Supply power to the active layer
-    switch (this->layerCounter) {
-        case 0:
-            PORTD = B00000100;  // 0
-            break;
-        case 1:
-            PORTD = B00001000;
-            break;
-        case 2:
-            PORTD = B00010000;
-            break;
-        case 3:
-            PORTD = B00100000;
-            break;
-        case 4:
-            PORTD = B01000000;
-            break;
-        case 5:
-            PORTD = B10000000;  // 5
-            break;
+    byte layer = index / 9;
+    byte old   = frame[index];
+
+    this->litCounts[this->PASS_RED][layer]        += this->countCodes(codes, this->PASS_RED);
+    this->litCounts[this->PASS_RED][layer]        -= this->countCodes(old, this->PASS_RED);
+    this->litCounts[this->PASS_BLUE_GREEN][layer] += this->countCodes(codes, this->PASS_BLUE_GREEN);
+    this->litCounts[this->PASS_BLUE_GREEN][layer] -= this->countCodes(old, this->PASS_BLUE_GREEN);
+
+    this->releaseOverlay(frame, index, old ^ codes);
+    frame[index] = codes;
+}
+
+/*
+ * Takes LEDs of a data byte off the particles' overlay
+ *
+ * 'codes' has bits set in the codes of the LEDs being written. The
+ * overlay has a bit per LED, so a byte of the data array is half a byte
+ * of it.
+ */
+void CubeEngine::releaseOverlay(byte *frame, int index, byte codes) {
+
+    if (this->overlay == NULL || frame != this->data) {
+        return;
     }
 
-    // Move to the next layer
-    if (this->mplexCounter == 1) {
-        this->layerCounter += 1;
+    byte leds = (codes | (codes >> 1)) & B01010101;
+    leds = (leds & B00000001) | ((leds >> 1) & B00000010) |
+           ((leds >> 2) & B00000100) | ((leds >> 3) & B00001000);
+
+    this->overlay[index >> 1] &= ~(leds << ((index & 1) << 2));
+}
+
+/*
+ * Counts the codes in a byte that light LEDs on one pass
+ *
+ * Red (01) is lit on the red pass, green (10) and blue (11) on the other.
+ */
+byte CubeEngine::countCodes(byte codes, byte pass) {
+
+    byte lit;
+    if (pass == PASS_RED) {
+        lit = codes & ~(codes >> 1) & B01010101;
+    } else {
+        lit = (codes >> 1) & B01010101;
     }
 
+    // Add up the four bits
+    lit = (lit & B00110011) + ((lit >> 2) & B00110011);
+    return (lit & B00001111) + (lit >> 4);
 }
 
-/* 
- * Ensures that the data array is set to 0 
+/*
+ * Counts the lit LEDs of every layer from scratch
  *
- * This sets all sprites to off
+ * Only needed when the cubes change, setLED() and the other writers keep
+ * the counts as they go.
  */
-void CubeEngine::killDataArray() {
-    for (int i = this->DATA_SIZE; i >= 0; i--) {
-        this->data[i] = 0;
+void CubeEngine::recountLayers() {
+
+    for (byte layer = 0; layer < 6; layer++) {
+        this->litCounts[this->PASS_BLUE_GREEN][layer] = 0;
+        this->litCounts[this->PASS_RED][layer]        = 0;
+    }
+
+    for (byte cube = 0; cube < this->cubeCount; cube++) {
+        byte *frame = this->getCubeData(cube);
+
+        for (byte i = 0; i < 54; i++) {
+            this->litCounts[this->PASS_RED][i / 9]        += this->countCodes(frame[i], this->PASS_RED);
+            this->litCounts[this->PASS_BLUE_GREEN][i / 9] += this->countCodes(frame[i], this->PASS_BLUE_GREEN);
+        }
     }
 }
 
 /*
- * Sets all registers to HIGH, which turns off the cube
+ * Picks the pass mplex() drives for the current layer
  *
- * This pushes out 36 off LEDs
+ * With equalisation on, a pass is only shown on as many frames in 16 as
+ * the table gives for its lit count, and is dark (PASS_DARK) on the rest.
+ * The frames are taken in bit-reversed order so the dark ones are spread
+ * out rather than bunched together.
  */
-void CubeEngine::killRegisters() {
-    for (int i = 0; i <= 35; i++) {
-        digitalWrite(this->dataPin, HIGH);
-        digitalWrite(this->clockPin, HIGH);
-        digitalWrite(this->clockPin, LOW); 
-        digitalWrite(this->clockPin, HIGH);
-        digitalWrite(this->clockPin, LOW); 
-        digitalWrite(this->clockPin, HIGH);
-        digitalWrite(this->clockPin, LOW); 
+byte CubeEngine::getRefreshPass(byte pass) {
+
+    if (this->brightnessTable == NULL) {
+        return pass;
+    }
+
+    // The count may be read half-written while the sketch changes it,
+    // which only affects this one pass
+    unsigned int lit = this->litCounts[pass][this->layerCounter];
+    if (this->cubeCount > 1) {
+        lit = lit / this->cubeCount;
+    }
+    if (lit > 36) {
+        lit = 36;
+    }
+
+    byte shown = pgm_read_byte(&this->brightnessTable[lit]);
+    byte order = pgm_read_byte(&REFRESH_FRAME_ORDER[this->refreshFrame]);
+
+    return (order < shown) ? pass : this->PASS_DARK;
+}
+
+/*
+ * Passes one pass of mplex() to the host instead of the pins
+ */
+void CubeEngine::driveHost(byte pass) {
+    if (this->host != NULL && this->host->output != NULL) {
+        this->host->output(this->host->context, this->layerCounter, pass, this->data);
     }
 }
 
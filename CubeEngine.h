@@ -6,6 +6,47 @@
 
 #include "Arduino.h"
 
+class CubeInput;
+class CubeComposite;
+class CubeBitboard;
+class CubeParticles;
+class CubeRaycast;
+class CubeText;
+class CubeRecorder;
+class CubeReplay;
+class CubeSnapshot;
+class CubeLockstep;
+class CubeJournal;
+struct CubeRuntimePins;
+struct CubeLEDBatch;
+
+// Size of the sprite pool
+// This sizes the sprite array, so the library and the sketch must agree on
+// it. Set it in the build flags (e.g. -DCUBE_SPRITE_COUNT=40), not with a
+// #define in the sketch. Sprites are numbered from 0, so 25 gives 0-24.
+#ifndef CUBE_SPRITE_COUNT
+  #define CUBE_SPRITE_COUNT 25
+#endif
+
+// Clock, random numbers and output for one engine
+// An engine normally uses millis(), micros(), random() and the cube's pins,
+// which are shared by everything in the sketch. A host gives an engine its
+// own, so many engines can run side by side off the board, each with its
+// own virtual time. Every hook is passed 'context'. A NULL hook falls back
+// to the Arduino function, and a NULL output discards the frames.
+struct CubeHost
+{
+    unsigned long (*millis)(void *context);
+    unsigned long (*micros)(void *context);
+    long (*random)(void *context, long howBig);
+
+    // Called for each pass of mplex() instead of driving the pins, with the
+    // layer and the first cube's data array
+    void (*output)(void *context, byte layer, byte pass, const byte *data);
+
+    void *context;
+};
+
 class CubeEngine
 {
     public:
@@ -16,71 +57,87 @@ class CubeEngine
 
         // The names of the sprite attributes
         // These are used to reference an attribute
-        const byte AN_STATE      = 0;
-        const byte AN_COLOUR     = 1;
-        const byte AN_VISIBILITY = 2;
-        const byte AN_X          = 3;
-        const byte AN_Y          = 4;
-        const byte AN_Z          = 5;
-        const byte AN_WRAP       = 6;
-        const byte AN_MOVE       = 7;
-        const byte AN_DIRECTION  = 8;
-        const byte AN_SPEED      = 9;
-        const byte AN_DEFEND     = 10;
-        const byte AN_ATTACK     = 11;
+        // Like every constant in the class they are static, so they're built
+        // into the code and take no RAM in each engine
+        static const byte AN_STATE      = 0;
+        static const byte AN_COLOUR     = 1;
+        static const byte AN_VISIBILITY = 2;
+        static const byte AN_X          = 3;
+        static const byte AN_Y          = 4;
+        static const byte AN_Z          = 5;
+        static const byte AN_WRAP       = 6;
+        static const byte AN_MOVE       = 7;
+        static const byte AN_DIRECTION  = 8;
+        static const byte AN_SPEED      = 9;
+        static const byte AN_DEFEND     = 10;
+        static const byte AN_ATTACK     = 11;
+        static const byte AN_CUBE       = 12;
         
         // The values of the sprite attributes
         // These value are written so they can be used directly with 'bit-wise or'
         //   in the getSpriteAttribute/setSpriteAttribute functions
-        const byte AV_LIVE               = B00001000; // state
-        const byte AV_DEAD               = B00000000;
-        const byte AV_ZERO               = B00000000; // coordinates
-        const byte AV_ONE                = B00000001; 
-        const byte AV_TWO                = B00000010; 
-        const byte AV_THREE              = B00000011; 
-        const byte AV_FOUR               = B00000100; 
-        const byte AV_FIVE               = B00000101; 
-        const byte AV_OFF                = B00000000; // colour
-        const byte AV_RED                = B01000000; 
-        const byte AV_GREEN              = B10000000; 
-        const byte AV_BLUE               = B11000000;
-        const byte AV_VISIBLE            = B10000000; // visibility
-        const byte AV_INVISIBLE          = B00000000; 
-        const byte AV_WRAP               = B01000000; // wrap
-        const byte AV_NOWRAP             = B00000000; 
-        const byte AV_MOVE               = B10000000; // Move
-        const byte AV_NOMOVE             = B00000000; 
-        const byte AV_UP                 = B00000000; // Direction
-        const byte AV_DOWN               = B00001000;
-        const byte AV_LEFT               = B00010000;
-        const byte AV_RIGHT              = B00011000;
-        const byte AV_BACK               = B00100000;
-        const byte AV_FRONT              = B00101000;
-        const byte AV_BACK_UP_LEFT       = B00110000;
-        const byte AV_BACK_UP_RIGHT      = B00111000;
-        const byte AV_BACK_DOWN_LEFT     = B01000000;
-        const byte AV_BACK_DOWN_RIGHT    = B01001000;
-        const byte AV_FRONT_UP_LEFT      = B01010000;
-        const byte AV_FRONT_UP_RIGHT     = B01011000;
-        const byte AV_FRONT_DOWN_LEFT    = B01100000;
-        const byte AV_FRONT_DOWN_RIGHT   = B01101000;
-        const byte AV_SPEED0             = B00000000; // Speed
-        const byte AV_SPEED1             = B00000001;
-        const byte AV_SPEED2             = B00000010;
-        const byte AV_SPEED3             = B00000011;
-        const byte AV_SPEED4             = B00000100;
-        const byte AV_SPEED5             = B00000101;
-        const byte AV_SPEED6             = B00000111;
-        const byte AV_KEEP_ALIVE         = B00000000; // Attack/Defend
-        const byte AV_KILL               = B00000001;
-        const byte AV_JUMP               = B00000010;
-        const byte AV_ENDGAME            = B00000011;
+        static const byte AV_LIVE               = B00001000; // state
+        static const byte AV_DEAD               = B00000000;
+        static const byte AV_ZERO               = B00000000; // coordinates
+        static const byte AV_ONE                = B00000001; 
+        static const byte AV_TWO                = B00000010; 
+        static const byte AV_THREE              = B00000011; 
+        static const byte AV_FOUR               = B00000100; 
+        static const byte AV_FIVE               = B00000101; 
+        static const byte AV_OFF                = B00000000; // colour
+        static const byte AV_RED                = B01000000; 
+        static const byte AV_GREEN              = B10000000; 
+        static const byte AV_BLUE               = B11000000;
+        static const byte AV_VISIBLE            = B10000000; // visibility
+        static const byte AV_INVISIBLE          = B00000000; 
+        static const byte AV_WRAP               = B01000000; // wrap
+        static const byte AV_NOWRAP             = B00000000; 
+        static const byte AV_MOVE               = B10000000; // Move
+        static const byte AV_NOMOVE             = B00000000; 
+        static const byte AV_UP                 = B00000000; // Direction
+        static const byte AV_DOWN               = B00001000;
+        static const byte AV_LEFT               = B00010000;
+        static const byte AV_RIGHT              = B00011000;
+        static const byte AV_BACK               = B00100000;
+        static const byte AV_FRONT              = B00101000;
+        static const byte AV_BACK_UP_LEFT       = B00110000;
+        static const byte AV_BACK_UP_RIGHT      = B00111000;
+        static const byte AV_BACK_DOWN_LEFT     = B01000000;
+        static const byte AV_BACK_DOWN_RIGHT    = B01001000;
+        static const byte AV_FRONT_UP_LEFT      = B01010000;
+        static const byte AV_FRONT_UP_RIGHT     = B01011000;
+        static const byte AV_FRONT_DOWN_LEFT    = B01100000;
+        static const byte AV_FRONT_DOWN_RIGHT   = B01101000;
+        static const byte AV_SPEED0             = B00000000; // Speed
+        static const byte AV_SPEED1             = B00000001;
+        static const byte AV_SPEED2             = B00000010;
+        static const byte AV_SPEED3             = B00000011;
+        static const byte AV_SPEED4             = B00000100;
+        static const byte AV_SPEED5             = B00000101;
+        static const byte AV_SPEED6             = B00000111;
+        static const byte AV_KEEP_ALIVE         = B00000000; // Attack/Defend
+        static const byte AV_KILL               = B00000001;
+        static const byte AV_JUMP               = B00000010;
+        static const byte AV_ENDGAME            = B00000011;
 
         // Cube engine construbtor
         CubeEngine(int latchPin, int clockPin, int dataPin,
                    int layer0, int layer1, int layer2,
                    int layer3, int layer4, int layer5);
 
+        // Cube engine constructor for a compile-time pin map (see CubePins.h)
+        template <class Pins>
+        explicit CubeEngine(Pins pins);
+
+        // Cube engine constructor without a cube
+        // No pins are touched and mplex() passes its output to the host
+        CubeEngine(CubeHost *host);
+
+        // An engine owns its runtime pins, so it can't be copied
+        ~CubeEngine();
+        CubeEngine(const CubeEngine &) = delete;
+        CubeEngine &operator=(const CubeEngine &) = delete;
+
         // Attribute related functions
         void setSpriteAttribute(int spriteNum, byte name, byte value);
         byte getSpriteAttribute(int spriteNum, byte name);
@@ -91,9 +148,35 @@ class CubeEngine
         // Sprite movement functions
         void moveSprite(int spriteNum, byte direction);
         void autoMoveSprites();
+        void autoMoveSprites(unsigned long curTimeStamp);
+        unsigned long getMillisToMove();
+        unsigned long getMillisToMove(unsigned long curTimeStamp);
+        static byte getDirectionSteps(byte direction);
 
         // Multiplexing and painting functions
         void mplex();
+
+        // Register chain functions
+        bool setShiftChains(byte chains, const int *dataPins);
+        bool setCubeCount(byte cubes, byte *frames);
+        byte getCubeCount();
+
+        // Input functions
+        // The attached input manager is sampled by mplex()
+        void attachInput(CubeInput *input);
+
+        // Journal functions
+        // The attached journal is told of every change to a sprite
+        void attachJournal(CubeJournal *journal);
+
+        // Host functions
+        // The engine and the classes built on it get their time and random
+        // numbers here, so they follow the host when one is set
+        void setHost(CubeHost *host);
+        unsigned long getMillis();
+        unsigned long getMicros();
+        long getRandom(long howBig);
+        long getRandom(long howSmall, long howBig);
         
         /***********************************
          * END ENGINE SPECIFIC CODE
@@ -106,18 +189,61 @@ class CubeEngine
         // setLED been made public so that programs can create patterns that require
         // more sprites than have been made available.
         void setLED(int layer, int row, int column, byte colour);
+
+        // Returns the colour of an LED as an AV_ colour, AV_OFF outside the cube
+        byte getLED(int layer, int row, int column);
+
+        // Batch LED functions
+        // LEDs are numbered cube * 216 + layer * 36 + row * 6 + column, the
+        // order they are stored in, four to a byte. A voxel packs a number
+        // with an AV_ colour as number | (colour << 8). Each byte of the data
+        // array is written once per call whatever the order of the list, but
+        // lists that finish with one cube before the next are quickest.
+        static unsigned int getLEDNumber(int layer, int row, int column);
+        static unsigned int getVoxel(int layer, int row, int column, byte colour);
+        void setLEDs(const unsigned int *leds, int count, byte colour);
+        void setLEDs(const unsigned int *leds, const byte *colours, int count);
+        void setLEDs(const unsigned int *voxels, int count);
+
+        // Brightness equalisation
+        // A layer with many LEDs lit looks dimmer than a sparse one, so with a
+        // table set each pass of a layer is shown on fewer frames the fewer
+        // LEDs it lights. The table is in PROGMEM (see setEqualisation()).
+        static const byte EQUALISATION_DEFAULT[37];
+        void setEqualisation(const byte *table);
+        unsigned int getLitCount(byte layer, byte pass);
+
+        // Register passes
+        // getLitCount() takes PASS_BLUE_GREEN or PASS_RED
+        static const byte PASS_BLUE_GREEN = 0;
+        static const byte PASS_RED        = 1;
+        static const byte PASS_BLANK      = 2;
+        static const byte PASS_DARK       = 3;
         
         /***********************************
          * END HARDWARE SPECIFIC CODE
          **********************************/
     private:
 
+        // These classes work on the data array directly
+        friend class CubeComposite;
+        friend class CubeBitboard;
+        friend class CubeParticles;
+        friend class CubeRaycast;
+        friend class CubeText;
+        friend class CubeRecorder;
+        friend class CubeReplay;
+        friend class CubeSnapshot;
+        friend class CubeLockstep;
+        friend class CubeJournal;
+        friend struct CubeRuntimePins;
+
         /***********************************
          * BEGIN ENGINE SPECIFIC CODE
          **********************************/
 
         // This array holds the game sprites
-        // This is limited to 25 in order to save memory
+        // This is limited to CUBE_SPRITE_COUNT (25 by default) in order to save memory
         //
         // The unsigned long has 32 bits, which are divided into 4 8-bit groups
         //
@@ -133,17 +259,18 @@ class CubeEngine
         //          7       movement
         // Group 3: 0 - 2   speed
         //          3       state
-        unsigned long sprites[25];   // one-indexed
-        const byte SPRITE_SIZE = 24; // zero-indexed, used for looping
+        //          4 - 6   cube
+        unsigned long sprites[CUBE_SPRITE_COUNT];                   // one-indexed
+        static const byte SPRITE_SIZE = CUBE_SPRITE_COUNT - 1;      // zero-indexed, used for looping
 
         // Automove sprite timers
-        const int AM_SPEED0_DIF = 4000;        // How many milliseconds between moves
-        const int AM_SPEED1_DIF = 2000;
-        const int AM_SPEED2_DIF = 1000;
-        const int AM_SPEED3_DIF = 500;
-        const int AM_SPEED4_DIF = 250;
-        const int AM_SPEED5_DIF = 125;
-        const int AM_SPEED6_DIF = 50;
+        static const int AM_SPEED0_DIF = 4000;        // How many milliseconds between moves
+        static const int AM_SPEED1_DIF = 2000;
+        static const int AM_SPEED2_DIF = 1000;
+        static const int AM_SPEED3_DIF = 500;
+        static const int AM_SPEED4_DIF = 250;
+        static const int AM_SPEED5_DIF = 125;
+        static const int AM_SPEED6_DIF = 50;
         unsigned long AM_SPEED0_PERIOD = 0;     // Total time elapsed since last move
         unsigned long AM_SPEED1_PERIOD = 0;
         unsigned long AM_SPEED2_PERIOD = 0;
@@ -152,10 +279,15 @@ class CubeEngine
         unsigned long AM_SPEED5_PERIOD = 0; 
         unsigned long AM_SPEED6_PERIOD = 0;
 
+        // Returns one of the automove timers, 0 (AM_SPEED0_PERIOD) to 6
+        unsigned long *getMoveTimer(byte timer);
+        unsigned int getMoveDelay(byte timer);
+
         // Attribute functions
         byte getGroup(int spriteNum, int group);        
         void writeSpriteAttribute(int spriteNum, int groupNum, byte group);
         byte getAttribute(int spriteNum, int groupNum, byte mask, int shift);
+        int getSpriteColumn(int spriteNum);
         byte clearAttribute(int spriteNum, int groupNum, byte mask);
 
         // Movement functions
@@ -171,31 +303,97 @@ class CubeEngine
          * BEGIN HARDWARE SPECIFIC CODE
          **********************************/
 
-        // These variables let us know which pins are connected to
-        // the cube
-        int latchPin, clockPin, dataPin, layer0, layer1,
-            layer2, layer3, layer4, layer5;
+        // Port registers and bit-masks of the pins connected to the cube
+        // Only kept when the pins aren't known at compile time, otherwise
+        // NULL. The pin number constructor makes them on the heap.
+        CubeRuntimePins *runtimePins;
+
+        // Drives the pins for one pass of mplex()
+        // This points at drive() instantiated for the cube's pin map
+        void (CubeEngine::*driveRegisters)(byte pass);
+
+        // Register bit patterns for each colour code, one table per pass
+        static const byte SHIFT_PATTERNS_BLUE_GREEN[4];
+        static const byte SHIFT_PATTERNS_RED[4];
 
         // Colour codes for registers
-        const byte REG_OFF   = 0;
-        const byte REG_RED   = 1;
-        const byte REG_GREEN = 2;
-        const byte REG_BLUE  = 3;
+        static const byte REG_OFF   = 0;
+        static const byte REG_RED   = 1;
+        static const byte REG_GREEN = 2;
+        static const byte REG_BLUE  = 3;
 
         // Counters used for multiplexing
         volatile int mplexCounter = 0;         
         volatile int layerCounter = 0;
+
+        // Lit LEDs in each pass of each layer, over every cube
+        // writeData() keeps these up to date, so the refresh never counts
+        unsigned int litCounts[2][6];
+
+        // Equalisation table, and the frame (0-15) it is applied to
+        const byte *brightnessTable;
+        byte refreshFrame;
+
+        // Input manager sampled on each refresh tick
+        CubeInput *input;
+
+        // Journal of sprite changes, for rewinding
+        CubeJournal *journal;
+
+        // LEDs of the first cube that CubeParticles drew, one bit each, or
+        // NULL. Anything else that writes an LED takes it back.
+        byte *overlay;
+
+        // Clock, random numbers and output, NULL to use the Arduino ones
+        CubeHost *host;
+
+        // Parallel register chains
+        // Each chain has its own data pin on the data pin's port and they
+        // share the clock. chainReserved holds the latch and clock bits of
+        // that port, which the chains can't use.
+        byte shiftChains;
+        byte chainMasks[8];
+        byte chainDataMask;
+        byte chainPort;
+        byte chainReserved;
         
         // Holds the states of the all the LEDs in the cube
         // The state of each LED is stored using 2-bits
         // 00 - off     01 - red
         // 10 - green   11 - blue
-        const byte DATA_SIZE = 53; // zero-indexed, used for looping
+        static const byte DATA_SIZE = 53; // zero-indexed, used for looping
         byte data[54];             // one-indexed
 
+        // Chained cubes
+        // Cube 0 uses the data array above and the others use 54 bytes each
+        // of the sketch's buffer
+        byte cubeCount;
+        byte *extraFrames;
+
         // Register and data functions        
+        void initialise();
+        static void checkRamBudget();
         void killDataArray();
         void killRegisters();
+        byte *getCubeData(byte cube);
+
+        // Lit count functions
+        void writeData(byte *frame, int index, byte codes);
+        void releaseOverlay(byte *frame, int index, byte codes);
+        void batchLED(CubeLEDBatch &batch, unsigned int led, byte code);
+        void finishBatch(CubeLEDBatch &batch);
+        static byte countCodes(byte codes, byte pass);
+        void recountLayers();
+        byte getRefreshPass(byte pass);
+
+        // Pin functions, defined in CubePins.h
+        template <class Pins>
+        void drive(byte pass);
+        template <class Pins>
+        void shiftParallel(int firstLED, const byte *patterns);
+
+        // Register driver for an engine without a cube
+        void driveHost(byte pass);
 
         /***********************************
          * END HARDWARE SPECIFIC CODE
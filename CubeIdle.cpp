@@ -0,0 +1,170 @@
+#include "CubeIdle.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+#if defined(__AVR__)
+  #include <avr/sleep.h>
+#endif
+
+/**
+ * This constructor uses idle sleep, with no loop attached and a guard of
+ * 100 microseconds for the time loop() takes to get round
+ */
+CubeIdle::CubeIdle(CubeEngine &engine, unsigned int refreshMicros) {
+    this->engine      = &engine;
+    this->loop        = NULL;
+    this->sleep       = &CubeIdle::sleepIdle;
+    this->guardMicros = 100;
+
+    this->setRefresh(refreshMicros);
+    this->resetStats();
+}
+
+/*
+ * Takes the deadline from a game loop's ticks
+ *
+ * Pass NULL to go back to the automove timers.
+ */
+void CubeIdle::attachLoop(CubeLoop *loop) {
+    this->loop = loop;
+}
+
+/*
+ * Sets the period of the refresh interrupt in microseconds
+ */
+void CubeIdle::setRefresh(unsigned int refreshMicros) {
+    this->refreshMicros = (refreshMicros == 0) ? 1 : refreshMicros;
+}
+
+/*
+ * Sets how long before a deadline the CPU must be awake
+ */
+void CubeIdle::setGuard(unsigned int guardMicros) {
+    this->guardMicros = guardMicros;
+}
+
+/*
+ * Sets the function that sleeps
+ *
+ * Pass NULL to go back to idle sleep.
+ */
+void CubeIdle::setSleep(IdleSleep sleep) {
+    this->sleep = (sleep == NULL) ? &CubeIdle::sleepIdle : sleep;
+}
+
+/*
+ * Returns the microseconds until the next tick or sprite move is due
+ *
+ * Returns 0xFFFFFFFF if there's nothing to wait for.
+ */
+unsigned long CubeIdle::getMicrosToDeadline() {
+
+    if (this->loop != NULL) {
+        return this->loop->getMicrosToTick();
+    }
+
+    // Part of the current millisecond may already have gone, so count
+    // one less to wake early rather than late
+    unsigned long millis = this->engine->getMillisToMove();
+    if (millis >= 0xFFFFFFFF / 1000) {
+        return 0xFFFFFFFF;
+    }
+    if (millis == 0) {
+        return 0;
+    }
+
+    return (millis - 1) * 1000;
+}
+
+/*
+ * Sleeps until the deadline is less than a refresh away
+ *
+ * Any interrupt wakes the CPU, and the refresh interrupt comes at least
+ * every refresh period, so a sleep can't run past the deadline. The last
+ * stretch before it is left to loop(), which is round again in time.
+ */
+bool CubeIdle::idle() {
+
+    unsigned long start = this->engine->getMicros();
+    bool slept = false;
+
+    while (true) {
+        unsigned long wait = this->getMicrosToDeadline();
+
+        if (wait <= (unsigned long) this->refreshMicros + this->guardMicros) {
+            break;
+        }
+
+        this->sleep(wait - this->guardMicros);
+        this->sleeps += 1;
+        slept = true;
+    }
+
+    if (slept) {
+        this->idleMicros += this->engine->getMicros() - start;
+    }
+
+    return slept;
+}
+
+/*
+ * Returns the time spent asleep
+ */
+unsigned long CubeIdle::getIdleMicros() {
+    return this->idleMicros;
+}
+
+/*
+ * Returns the number of times the CPU was put to sleep
+ */
+unsigned long CubeIdle::getSleeps() {
+    return this->sleeps;
+}
+
+/*
+ * Returns the share of the time spent asleep, in percent
+ */
+byte CubeIdle::getIdleRatio() {
+
+    unsigned long total = (this->engine->getMicros() - this->statsStart) / 100;
+    if (total == 0) {
+        return 0;
+    }
+
+    unsigned long ratio = this->idleMicros / total;
+    return (ratio > 100) ? 100 : ratio;
+}
+
+/*
+ * Clears the counters and starts timing again from now
+ */
+void CubeIdle::resetStats() {
+    this->statsStart = this->engine->getMicros();
+    this->idleMicros = 0;
+    this->sleeps     = 0;
+}
+
+/*
+ * Puts the CPU into idle sleep until the next interrupt
+ *
+ * The refresh interrupt always comes before the deadline, so the longest
+ * sleep isn't needed on AVR, or on ARM where WFI waits the same way.
+ * Other boards have no portable sleep, so they wait out the longest
+ * sleep with delay(), which at least lets an RTOS core run other tasks.
+ * Without one of these idle() would spin until the deadline.
+ */
+void CubeIdle::sleepIdle(unsigned long maxMicros) {
+#if defined(__AVR__)
+    (void) maxMicros;
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_mode();
+#elif defined(__arm__)
+    (void) maxMicros;
+    __asm__ volatile ("wfi");
+#else
+    delay(maxMicros / 1000);
+    delayMicroseconds(maxMicros % 1000);
+#endif
+}
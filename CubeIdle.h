@@ -0,0 +1,79 @@
+/*
+* CubeIdle.h - Sleeps between refresh and game deadlines for the CubeEngine library.
+*
+* The cube is refreshed by a timer interrupt that calls mplex(), so loop()
+* has nothing to do until the next tick or sprite move is due. Calling
+* idle() at the end of loop() sleeps the CPU until then, e.g.
+*
+*   void loop() {
+*       gameLoop.run();
+*       idler.idle();
+*   }
+*
+* On AVR this is idle sleep, the deepest mode that keeps the timers
+* clocked. The deeper modes stop Timer0 and Timer1, which would stop
+* millis() and the refresh. On ARM it is WFI, and elsewhere a delay() up
+* to the deadline, which saves no power unless the core sleeps in delay().
+*/
+#ifndef CubeIdle_h
+#define CubeIdle_h
+
+#include "Arduino.h"
+#include "CubeEngine.h"
+#include "CubeLoop.h"
+
+class CubeIdle
+{
+    public:
+
+        // Sleeps for at most 'maxMicros', or until the next interrupt
+        // A host build can pass its own to move a virtual clock on.
+        typedef void (*IdleSleep)(unsigned long maxMicros);
+
+        // Idle manager constructor
+        // 'refreshMicros' is the period of the interrupt that calls mplex().
+        // Each sleep ends by the next refresh at the latest, so no layer is
+        // ever shown late.
+        CubeIdle(CubeEngine &engine, unsigned int refreshMicros);
+
+        // Configuration functions
+        // With a loop attached its ticks are the deadline, as sprites only
+        // move on ticks. Otherwise the engine's automove timers are used.
+        void attachLoop(CubeLoop *loop);
+        void setRefresh(unsigned int refreshMicros);
+        void setGuard(unsigned int guardMicros);
+        void setSleep(IdleSleep sleep);
+
+        // Microseconds until the game next needs the CPU
+        unsigned long getMicrosToDeadline();
+
+        // Sleeps while the deadline is more than a refresh away
+        // Returns true if it slept.
+        bool idle();
+
+        // Instrumentation counters
+        // Idle is time spent asleep, since the counters were last reset.
+        // The microsecond counters wrap after about 71 minutes.
+        unsigned long getIdleMicros();
+        unsigned long getSleeps();
+        byte getIdleRatio();
+        void resetStats();
+
+    private:
+
+        CubeEngine *engine;
+        CubeLoop *loop;
+        IdleSleep sleep;
+
+        unsigned int refreshMicros;
+        unsigned int guardMicros;
+
+        // Counters
+        unsigned long statsStart;
+        unsigned long idleMicros;
+        unsigned long sleeps;
+
+        static void sleepIdle(unsigned long maxMicros);
+};
+
+#endif
@@ -0,0 +1,235 @@
+#include "CubeInput.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+/**
+ * This constructor clears the button table and debounce state
+ */
+CubeInput::CubeInput() {
+
+    this->buttonCount   = 0;
+    this->invert        = 0;
+    this->sampleDivider = 1;
+    this->sampleCounter = 0;
+
+    // Counters start at 11, the value they return to whenever a button is stable
+    this->count0   = 0xFF;
+    this->count1   = 0xFF;
+    this->held     = 0;
+    this->pressed  = 0;
+    this->released = 0;
+
+    this->latencyState = this->LT_IDLE;
+    this->pressTime    = 0;
+    this->lastLatency  = 0;
+    this->maxLatency   = 0;
+}
+
+/*
+ * Adds a button and returns its number
+ *
+ * Active-low buttons get the internal pull-up so they can be wired
+ * straight to ground.
+ */
+byte CubeInput::addButton(int pin, bool activeLow) {
+
+    // Do nothing when all the state bits are in use
+    if (this->buttonCount >= this->MAX_BUTTONS) {
+        return this->NO_BUTTON;
+    }
+
+    byte port = digitalPinToPort(pin);
+    if (port == NOT_A_PORT) {
+        return this->NO_BUTTON;
+    }
+
+    pinMode(pin, activeLow ? INPUT_PULLUP : INPUT);
+
+    byte button = this->buttonCount;
+    this->ports[button] = portInputRegister(port);
+    this->masks[button] = digitalPinToBitMask(pin);
+
+    if (activeLow) {
+        this->invert |= (1 << button);
+    }
+
+    this->buttonCount += 1;
+
+    return button;
+}
+
+/*
+ * Sets how many refresh ticks pass between samples
+ *
+ * A button has to be stable for four samples, so the debounce time is
+ * four times the refresh period times the divider.
+ */
+void CubeInput::setSampleDivider(byte divider) {
+    if (divider == 0) {
+        divider = 1;
+    }
+
+    this->sampleDivider = divider;
+    this->sampleCounter = 0;
+}
+
+/*
+ * Returns true while the button is down
+ */
+bool CubeInput::isHeld(byte button) {
+    return (this->held >> button) & 1;
+}
+
+/*
+ * Returns true once for each press
+ */
+bool CubeInput::wasPressed(byte button) {
+
+    bool result = this->takeBit(&this->pressed, button);
+
+    // Start timing how long this press takes to reach the display
+    if (result && this->latencyState == this->LT_PRESSED) {
+        this->latencyState = this->LT_CONSUMED;
+    }
+
+    return result;
+}
+
+/*
+ * Returns true once for each release
+ */
+bool CubeInput::wasReleased(byte button) {
+    return this->takeBit(&this->released, button);
+}
+
+/*
+ * Returns the latency of the most recently displayed press
+ */
+unsigned long CubeInput::getLastLatency() {
+    byte sreg = SREG;
+    cli();
+    unsigned long latency = this->lastLatency;
+    SREG = sreg;
+
+    return latency;
+}
+
+/*
+ * Returns the worst latency seen since the last reset
+ */
+unsigned long CubeInput::getMaxLatency() {
+    byte sreg = SREG;
+    cli();
+    unsigned long latency = this->maxLatency;
+    SREG = sreg;
+
+    return latency;
+}
+
+/*
+ * Clears the latency counters
+ */
+void CubeInput::resetLatency() {
+    byte sreg = SREG;
+    cli();
+    this->latencyState = this->LT_IDLE;
+    this->lastLatency  = 0;
+    this->maxLatency   = 0;
+    SREG = sreg;
+}
+
+/*
+ * Samples and debounces every button
+ *
+ * This runs inside mplex(), so it only uses direct port reads and
+ * byte-wide logic. All buttons are debounced at once by treating each
+ * bit of count0/count1 as one button's 2-bit counter.
+ */
+void CubeInput::sample() {
+
+    // Only sample every n-th refresh tick
+    this->sampleCounter += 1;
+    if (this->sampleCounter < this->sampleDivider) {
+        return;
+    }
+    this->sampleCounter = 0;
+
+    // Read the raw pin levels into one byte
+    byte raw = 0;
+    byte bit = 1;
+    for (byte i = 0; i < this->buttonCount; i++) {
+        if (*this->ports[i] & this->masks[i]) {
+            raw |= bit;
+        }
+        bit = bit << 1;
+    }
+
+    // Pressed buttons read as 1 from here on
+    raw ^= this->invert;
+
+    // Count samples which differ from the debounced state
+    // Any button that matches the debounced state resets its counter
+    byte changed = this->held ^ raw;
+    this->count0 = ~(this->count0 & changed);
+    this->count1 = this->count0 ^ (this->count1 & changed);
+
+    // Toggle buttons whose counter has rolled over
+    byte toggled = changed & this->count0 & this->count1;
+    byte state   = this->held ^ toggled;
+    this->held = state;
+
+    // Latch edges until the sketch reads them
+    this->pressed  |= toggled & state;
+    this->released |= toggled & ~state;
+
+    // Time-stamp new presses for the latency counters
+    if ((toggled & state) && this->latencyState <= this->LT_PRESSED) {
+        this->pressTime    = micros();
+        this->latencyState = this->LT_PRESSED;
+    }
+}
+
+/*
+ * Called by mplex() each time the refresh returns to layer 0
+ *
+ * A consumed press waits for one boundary to mark the start of the
+ * frame that shows its effect, and the next boundary marks the end.
+ */
+void CubeInput::frameBoundary() {
+
+    if (this->latencyState == this->LT_CONSUMED) {
+        this->latencyState = this->LT_DISPLAYING;
+
+    } else if (this->latencyState == this->LT_DISPLAYING) {
+        unsigned long latency = micros() - this->pressTime;
+
+        this->lastLatency = latency;
+        if (latency > this->maxLatency) {
+            this->maxLatency = latency;
+        }
+
+        this->latencyState = this->LT_IDLE;
+    }
+}
+
+/*
+ * Reads and clears one button's bit of an edge byte
+ *
+ * The edge bytes are also written by sample(), so interrupts are held
+ * off for the read-modify-write.
+ */
+bool CubeInput::takeBit(volatile byte *state, byte button) {
+
+    byte mask = 1 << button;
+
+    byte sreg = SREG;
+    cli();
+    bool result = (*state & mask) != 0;
+    *state &= ~mask;
+    SREG = sreg;
+
+    return result;
+}
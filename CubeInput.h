@@ -0,0 +1,85 @@
+/*
+* CubeInput.h - Debounced button input for the CubeEngine library.
+*/
+#ifndef CubeInput_h
+#define CubeInput_h
+
+#include "Arduino.h"
+
+class CubeInput
+{
+    public:
+
+        // The most buttons a single input manager can watch
+        // This lets every button share one bit of each state byte
+        static const byte MAX_BUTTONS = 8;
+
+        // Returned by addButton when no more buttons can be added
+        static const byte NO_BUTTON = 0xFF;
+
+        // Input manager constructor
+        CubeInput();
+
+        // Configuration functions
+        byte addButton(int pin, bool activeLow);
+        void setSampleDivider(byte divider);
+
+        // Button state functions
+        bool isHeld(byte button);
+        bool wasPressed(byte button);
+        bool wasReleased(byte button);
+
+        // Latency counters (microseconds)
+        unsigned long getLastLatency();
+        unsigned long getMaxLatency();
+        void resetLatency();
+
+        // Called by CubeEngine::mplex(), not by the sketch
+        void sample();
+        void frameBoundary();
+
+    private:
+
+        // Input registers and bit-masks of the configured pins
+        // These are resolved once so sample() can read the ports directly
+        volatile byte *ports[MAX_BUTTONS];
+        byte masks[MAX_BUTTONS];
+        byte buttonCount;
+
+        // Buttons which read LOW when pressed (one bit per button)
+        byte invert;
+
+        // Refresh ticks between samples
+        byte sampleDivider;
+        byte sampleCounter;
+
+        // Debounce state (one bit per button)
+        //
+        // count0 and count1 form a 2-bit vertical counter per button. A button
+        // must read the same new level on four samples in a row before the
+        // debounced state toggles.
+        byte count0;
+        byte count1;
+        volatile byte held;
+        volatile byte pressed;
+        volatile byte released;
+
+        // Input-to-display latency tracking
+        //
+        // A press is timed from the sample that debounced it, through the sketch
+        // consuming it with wasPressed(), to the end of the first full frame
+        // started after that.
+        static const byte LT_IDLE       = 0;
+        static const byte LT_PRESSED    = 1;
+        static const byte LT_CONSUMED   = 2;
+        static const byte LT_DISPLAYING = 3;
+        volatile byte latencyState;
+        volatile unsigned long pressTime;
+        volatile unsigned long lastLatency;
+        volatile unsigned long maxLatency;
+
+        // Clears button bits in a state byte shared with mplex()
+        bool takeBit(volatile byte *state, byte button);
+};
+
+#endif
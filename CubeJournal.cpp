@@ -0,0 +1,369 @@
+#include "CubeJournal.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+// Sprite and group share the first byte of an entry, and sprite 63 with
+// group 3 is the marker
+static_assert(CUBE_SPRITE_COUNT <= 63, "CubeJournal needs sprite numbers below 63");
+
+/*
+ * Bits of each attribute group that place the sprite
+ *
+ * Group 0 holds x and y, group 1 z and group 3 the cube.
+ */
+static const byte JOURNAL_POSITION_BITS[4] PROGMEM = {
+    B00111111, B00000111, B00000000, B01110000
+};
+
+/**
+ * This constructor starts with no history, the buffer is used two bytes
+ * at a time
+ */
+CubeJournal::CubeJournal(CubeEngine &engine, byte *buffer, int size) {
+    this->engine    = &engine;
+    this->buffer    = buffer;
+    this->units     = (buffer == NULL || size < 0) ? 0 : size / 2;
+    this->overflows = 0;
+    this->applying  = false;
+
+    this->clear();
+}
+
+/*
+ * Closes the current tick
+ *
+ * A tick that changed nothing just adds to the count in the marker before
+ * it. Ticking on while rewound drops the ticks that could be replayed.
+ */
+void CubeJournal::endTick() {
+
+    this->discardFuture();
+
+    // A tick too big to keep can't be undone, so the history starts again
+    // after it
+    if (this->overflowing) {
+        this->overflowing = false;
+        return;
+    }
+
+    this->closeTick();
+}
+
+/*
+ * Undoes up to 'ticks' ticks, newest first
+ */
+unsigned int CubeJournal::rewind(unsigned int ticks) {
+
+    // Changes since the last endTick() are undone as a tick of their own
+    if (this->isOpen()) {
+        this->closeTick();
+    }
+
+    unsigned int done = 0;
+    while (done < ticks && this->undoTick()) {
+        done += 1;
+    }
+
+    if (done > 0) {
+        this->redraw();
+    }
+
+    return done;
+}
+
+/*
+ * Does again up to 'ticks' rewound ticks, oldest first
+ */
+unsigned int CubeJournal::replay(unsigned int ticks) {
+
+    unsigned int done = 0;
+    while (done < ticks && this->redoTick()) {
+        done += 1;
+    }
+
+    if (done > 0) {
+        this->redraw();
+    }
+
+    return done;
+}
+
+/*
+ * Returns the number of ticks that can be rewound
+ */
+unsigned long CubeJournal::getDepth() {
+    return this->pastTicks;
+}
+
+/*
+ * Returns the number of rewound ticks that can be replayed
+ */
+unsigned long CubeJournal::getFuture() {
+    return this->futureTicks;
+}
+
+/*
+ * Returns the bytes of the buffer holding changes and markers
+ */
+int CubeJournal::getUsed() {
+    return this->used * 2;
+}
+
+/*
+ * Returns the number of ticks that were too big for the buffer
+ */
+unsigned long CubeJournal::getOverflows() {
+    return this->overflows;
+}
+
+/*
+ * Forgets every tick, the game as it is becomes the oldest state
+ */
+void CubeJournal::clear() {
+    this->tail        = 0;
+    this->used        = 0;
+    this->cursor      = 0;
+    this->rewound     = 0;
+    this->pastTicks   = 0;
+    this->futureTicks = 0;
+    this->overflowing = false;
+}
+
+/*
+ * Records the old value of an attribute group
+ *
+ * Writes that leave the group as it was aren't kept.
+ */
+void CubeJournal::record(int spriteNum, int groupNum, byte old, byte group) {
+
+    if (this->applying || old == group) {
+        return;
+    }
+
+    this->discardFuture();
+
+    if (this->overflowing || !this->makeRoom()) {
+        return;
+    }
+
+    byte *entry = this->getUnit(this->used);
+    entry[0] = (spriteNum << 2) | groupNum;
+    entry[1] = old;
+
+    this->used  += 1;
+    this->cursor = this->used;
+}
+
+/*
+ * Returns a unit of the ring, counted from the oldest
+ */
+byte *CubeJournal::getUnit(int position) {
+    return this->buffer + (((this->tail + position) % this->units) * 2);
+}
+
+/*
+ * Returns true if changes have been recorded since the last marker
+ */
+bool CubeJournal::isOpen() {
+    return this->cursor > 0 && this->getUnit(this->cursor - 1)[0] != this->MARKER;
+}
+
+/*
+ * Ends the current tick with a marker, or adds it to the marker before
+ */
+void CubeJournal::closeTick() {
+
+    if (this->cursor > 0 && !this->isOpen()) {
+        byte *marker = this->getUnit(this->cursor - 1);
+
+        if (marker[1] < 255) {
+            marker[1]       += 1;
+            this->pastTicks += 1;
+            return;
+        }
+    }
+
+    // There's no room for the marker only if the tick fills the buffer
+    if (!this->makeRoom()) {
+        this->overflowing = false;
+        return;
+    }
+
+    byte *marker = this->getUnit(this->used);
+    marker[0] = this->MARKER;
+    marker[1] = 0;
+
+    this->used      += 1;
+    this->cursor     = this->used;
+    this->pastTicks += 1;
+}
+
+/*
+ * Drops the rewound ticks, which can't be replayed once the game moves on
+ */
+void CubeJournal::discardFuture() {
+
+    // Empty ticks rewound come off the marker's count
+    if (this->rewound > 0) {
+        this->getUnit(this->cursor - 1)[1] -= this->rewound;
+        this->rewound = 0;
+    }
+
+    this->used        = this->cursor;
+    this->futureTicks = 0;
+}
+
+/*
+ * Makes room for one more unit by dropping the oldest ticks
+ *
+ * If the current tick already fills the buffer the history is cleared,
+ * and the rest of the tick isn't recorded. Returns false when that
+ * happens.
+ */
+bool CubeJournal::makeRoom() {
+
+    while (this->used >= this->units) {
+
+        // Find the end of the oldest tick
+        int position = 0;
+        while (position < this->used && this->getUnit(position)[0] != this->MARKER) {
+            position += 1;
+        }
+
+        if (position >= this->used) {
+            this->clear();
+            this->overflowing = true;
+            this->overflows  += 1;
+            return false;
+        }
+
+        this->pastTicks -= this->getUnit(position)[1] + 1;
+
+        position     += 1;
+        this->tail    = (this->tail + position) % this->units;
+        this->used   -= position;
+        this->cursor -= position;
+    }
+
+    return true;
+}
+
+/*
+ * Undoes the newest tick before the cursor
+ *
+ * An empty tick only moves the count. A tick with changes undoes them
+ * newest first, back to the marker before.
+ */
+bool CubeJournal::undoTick() {
+
+    if (this->cursor == 0) {
+        return false;
+    }
+
+    byte *marker = this->getUnit(this->cursor - 1);
+
+    if (this->rewound < marker[1]) {
+        this->rewound += 1;
+    } else {
+        int position = this->cursor - 1;
+
+        while (position > 0) {
+            byte *entry = this->getUnit(position - 1);
+            if (entry[0] == this->MARKER) {
+                break;
+            }
+
+            this->apply(entry);
+            position -= 1;
+        }
+
+        this->cursor  = position;
+        this->rewound = 0;
+    }
+
+    this->pastTicks   -= 1;
+    this->futureTicks += 1;
+
+    return true;
+}
+
+/*
+ * Does again the oldest tick after the cursor
+ */
+bool CubeJournal::redoTick() {
+
+    if (this->rewound > 0) {
+        this->rewound -= 1;
+
+    } else if (this->cursor < this->used) {
+        int position = this->cursor;
+
+        while (this->getUnit(position)[0] != this->MARKER) {
+            this->apply(this->getUnit(position));
+            position += 1;
+        }
+
+        // The empty ticks after it are still to come
+        this->cursor  = position + 1;
+        this->rewound = this->getUnit(position)[1];
+
+    } else {
+        return false;
+    }
+
+    this->pastTicks   += 1;
+    this->futureTicks -= 1;
+
+    return true;
+}
+
+/*
+ * Puts a group back to the value in an entry, and keeps the value it had
+ * in its place
+ *
+ * A sprite that moves leaves its LED off, as with setSpriteAttribute().
+ */
+void CubeJournal::apply(byte *entry) {
+
+    CubeEngine *engine = this->engine;
+    int spriteNum = entry[0] >> 2;
+    int groupNum  = entry[0] & 3;
+    byte current  = engine->getGroup(spriteNum, groupNum);
+
+    if (((current ^ entry[1]) & pgm_read_byte(&JOURNAL_POSITION_BITS[groupNum])) != 0) {
+        engine->setLED(engine->getSpriteAttribute(spriteNum, engine->AN_X),
+                       engine->getSpriteAttribute(spriteNum, engine->AN_Y),
+                       engine->getSpriteColumn(spriteNum),
+                       engine->AV_OFF);
+    }
+
+    this->applying = true;
+    engine->writeSpriteAttribute(spriteNum, groupNum, entry[1]);
+    this->applying = false;
+
+    entry[1] = current;
+}
+
+/*
+ * Draws every visible, live sprite again
+ *
+ * A sprite that moves turns its old LED off even if another sprite is on
+ * it, so after a run of changes the sprites left dark are put back.
+ */
+void CubeJournal::redraw() {
+
+    CubeEngine *engine = this->engine;
+
+    for (int i = 0; i < CUBE_SPRITE_COUNT; i++) {
+        if (engine->getSpriteAttribute(i, engine->AN_VISIBILITY) == engine->AV_VISIBLE &&
+            engine->getSpriteAttribute(i, engine->AN_STATE) == engine->AV_LIVE) {
+            engine->setLED(engine->getSpriteAttribute(i, engine->AN_X),
+                           engine->getSpriteAttribute(i, engine->AN_Y),
+                           engine->getSpriteColumn(i),
+                           engine->getSpriteAttribute(i, engine->AN_COLOUR));
+        }
+    }
+}
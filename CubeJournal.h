@@ -0,0 +1,109 @@
+/*
+* CubeJournal.h - Rewind journal of sprite changes for the CubeEngine library.
+*
+* Every change to a sprite goes through the engine's writeSpriteAttribute(),
+* one attribute group (a byte) at a time. The journal keeps each change as
+* two bytes, the sprite and group then the old value, in a ring buffer
+* supplied by the sketch, with a two byte marker at the end of each tick.
+* A marker also counts the empty ticks after it, up to 255, so a quiet game
+* costs next to nothing and the history is as deep as the changes allow.
+* When the buffer fills, the oldest ticks are dropped.
+*
+*   byte history[256];
+*   CubeJournal journal(cube, history, sizeof(history));
+*   cube.attachJournal(&journal);
+*
+*   void tick() {
+*       ...game logic...
+*       journal.endTick();
+*   }
+*
+* rewind() undoes ticks and replay() does them again. Undoing a change
+* swaps the value in the entry for the current one, so the same entries
+* replay the ticks without any more room. Anything new recorded while
+* rewound starts the history again from there.
+*
+* Only sprites are journaled. LEDs drawn with setLED() and sprites
+* loaded by a snapshot or resync aren't, so call clear() after those.
+* Sprite numbers must be below 63.
+*/
+#ifndef CubeJournal_h
+#define CubeJournal_h
+
+#include "Arduino.h"
+#include "CubeEngine.h"
+
+class CubeJournal
+{
+    public:
+
+        // Journal constructor
+        // 'size' is the buffer size in bytes, two per change.
+        CubeJournal(CubeEngine &engine, byte *buffer, int size);
+
+        // Closes the current tick, call once at the end of each tick
+        void endTick();
+
+        // Undoes or redoes up to 'ticks' ticks
+        // Both return the number of ticks they moved.
+        unsigned int rewind(unsigned int ticks);
+        unsigned int replay(unsigned int ticks);
+
+        // Ticks that can be rewound and replayed
+        unsigned long getDepth();
+        unsigned long getFuture();
+
+        // Bytes of the buffer in use
+        int getUsed();
+
+        // Ticks that changed more than the whole buffer holds
+        // The history is lost when that happens.
+        unsigned long getOverflows();
+
+        // Forgets the history
+        void clear();
+
+        // Called by CubeEngine::writeSpriteAttribute(), not by the sketch
+        void record(int spriteNum, int groupNum, byte old, byte group);
+
+    private:
+
+        // First byte of a tick marker, the second is the empty ticks after it
+        static const byte MARKER = 0xFF;
+
+        CubeEngine *engine;
+        byte *buffer;
+
+        // Ring of two byte units
+        // 'position' counts units from the oldest, at 'tail'. Those before
+        // the cursor are the past and those after it can be replayed.
+        int units;
+        int tail;
+        int used;
+        int cursor;
+
+        // Empty ticks after the marker before the cursor that have been
+        // rewound
+        byte rewound;
+
+        unsigned long pastTicks;
+        unsigned long futureTicks;
+        unsigned long overflows;
+
+        // Set while a tick is too big to keep, or while changes are undone
+        bool overflowing;
+        bool applying;
+
+        // Journal functions
+        byte *getUnit(int position);
+        bool isOpen();
+        void closeTick();
+        void discardFuture();
+        bool makeRoom();
+        bool undoTick();
+        bool redoTick();
+        void apply(byte *entry);
+        void redraw();
+};
+
+#endif
@@ -0,0 +1,291 @@
+#include "CubeLife.h"
+#include "CubeBitboard.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+/*
+ * The counting kernel works on words of cells
+ *
+ * With 64-bit words a layer is one word and moving a row is a shift by
+ * eight bits. With 8-bit words a layer is eight words (one per row) and
+ * moving a row means using the next word. Both read the same byte layout,
+ * which assumes a little-endian host.
+ */
+#if CUBE_LIFE_SWAR == 64
+typedef uint64_t LifeWord;
+static const byte LIFE_WORDS = 1;
+#else
+typedef byte LifeWord;
+static const byte LIFE_WORDS = 8;
+#endif
+
+/*
+ * Returns the interior cells of a word, leaving out the halo
+ */
+#if CUBE_LIFE_SWAR == 64
+static LifeWord lifeInterior(byte) {
+    return 0x007E7E7E7E7E7E00ULL;
+}
+#else
+static LifeWord lifeInterior(byte word) {
+    return (word == 0 || word == 7) ? 0 : B01111110;
+}
+#endif
+
+/*
+ * Counts each cell and its neighbours within a layer
+ *
+ * The 3x3 count (0-9) is returned bit-sliced in four words, so sums[i]
+ * holds bit i of every cell's count. A full adder across z gives a 2-bit
+ * count per row, and the rows either side are then added with a 3-input
+ * adder.
+ */
+static void lifeLayerSums(const byte *layer, LifeWord sums[4][LIFE_WORDS]) {
+
+    LifeWord col0[LIFE_WORDS];
+    LifeWord col1[LIFE_WORDS];
+
+    for (byte k = 0; k < LIFE_WORDS; k++) {
+        LifeWord mid;
+        memcpy(&mid, layer + (k * sizeof(LifeWord)), sizeof(LifeWord));
+
+        LifeWord left  = mid >> 1;
+        LifeWord right = mid << 1;
+
+        col0[k] = left ^ mid ^ right;
+        col1[k] = (left & mid) | (right & (left ^ mid));
+    }
+
+    for (byte k = 0; k < LIFE_WORDS; k++) {
+
+#if CUBE_LIFE_SWAR == 64
+        LifeWord up0   = col0[k] << 8;
+        LifeWord up1   = col1[k] << 8;
+        LifeWord down0 = col0[k] >> 8;
+        LifeWord down1 = col1[k] >> 8;
+#else
+        LifeWord up0   = (k > 0) ? col0[k - 1] : 0;
+        LifeWord up1   = (k > 0) ? col1[k - 1] : 0;
+        LifeWord down0 = (k < 7) ? col0[k + 1] : 0;
+        LifeWord down1 = (k < 7) ? col1[k + 1] : 0;
+#endif
+
+        // Bit 0 of the three counts
+        LifeWord carry0 = (up0 & col0[k]) | (down0 & (up0 ^ col0[k]));
+        sums[0][k] = up0 ^ col0[k] ^ down0;
+
+        // Bit 1 of the three counts plus the carry
+        LifeWord bit1   = up1 ^ col1[k] ^ down1;
+        LifeWord carry1 = (up1 & col1[k]) | (down1 & (up1 ^ col1[k]));
+        LifeWord carry2 = bit1 & carry0;
+        sums[1][k] = bit1 ^ carry0;
+
+        // Bits 2 and 3 from the two carries
+        sums[2][k] = carry1 ^ carry2;
+        sums[3][k] = carry1 & carry2;
+    }
+}
+
+/**
+ * This constructor starts empty, without wrap, using the 4555 rules
+ */
+CubeLife::CubeLife(CubeEngine &engine) {
+    this->engine = &engine;
+    this->wrap   = false;
+
+    this->setRules(this->RULE_4555_BIRTH, this->RULE_4555_SURVIVE);
+    this->clear();
+}
+
+/*
+ * Sets the birth and survival rules
+ *
+ * The kernel counts the whole 3x3x3 block, so a live cell's total is one
+ * more than its neighbour count.
+ */
+void CubeLife::setRules(unsigned long birth, unsigned long survive) {
+    this->bornTotals = birth & 0x07FFFFFFUL;
+    this->liveTotals = (survive & 0x07FFFFFFUL) << 1;
+}
+
+/*
+ * Sets whether the faces of the cube wrap around to the opposite face
+ */
+void CubeLife::setWrap(bool wrap) {
+    this->wrap = wrap;
+}
+
+/*
+ * Kills every cell
+ */
+void CubeLife::clear() {
+    for (int i = 63; i >= 0; i--) {
+        this->cells[i] = 0;
+    }
+}
+
+/*
+ * Sets one cell
+ */
+void CubeLife::setCell(byte x, byte y, byte z, bool alive) {
+
+    if (x > 5 || y > 5 || z > 5) {
+        return;
+    }
+
+    byte index = ((x + 1) * 8) + y + 1;
+    byte mask  = 1 << (z + 1);
+
+    if (alive) {
+        this->cells[index] |= mask;
+    } else {
+        this->cells[index] &= ~mask;
+    }
+}
+
+/*
+ * Returns true if a cell is alive
+ */
+bool CubeLife::getCell(byte x, byte y, byte z) {
+
+    if (x > 5 || y > 5 || z > 5) {
+        return false;
+    }
+
+    return (this->cells[((x + 1) * 8) + y + 1] >> (z + 1)) & 1;
+}
+
+/*
+ * Advances one generation
+ *
+ * Layers are updated in place. Each layer's 3x3 sums are worked out
+ * before the layer below it is overwritten and kept for the next two
+ * layers, so no second copy of the generation is needed.
+ */
+void CubeLife::step() {
+
+    this->fillHalo();
+
+    // 3x3 sums of three consecutive layers, used round-robin
+    LifeWord sums[3][4][LIFE_WORDS];
+
+    lifeLayerSums(&this->cells[0], sums[0]);
+    lifeLayerSums(&this->cells[8], sums[1]);
+
+    for (byte layer = 1; layer <= 6; layer++) {
+
+        lifeLayerSums(&this->cells[(layer + 1) * 8], sums[(layer + 1) % 3]);
+
+        LifeWord (*below)[LIFE_WORDS] = sums[(layer - 1) % 3];
+        LifeWord (*level)[LIFE_WORDS] = sums[layer % 3];
+        LifeWord (*above)[LIFE_WORDS] = sums[(layer + 1) % 3];
+
+        for (byte k = 0; k < LIFE_WORDS; k++) {
+
+            // Add the three layers into a 5-bit total (0-27)
+            LifeWord pair[5];
+            LifeWord total[5];
+            LifeWord carry = 0;
+
+            for (byte i = 0; i < 4; i++) {
+                LifeWord a = below[i][k];
+                LifeWord b = level[i][k];
+                pair[i] = a ^ b ^ carry;
+                carry   = (a & b) | (carry & (a ^ b));
+            }
+            pair[4] = carry;
+
+            carry = 0;
+            for (byte i = 0; i < 5; i++) {
+                LifeWord a = pair[i];
+                LifeWord b = (i < 4) ? above[i][k] : 0;
+                total[i] = a ^ b ^ carry;
+                carry    = (a & b) | (carry & (a ^ b));
+            }
+
+            // Apply the rules to every cell of the word at once
+            byte *cell = &this->cells[(layer * 8) + (k * sizeof(LifeWord))];
+            LifeWord alive;
+            memcpy(&alive, cell, sizeof(LifeWord));
+
+            LifeWord result = 0;
+            for (byte value = 0; value < 28; value++) {
+
+                bool born = (this->bornTotals >> value) & 1;
+                bool live = (this->liveTotals >> value) & 1;
+                if (!born && !live) {
+                    continue;
+                }
+
+                // Cells whose total equals this value
+                LifeWord match = ~(LifeWord) 0;
+                for (byte i = 0; i < 5; i++) {
+                    match &= ((value >> i) & 1) ? total[i] : (LifeWord) ~total[i];
+                }
+
+                if (born) {
+                    result |= match & ~alive;
+                }
+                if (live) {
+                    result |= match & alive;
+                }
+            }
+
+            result &= lifeInterior(k);
+            memcpy(cell, &result, sizeof(LifeWord));
+        }
+    }
+}
+
+/*
+ * Draws the generation into the data array in one colour
+ *
+ * This replaces the whole frame, including any sprites.
+ */
+void CubeLife::render(byte colour) {
+
+    CubeBitboard board(*this->engine);
+
+    for (byte x = 0; x < 6; x++) {
+        for (byte y = 0; y < 6; y++) {
+            board.setRow(x, y, this->cells[((x + 1) * 8) + y + 1] >> 1, colour);
+        }
+    }
+
+    board.store();
+}
+
+/*
+ * Fills in the halo around the generation
+ *
+ * With wrap each face of the halo is a copy of the opposite face. Rows
+ * are done first, then the row halos, then the layer halos, so the copies
+ * carry the edges and corners with them.
+ */
+void CubeLife::fillHalo() {
+
+    for (byte layer = 1; layer <= 6; layer++) {
+        byte *rows = &this->cells[layer * 8];
+
+        for (byte y = 1; y <= 6; y++) {
+            byte row = rows[y] & B01111110;
+
+            if (this->wrap) {
+                row |= ((row >> 6) & B00000001) | ((row << 6) & B10000000);
+            }
+
+            rows[y] = row;
+        }
+
+        rows[0] = this->wrap ? rows[6] : 0;
+        rows[7] = this->wrap ? rows[1] : 0;
+    }
+
+    for (byte i = 0; i < 8; i++) {
+        this->cells[i]      = this->wrap ? this->cells[48 + i] : 0;
+        this->cells[56 + i] = this->wrap ? this->cells[8 + i] : 0;
+    }
+}
@@ -0,0 +1,65 @@
+/*
+* CubeLife.h - 3D cellular automata for the CubeEngine library.
+*/
+#ifndef CubeLife_h
+#define CubeLife_h
+
+#include "Arduino.h"
+#include "CubeEngine.h"
+
+// Word size of the neighbour counting kernel
+// AVR has no fast 64-bit operations, so it counts one row byte at a time.
+// Everywhere else a whole layer is counted in one 64-bit word.
+#ifndef CUBE_LIFE_SWAR
+  #if defined(__AVR__)
+    #define CUBE_LIFE_SWAR 8
+  #else
+    #define CUBE_LIFE_SWAR 64
+  #endif
+#endif
+
+class CubeLife
+{
+    public:
+
+        // Rule bits for the classic 3D life "4555" (survive on 4-5, born on 5)
+        static const unsigned long RULE_4555_BIRTH   = 0x00000020UL;
+        static const unsigned long RULE_4555_SURVIVE = 0x00000030UL;
+
+        // Cellular automaton constructor
+        CubeLife(CubeEngine &engine);
+
+        // Rule functions
+        // Bit n of each mask is set if n live neighbours (0-26) gives a live cell
+        void setRules(unsigned long birth, unsigned long survive);
+        void setWrap(bool wrap);
+
+        // Cell functions
+        void clear();
+        void setCell(byte x, byte y, byte z, bool alive);
+        bool getCell(byte x, byte y, byte z);
+
+        // Generation functions
+        void step();
+        void render(byte colour);
+
+    private:
+
+        CubeEngine *engine;
+
+        // The generation, one bit per cell with a one cell halo on every side
+        // Byte (x + 1) * 8 + (y + 1) holds the row along z in bits 1-6, so each
+        // layer is one 64-bit word. The halo is empty or, when wrapping, a copy
+        // of the opposite face.
+        byte cells[64];
+
+        // Rules as totals over the 3x3x3 block, which includes the cell itself
+        unsigned long bornTotals;
+        unsigned long liveTotals;
+        bool wrap;
+
+        // Generation helpers
+        void fillHalo();
+};
+
+#endif
@@ -0,0 +1,741 @@
+#include "CubeLockstep.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+// Packet bytes
+static const byte LOCKSTEP_INPUT_SYNC   = 0xA0;
+static const byte LOCKSTEP_RESYNC_SYNC  = 0x5A;
+static const byte LOCKSTEP_RESYNC_EPOCH = 0xC0;
+static const byte LOCKSTEP_INPUT_SIZE   = 7;
+static const byte LOCKSTEP_RESYNC_SIZE  = CubeLockstep::RESYNC_CHUNK_SIZE + 5;
+
+// No resync being taken in
+static const byte LOCKSTEP_NO_EPOCH = 0xFF;
+
+/**
+ * This constructor only stores the engine and the link, begin() starts a game
+ */
+CubeLockstep::CubeLockstep(CubeEngine &engine, Stream &link, byte player) {
+    this->engine = &engine;
+    this->link   = &link;
+    this->player = player & 1;
+
+    this->tick        = NULL;
+    this->tickMillis  = 20;
+    this->delay       = 2;
+    this->randomState = 1;
+    this->epoch       = 0;
+    this->rxCount     = 0;
+    this->rxEpoch     = LOCKSTEP_NO_EPOCH;
+
+    this->started = false;
+    this->lastNow = 0;
+
+    this->stalls        = 0;
+    this->resyncs       = 0;
+    this->bytesSent     = 0;
+    this->bytesReceived = 0;
+
+    this->restart(0);
+}
+
+/*
+ * Starts a game
+ *
+ * Both cubes start from tick 0 with neutral (0) inputs for the first
+ * 'delay' ticks. Set the game up in the first tick, or the same way on
+ * both cubes before calling this.
+ */
+void CubeLockstep::begin(unsigned long seed, unsigned int tickMillis, byte delay, LockstepTick tick) {
+
+    this->tick       = tick;
+    this->tickMillis = (tickMillis == 0) ? 1 : tickMillis;
+    this->delay      = constrain(delay, 1, this->MAX_DELAY);
+
+    // xorshift32 can't start from 0
+    this->randomState = seed & 0xFFFFFFFFUL;
+    if (this->randomState == 0) {
+        this->randomState = 0x9E3779B9UL;
+    }
+
+    this->host.millis  = hostMillis;
+    this->host.micros  = hostMicros;
+    this->host.random  = hostRandom;
+    this->host.output  = NULL;
+    this->host.context = this;
+    this->engine->setHost(&this->host);
+
+    this->epoch   = 0;
+    this->rxCount = 0;
+    this->rxEpoch = LOCKSTEP_NO_EPOCH;
+    this->started = false;
+    this->lastNow = 0;
+
+    this->stalls        = 0;
+    this->resyncs       = 0;
+    this->bytesSent     = 0;
+    this->bytesReceived = 0;
+
+    this->restart(0);
+}
+
+/*
+ * Takes this player's input and runs the next tick when it is due
+ *
+ * The input is for the tick 'delay' ahead of the one that runs now. A
+ * tick is held until the other cube's input for it arrives. While it is
+ * held our latest packets are sent again every four ticks, in case some
+ * were lost.
+ */
+bool CubeLockstep::update(byte input, unsigned long now) {
+
+    this->lastNow = now;
+    this->receive();
+
+    if (!this->started) {
+        this->started      = true;
+        this->nextTickTime = now;
+        this->lastSendTime = now;
+    }
+
+    // After a mismatch player 0 holds its game and sends it until player 1
+    // has it, and player 1 waits for it
+    if (this->resyncing) {
+        if (now - this->lastSendTime >= this->tickMillis * 4UL) {
+            if (this->player == 0) {
+                this->sendResync();
+            } else {
+                this->resend();
+            }
+            this->lastSendTime = now;
+        }
+        return false;
+    }
+
+    if ((long) (now - this->nextTickTime) < 0) {
+        return false;
+    }
+
+    // Take this tick's input
+    if (this->localTick <= this->currentTick + this->delay) {
+        this->localInputs[this->localTick & 15] = input;
+        this->sendInput(this->localTick);
+        this->localTick   += 1;
+        this->lastSendTime = now;
+    }
+
+    // Wait for the other input
+    if (this->remoteTick <= this->currentTick) {
+        if (!this->stalled) {
+            this->stalled = true;
+            this->stalls += 1;
+        }
+
+        if (now - this->lastSendTime >= this->tickMillis * 4UL) {
+            this->resend();
+            this->lastSendTime = now;
+        }
+        return false;
+    }
+
+    bool waited   = this->stalled;
+    this->stalled = false;
+    this->runTick();
+
+    // A tick that had to wait sets the pace from now, so the cube that is
+    // ahead falls in behind the other instead of waiting on every tick.
+    // After a long delay, carry on from now rather than rushing to catch up.
+    if (waited) {
+        this->nextTickTime = now + this->tickMillis;
+    } else {
+        this->nextTickTime += this->tickMillis;
+        if ((long) (now - this->nextTickTime) > (long) (this->tickMillis * 4UL)) {
+            this->nextTickTime = now;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Returns the next tick to run, which is also the number run so far
+ */
+unsigned long CubeLockstep::getTick() {
+    return this->currentTick;
+}
+
+/*
+ * Returns the checksum of the game after the last tick
+ */
+byte CubeLockstep::getChecksum() {
+    return this->checks[this->currentTick & 15];
+}
+
+/*
+ * Returns true while a tick is waiting for the other cube's input
+ */
+bool CubeLockstep::isStalled() {
+    return this->stalled;
+}
+
+/*
+ * Returns true while player 0 is sending its game, or player 1 waits for it
+ */
+bool CubeLockstep::isResyncing() {
+    return this->resyncing;
+}
+
+/*
+ * Returns the number of ticks that had to wait for the other cube
+ */
+unsigned long CubeLockstep::getStalls() {
+    return this->stalls;
+}
+
+/*
+ * Returns the number of resyncs sent (player 0) or taken (player 1)
+ */
+unsigned long CubeLockstep::getResyncs() {
+    return this->resyncs;
+}
+
+/*
+ * Returns the bytes written to the link
+ */
+unsigned long CubeLockstep::getBytesSent() {
+    return this->bytesSent;
+}
+
+/*
+ * Returns the bytes read from the link
+ */
+unsigned long CubeLockstep::getBytesReceived() {
+    return this->bytesReceived;
+}
+
+/*
+ * Starts the input pipeline again from a tick
+ *
+ * The first 'delay' ticks have neutral inputs on both cubes, since no
+ * input was taken for them.
+ */
+void CubeLockstep::restart(unsigned long tick) {
+
+    this->currentTick = tick;
+    this->baseTick    = tick;
+    this->localTick   = tick + this->delay;
+    this->remoteTick  = tick + this->delay;
+    this->peerTick    = tick;
+
+    for (byte i = 0; i < this->delay; i++) {
+        this->localInputs[(tick + i) & 15]  = 0;
+        this->remoteInputs[(tick + i) & 15] = 0;
+    }
+
+    this->checks[tick & 15] = this->getStateCheck();
+    this->checkPending      = false;
+    this->stalled           = false;
+    this->resyncing         = false;
+}
+
+/*
+ * Runs the current tick with both inputs
+ */
+void CubeLockstep::runTick() {
+
+    byte inputs[2];
+    inputs[this->player]     = this->localInputs[this->currentTick & 15];
+    inputs[this->player ^ 1] = this->remoteInputs[this->currentTick & 15];
+
+    if (this->tick != NULL) {
+        this->tick(*this->engine, inputs);
+    }
+
+    this->currentTick += 1;
+    this->checks[this->currentTick & 15] = this->getStateCheck();
+
+    if (this->checkPending && this->pendingTick <= this->currentTick) {
+        this->checkPending = false;
+        this->compareCheck(this->pendingTick, this->pendingCheck);
+    }
+}
+
+/*
+ * Compares the other cube's checksum with ours for the same tick
+ *
+ * A checksum for a tick we haven't reached is kept until we get there.
+ */
+void CubeLockstep::compareCheck(unsigned long tick, byte check) {
+
+    if ((long) (tick - this->baseTick) < 0) {
+        return;
+    }
+
+    if ((long) (tick - this->currentTick) > 0) {
+        this->checkPending = true;
+        this->pendingTick  = tick;
+        this->pendingCheck = check;
+        return;
+    }
+
+    if (this->currentTick - tick < 16 && this->checks[tick & 15] != check) {
+        this->desync();
+    }
+}
+
+/*
+ * Handles games that have drifted apart
+ *
+ * Player 0 starts a new epoch, so any packets still on the way from before
+ * are ignored, and sends its game. It runs no more ticks until player 1's
+ * inputs come back on the new epoch, so the game it sends again meanwhile
+ * is the same one. Player 1 stops until the game arrives.
+ */
+void CubeLockstep::desync() {
+
+    if (this->player == 1) {
+        this->resyncing = true;
+        return;
+    }
+
+    this->epoch = (this->epoch + 1) & 0x0F;
+    this->restart(this->currentTick);
+    this->resyncing = true;
+
+    this->sendResync();
+    this->lastSendTime = this->lastNow;
+
+    this->resyncs += 1;
+}
+
+/*
+ * Reads everything waiting on the link
+ */
+void CubeLockstep::receive() {
+
+    while (this->link->available() > 0) {
+
+        int value = this->link->read();
+        if (value < 0) {
+            break;
+        }
+        this->bytesReceived += 1;
+
+        // Look for the start of a packet
+        if (this->rxCount == 0 && !this->isPacketStart(value)) {
+            continue;
+        }
+        this->rx[this->rxCount] = value;
+        this->rxCount += 1;
+
+        // A lost byte leaves a packet that runs into the next one, so one
+        // that fails its check moves along to its next sync byte rather
+        // than throwing that one away too
+        while (this->rxCount > 0 && this->rxCount >= getPacketSize(this->rx[0])) {
+
+            byte size  = getPacketSize(this->rx[0]);
+            bool taken = (this->rx[0] == LOCKSTEP_RESYNC_SYNC) ? this->receiveResync() : this->receiveInput();
+
+            this->skip(taken ? size : 1);
+        }
+    }
+}
+
+/*
+ * Returns true if a byte can start a packet for us
+ *
+ * Only player 1 takes resyncs.
+ */
+bool CubeLockstep::isPacketStart(byte value) {
+    return (value & 0xF0) == LOCKSTEP_INPUT_SYNC || (value == LOCKSTEP_RESYNC_SYNC && this->player == 1);
+}
+
+/*
+ * Drops bytes from the incoming packet, then any up to its next sync byte
+ */
+void CubeLockstep::skip(byte count) {
+
+    while (count < this->rxCount && !this->isPacketStart(this->rx[count])) {
+        count += 1;
+    }
+
+    if (count >= this->rxCount) {
+        this->rxCount = 0;
+        return;
+    }
+
+    for (byte i = count; i < this->rxCount; i++) {
+        this->rx[i - count] = this->rx[i];
+    }
+    this->rxCount -= count;
+}
+
+/*
+ * Takes in a whole input packet
+ *
+ * Returns false if it fails its check.
+ */
+bool CubeLockstep::receiveInput() {
+
+    if (getPacketCheck(this->rx) != this->rx[LOCKSTEP_INPUT_SIZE - 1]) {
+        return false;
+    }
+
+    // A packet from before the last resync
+    if ((this->rx[0] & 0x0F) != this->epoch) {
+        return true;
+    }
+
+    // The cubes are never more than a few ticks apart, so a packet that
+    // says otherwise only passed the check by chance
+    unsigned long tick = this->expandTick(this->rx[1], this->remoteTick);
+    unsigned long ran  = this->expandTick(this->rx[4], this->currentTick);
+    long window = (this->delay * 2) + 2;
+
+    if ((long) (ran - this->currentTick) > window || (long) (this->currentTick - ran) > 16 ||
+        (long) (tick - this->currentTick) > window * 2 || (long) (this->currentTick - tick) > 16) {
+        return false;
+    }
+
+    // Player 1 is on our game, so player 0 can carry on
+    if (this->player == 0) {
+        this->resyncing = false;
+    }
+
+    // Inputs only go in order, so the copy of the one before fills a gap
+    // left by a lost packet
+    if (tick - 1 == this->remoteTick) {
+        this->remoteInputs[this->remoteTick & 15] = this->rx[3];
+        this->remoteTick += 1;
+    }
+    if (tick == this->remoteTick && this->remoteTick - this->currentTick < 16) {
+        this->remoteInputs[this->remoteTick & 15] = this->rx[2];
+        this->remoteTick += 1;
+    }
+
+    this->peerTick = ran;
+    this->compareCheck(ran, this->rx[5]);
+
+    return true;
+}
+
+/*
+ * Takes in a whole resync packet
+ *
+ * Each chunk goes straight into the engine, as there's no room to hold
+ * the game, so player 1 stops at the first chunk of a new epoch. Chunks
+ * may come in any order and more than once. Returns false if the packet
+ * fails its check.
+ */
+bool CubeLockstep::receiveResync() {
+
+    unsigned int check = 0;
+    for (byte i = 1; i < LOCKSTEP_RESYNC_SIZE - 2; i++) {
+        check = addCheck(check, this->rx[i]);
+    }
+
+    unsigned int sent = this->rx[LOCKSTEP_RESYNC_SIZE - 2] | ((unsigned int) this->rx[LOCKSTEP_RESYNC_SIZE - 1] << 8);
+    byte chunk = this->rx[2];
+
+    if ((this->rx[1] & 0xF0) != LOCKSTEP_RESYNC_EPOCH || chunk >= this->RESYNC_CHUNKS || sent != check) {
+        return false;
+    }
+
+    // A chunk of the game we already have
+    byte epoch = this->rx[1] & 0x0F;
+    if (epoch == this->epoch) {
+        return true;
+    }
+
+    if (epoch != this->rxEpoch) {
+        this->rxEpoch      = epoch;
+        this->rxChunkCount = 0;
+        for (byte i = 0; i < sizeof(this->rxChunks); i++) {
+            this->rxChunks[i] = 0;
+        }
+        this->resyncing = true;
+    }
+
+    byte mask = 1 << (chunk & 7);
+    if ((this->rxChunks[chunk >> 3] & mask) != 0) {
+        return true;
+    }
+    this->rxChunks[chunk >> 3] |= mask;
+    this->rxChunkCount += 1;
+
+    int index = chunk * this->RESYNC_CHUNK_SIZE;
+    for (byte i = 0; i < this->RESYNC_CHUNK_SIZE && index < this->RESYNC_SIZE; i++, index++) {
+        this->setResyncByte(index, this->rx[3 + i]);
+    }
+
+    if (this->rxChunkCount == this->RESYNC_CHUNKS) {
+        this->epoch       = this->rxEpoch;
+        this->rxEpoch     = LOCKSTEP_NO_EPOCH;
+        this->randomState = this->resyncRandom;
+        this->restart(this->resyncTick);
+
+        this->resyncs += 1;
+    }
+
+    return true;
+}
+
+/*
+ * Sends the input packet for a tick
+ */
+void CubeLockstep::sendInput(unsigned long tick) {
+
+    byte packet[LOCKSTEP_INPUT_SIZE];
+    packet[0] = LOCKSTEP_INPUT_SYNC | this->epoch;
+    packet[1] = (byte) tick;
+    packet[2] = this->localInputs[tick & 15];
+    packet[3] = this->localInputs[(tick - 1) & 15];
+    packet[4] = (byte) this->currentTick;
+    packet[5] = this->checks[this->currentTick & 15];
+
+    packet[6] = getPacketCheck(packet);
+
+    for (byte i = 0; i < LOCKSTEP_INPUT_SIZE; i++) {
+        this->send(packet[i]);
+    }
+}
+
+/*
+ * Sends again the inputs the other cube may not have
+ *
+ * That is every input from the tick it has reached. If there are none,
+ * the latest packet still goes, to carry our checksum.
+ */
+void CubeLockstep::resend() {
+
+    unsigned long first = this->baseTick + this->delay;
+    if ((long) (this->peerTick - first) > 0) {
+        first = this->peerTick;
+    }
+    if ((long) (first - this->localTick) >= 0 || this->localTick - first > 16) {
+        first = this->localTick - 1;
+    }
+
+    for (unsigned long tick = first; tick != this->localTick; tick++) {
+        this->sendInput(tick);
+    }
+}
+
+/*
+ * Sends player 0's whole game, chunk by chunk
+ */
+void CubeLockstep::sendResync() {
+    for (byte chunk = 0; chunk < this->RESYNC_CHUNKS; chunk++) {
+        this->sendResyncChunk(chunk);
+    }
+}
+
+/*
+ * Sends one chunk of player 0's game
+ */
+void CubeLockstep::sendResyncChunk(byte chunk) {
+
+    byte packet[LOCKSTEP_RESYNC_SIZE];
+    packet[0] = LOCKSTEP_RESYNC_SYNC;
+    packet[1] = LOCKSTEP_RESYNC_EPOCH | this->epoch;
+    packet[2] = chunk;
+
+    int index = chunk * this->RESYNC_CHUNK_SIZE;
+    for (byte i = 0; i < this->RESYNC_CHUNK_SIZE; i++, index++) {
+        packet[3 + i] = (index < this->RESYNC_SIZE) ? this->getResyncByte(index) : 0;
+    }
+
+    unsigned int check = 0;
+    for (byte i = 1; i < LOCKSTEP_RESYNC_SIZE - 2; i++) {
+        check = addCheck(check, packet[i]);
+    }
+    packet[LOCKSTEP_RESYNC_SIZE - 2] = (byte) check;
+    packet[LOCKSTEP_RESYNC_SIZE - 1] = (byte) (check >> 8);
+
+    for (byte i = 0; i < LOCKSTEP_RESYNC_SIZE; i++) {
+        this->send(packet[i]);
+    }
+}
+
+/*
+ * Writes one byte to the link
+ */
+void CubeLockstep::send(byte value) {
+    this->link->write(value);
+    this->bytesSent += 1;
+}
+
+/*
+ * Returns one byte of the game state
+ *
+ * The state is the sprites, then the data array, then the automove
+ * timers, with numbers low byte first.
+ */
+byte CubeLockstep::getImageByte(int index) {
+
+    CubeEngine *engine = this->engine;
+
+    if (index < CUBE_SPRITE_COUNT * 4) {
+        return (byte) (engine->sprites[index >> 2] >> ((index & 3) * 8));
+    }
+    index -= CUBE_SPRITE_COUNT * 4;
+
+    if (index < 54) {
+        return engine->data[index];
+    }
+    index -= 54;
+
+    return (byte) (*engine->getMoveTimer(index >> 2) >> ((index & 3) * 8));
+}
+
+/*
+ * Sets one byte of the game state
+ */
+void CubeLockstep::setImageByte(int index, byte value) {
+
+    CubeEngine *engine = this->engine;
+    unsigned long *number;
+
+    if (index < CUBE_SPRITE_COUNT * 4) {
+        number = &engine->sprites[index >> 2];
+
+    } else if (index < (CUBE_SPRITE_COUNT * 4) + 54) {
+        engine->writeData(engine->data, index - (CUBE_SPRITE_COUNT * 4), value);
+        return;
+
+    } else {
+        index -= (CUBE_SPRITE_COUNT * 4) + 54;
+        number = engine->getMoveTimer(index >> 2);
+    }
+
+    byte shift = (index & 3) * 8;
+    *number = (*number & ~(0xFFUL << shift)) | ((unsigned long) value << shift);
+}
+
+/*
+ * Returns one byte of a resync: the tick, the random state, then the game
+ * state
+ */
+byte CubeLockstep::getResyncByte(int index) {
+
+    if (index < 4) {
+        return (byte) (this->currentTick >> (index * 8));
+    }
+    if (index < 8) {
+        return (byte) (this->randomState >> ((index - 4) * 8));
+    }
+
+    return this->getImageByte(index - 8);
+}
+
+/*
+ * Sets one byte of a resync
+ *
+ * The tick and random state are kept aside until the whole game is in.
+ */
+void CubeLockstep::setResyncByte(int index, byte value) {
+
+    unsigned long *number;
+
+    if (index < 4) {
+        number = &this->resyncTick;
+    } else if (index < 8) {
+        number = &this->resyncRandom;
+        index -= 4;
+    } else {
+        this->setImageByte(index - 8, value);
+        return;
+    }
+
+    byte shift = index * 8;
+    *number = (*number & ~(0xFFUL << shift)) | ((unsigned long) value << shift);
+}
+
+/*
+ * Returns a checksum of the game state and random state
+ */
+byte CubeLockstep::getStateCheck() {
+
+    unsigned int check = 0;
+
+    for (int i = 0; i < this->IMAGE_SIZE; i++) {
+        check = addCheck(check, this->getImageByte(i));
+    }
+
+    for (byte i = 0; i < 4; i++) {
+        check = addCheck(check, (byte) (this->randomState >> (i * 8)));
+    }
+
+    return (byte) check ^ (byte) (check >> 8);
+}
+
+/*
+ * Returns the size of a packet from its first byte
+ */
+byte CubeLockstep::getPacketSize(byte first) {
+    return (first == LOCKSTEP_RESYNC_SYNC) ? LOCKSTEP_RESYNC_SIZE : LOCKSTEP_INPUT_SIZE;
+}
+
+/*
+ * Returns the check byte of an input packet
+ *
+ * Unlike a plain sum this changes when bytes swap places, which is how a
+ * packet read from the wrong start usually looks.
+ */
+byte CubeLockstep::getPacketCheck(const byte *packet) {
+
+    unsigned int check = 0;
+    for (byte i = 0; i < LOCKSTEP_INPUT_SIZE - 1; i++) {
+        check = addCheck(check, packet[i]);
+    }
+
+    return (byte) check ^ (byte) (check >> 8);
+}
+
+/*
+ * Turns the low byte of a tick back into a tick near a known one
+ */
+unsigned long CubeLockstep::expandTick(byte low, unsigned long near) {
+    return near + (signed char) (byte) (low - (byte) near);
+}
+
+/*
+ * Adds a byte to a 16-bit rotate-and-add checksum
+ */
+unsigned int CubeLockstep::addCheck(unsigned int check, byte value) {
+    check &= 0xFFFF;
+    return (((check << 1) | (check >> 15)) + value) & 0xFFFF;
+}
+
+/*
+ * Game time, from the tick being run
+ */
+unsigned long CubeLockstep::hostMillis(void *context) {
+    CubeLockstep *lockstep = (CubeLockstep *) context;
+    return lockstep->currentTick * lockstep->tickMillis;
+}
+
+/*
+ * Game time in microseconds
+ */
+unsigned long CubeLockstep::hostMicros(void *context) {
+    return hostMillis(context) * 1000UL;
+}
+
+/*
+ * Random numbers shared by both cubes, from xorshift32
+ */
+long CubeLockstep::hostRandom(void *context, long howBig) {
+    CubeLockstep *lockstep = (CubeLockstep *) context;
+
+    unsigned long x = lockstep->randomState;
+    x ^= (x << 13) & 0xFFFFFFFFUL;
+    x ^= x >> 17;
+    x ^= (x << 5) & 0xFFFFFFFFUL;
+    lockstep->randomState = x;
+
+    return (long) (x % (unsigned long) howBig);
+}
@@ -0,0 +1,184 @@
+/*
+* CubeLockstep.h - Two-cube lockstep multiplayer for the CubeEngine library.
+*
+* Both cubes run the same game from the same seed, one fixed tick at a
+* time, and only send each other their inputs. A tick runs once both
+* players' inputs for it are in, so the games never drift apart. Inputs
+* are sent 'delay' ticks ahead, which hides the link latency.
+*
+* Input packet, 7 bytes, sent once per tick:
+*
+*   0xA0 | epoch    sync, and which resync the sender is on
+*   tick            low byte of the tick the input is for
+*   input           input for that tick
+*   input           input for the tick before, in case a packet was lost
+*   ticks run       low byte of how many ticks the sender has run
+*   state           checksum of the sender's game after that many ticks
+*   check           rotate-and-add checksum of the bytes above
+*
+* If the checksums ever differ, player 0 starts a new epoch and sends its
+* whole game: the tick, the random state and the game state, in chunks of
+* RESYNC_CHUNK_SIZE bytes, each in a packet of its own:
+*
+*   0x5A            sync
+*   0xC0 | epoch    second sync, and the epoch the game starts
+*   chunk           which chunk this is
+*   data            RESYNC_CHUNK_SIZE bytes, the last chunk padded with 0
+*   check (2)       rotate-and-add checksum of the epoch, chunk and data
+*
+* Player 1 keeps every good chunk, so one lost byte only costs its own
+* chunk. Player 0 holds its game and sends every chunk again each four
+* ticks, until player 1's inputs come back on the new epoch. At 3% byte
+* loss two chunks in three get through each time, and the whole game is
+* usually across in half a dozen rounds, about half a second at 50 ticks
+* a second.
+*/
+#ifndef CubeLockstep_h
+#define CubeLockstep_h
+
+#include "Arduino.h"
+#include "CubeEngine.h"
+
+class CubeLockstep
+{
+    public:
+
+        // Longest input delay, in ticks
+        static const byte MAX_DELAY = 4;
+
+        // The game state sent by a resync: the sprites, the first cube's
+        // frame and the automove timers
+        static const int IMAGE_SIZE = (CUBE_SPRITE_COUNT * 4) + 54 + 28;
+
+        // A resync is the tick and random state, then the game state, sent
+        // this many bytes at a time
+        static const byte RESYNC_CHUNK_SIZE = 8;
+        static const int RESYNC_SIZE = 8 + IMAGE_SIZE;
+        static const byte RESYNC_CHUNKS = (RESYNC_SIZE + RESYNC_CHUNK_SIZE - 1) / RESYNC_CHUNK_SIZE;
+
+        // Runs one tick of the game
+        // inputs[0] is player 0's input and inputs[1] player 1's, on both
+        // cubes. The game must only use the engine's getMillis() and
+        // getRandom() for time and random numbers.
+        typedef void (*LockstepTick)(CubeEngine &engine, const byte *inputs);
+
+        // Lockstep constructor
+        // 'player' is 0 on one cube and 1 on the other. Player 0's game is
+        // the one kept after a resync.
+        CubeLockstep(CubeEngine &engine, Stream &link, byte player);
+
+        // Starts a game
+        // Both cubes must use the same seed, tick length and delay. The
+        // engine is given a CubeHost that runs on game time, replacing any
+        // host it had.
+        void begin(unsigned long seed, unsigned int tickMillis, byte delay, LockstepTick tick);
+
+        // Call every loop() with this player's input and the time
+        // Returns true if a tick ran.
+        bool update(byte input, unsigned long now);
+
+        // Status functions
+        unsigned long getTick();
+        byte getChecksum();
+        bool isStalled();
+        bool isResyncing();
+
+        // Link statistics
+        // Stalls counts the ticks that had to wait for the other cube.
+        unsigned long getStalls();
+        unsigned long getResyncs();
+        unsigned long getBytesSent();
+        unsigned long getBytesReceived();
+
+    private:
+
+        CubeEngine *engine;
+        Stream *link;
+        byte player;
+
+        // Game settings
+        LockstepTick tick;
+        unsigned int tickMillis;
+        byte delay;
+        CubeHost host;
+        unsigned long randomState;
+
+        // Tick state
+        // Inputs, and our checksum after each tick, are kept for the last 16
+        // ticks, indexed by tick & 15
+        unsigned long currentTick;   // the next tick to run
+        unsigned long baseTick;      // where the inputs started, at begin() or a resync
+        unsigned long localTick;     // the next tick to take our input for
+        unsigned long remoteTick;    // the next tick to get the other input for
+        unsigned long peerTick;      // ticks the other cube has run
+        byte localInputs[16];
+        byte remoteInputs[16];
+        byte checks[16];
+
+        // A checksum from the other cube for a tick we haven't run yet
+        bool checkPending;
+        unsigned long pendingTick;
+        byte pendingCheck;
+
+        // Timing
+        bool started;
+        bool stalled;
+        bool resyncing;
+        byte epoch;
+        unsigned long nextTickTime;
+        unsigned long lastSendTime;
+        unsigned long lastNow;
+
+        // Incoming packet, big enough for the largest kind
+        byte rxCount;
+        byte rx[RESYNC_CHUNK_SIZE + 5];
+
+        // The resync player 1 is taking in, and the chunks it has of it
+        byte rxEpoch;
+        byte rxChunkCount;
+        byte rxChunks[(RESYNC_CHUNKS + 7) / 8];
+        unsigned long resyncTick;
+        unsigned long resyncRandom;
+
+        // Statistics
+        unsigned long stalls;
+        unsigned long resyncs;
+        unsigned long bytesSent;
+        unsigned long bytesReceived;
+
+        // Pipeline functions
+        void restart(unsigned long tick);
+        void runTick();
+        void compareCheck(unsigned long tick, byte check);
+        void desync();
+
+        // Link functions
+        void receive();
+        bool isPacketStart(byte value);
+        void skip(byte count);
+        bool receiveInput();
+        bool receiveResync();
+        void sendInput(unsigned long tick);
+        void resend();
+        void sendResync();
+        void sendResyncChunk(byte chunk);
+        void send(byte value);
+
+        // State functions
+        byte getImageByte(int index);
+        void setImageByte(int index, byte value);
+        byte getResyncByte(int index);
+        void setResyncByte(int index, byte value);
+        byte getStateCheck();
+        unsigned long expandTick(byte low, unsigned long near);
+        static byte getPacketSize(byte first);
+        static byte getPacketCheck(const byte *packet);
+        static unsigned int addCheck(unsigned int check, byte value);
+
+        // Host hooks
+        static unsigned long hostMillis(void *context);
+        static unsigned long hostMicros(void *context);
+        static long hostRandom(void *context, long howBig);
+};
+
+#endif
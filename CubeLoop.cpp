@@ -0,0 +1,287 @@
+#include "CubeLoop.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+/**
+ * This constructor sets the timestep, with no callbacks and sprites moved
+ * on each tick
+ */
+CubeLoop::CubeLoop(CubeEngine &engine, unsigned int tickMillis) {
+    this->engine = &engine;
+
+    for (byte i = 0; i < this->PHASE_COUNT; i++) {
+        this->callbacks[i] = NULL;
+    }
+
+    this->scheduler    = NULL;
+    this->autoMove     = true;
+    this->maxTicks     = 4;
+    this->maxFrameSkip = 0;
+
+    this->tickCount  = 0;
+    this->gameMillis = 0;
+
+    this->setTimestep(tickMillis);
+    this->resetStats();
+}
+
+/*
+ * Sets the length of a tick in milliseconds
+ *
+ * This also restarts the clock, so time spent before the first run() or
+ * while the loop was stopped isn't caught up.
+ */
+void CubeLoop::setTimestep(unsigned int tickMillis) {
+    if (tickMillis == 0) {
+        tickMillis = 1;
+    }
+
+    this->stepMicros   = tickMillis * 1000UL;
+    this->lag          = 0;
+    this->started      = false;
+    this->frameSkipRun = 0;
+}
+
+/*
+ * Sets the frame-skip policy
+ *
+ * 'maxTicks' is the most ticks run by one call to run() (at least 1).
+ * When the game is further behind than that, the compose phase is skipped
+ * on up to 'maxFrameSkip' calls in a row to catch up. Once that runs out
+ * the rest of the backlog is dropped and the game slows down instead.
+ */
+void CubeLoop::setCatchUp(byte maxTicks, byte maxFrameSkip) {
+    this->maxTicks     = (maxTicks == 0) ? 1 : maxTicks;
+    this->maxFrameSkip = maxFrameSkip;
+    this->frameSkipRun = 0;
+}
+
+/*
+ * Sets whether the engine's moving sprites are moved on each tick
+ */
+void CubeLoop::setAutoMove(bool autoMove) {
+    this->autoMove = autoMove;
+}
+
+/*
+ * Sets the callback for a phase
+ *
+ * Pass NULL to remove it. Returns false if the phase doesn't exist.
+ */
+bool CubeLoop::setCallback(byte phase, TickCallback callback) {
+    if (phase >= this->PHASE_COUNT) {
+        return false;
+    }
+
+    this->callbacks[phase] = callback;
+    return true;
+}
+
+/*
+ * Attaches a task scheduler to the ticks
+ *
+ * Pass NULL to stop resuming it. Task waits are counted in game time, so
+ * they stretch when the game slows down.
+ */
+void CubeLoop::attachScheduler(CubeScheduler *scheduler) {
+    this->scheduler = scheduler;
+}
+
+/*
+ * Runs the ticks that are due and then composes the frame
+ *
+ * The game only ever advances in whole ticks, so the logic runs at the
+ * same rate however fast loop() is called and however long the refresh
+ * interrupt takes.
+ */
+bool CubeLoop::run() {
+
+    unsigned long now = this->engine->getMicros();
+
+    // The first call only starts the clock
+    if (!this->started) {
+        this->started  = true;
+        this->lastTime = now;
+        return false;
+    }
+
+    this->lag     += now - this->lastTime;
+    this->lastTime = now;
+
+    // Run the ticks that are due, up to the limit
+    byte ticks = 0;
+    while (this->lag >= this->stepMicros && ticks < this->maxTicks) {
+        this->tick();
+        this->lag -= this->stepMicros;
+        ticks += 1;
+    }
+
+    if (ticks == 0) {
+        return false;
+    }
+
+    // Still behind, so skip this frame or give up on the backlog
+    if (this->lag >= this->stepMicros) {
+        if (this->frameSkipRun < this->maxFrameSkip) {
+            this->frameSkipRun  += 1;
+            this->skippedFrames += 1;
+            return true;
+        }
+
+        this->droppedTicks += this->lag / this->stepMicros;
+        this->lag           = this->lag % this->stepMicros;
+    }
+
+    this->frameSkipRun = 0;
+    this->runPhase(this->PHASE_COMPOSE);
+
+    return true;
+}
+
+/*
+ * Returns the number of ticks run since the loop was created
+ */
+unsigned long CubeLoop::getTickCount() {
+    return this->tickCount;
+}
+
+/*
+ * Returns the game time in milliseconds
+ *
+ * This only counts ticks that ran, so it stands still while ticks are
+ * dropped.
+ */
+unsigned long CubeLoop::getGameMillis() {
+    return this->gameMillis;
+}
+
+/*
+ * Returns the microseconds until the next tick is due
+ *
+ * Before the first run() this is 0, as that call starts the clock.
+ */
+unsigned long CubeLoop::getMicrosToTick() {
+
+    if (!this->started) {
+        return 0;
+    }
+
+    unsigned long pending = this->lag + (this->engine->getMicros() - this->lastTime);
+    if (pending >= this->stepMicros) {
+        return 0;
+    }
+
+    return this->stepMicros - pending;
+}
+
+/*
+ * Returns the time a phase took on its last run
+ */
+unsigned int CubeLoop::getPhaseTime(byte phase) {
+    if (phase >= this->PHASE_COUNT) {
+        return 0;
+    }
+
+    return this->phaseTime[phase];
+}
+
+/*
+ * Returns the longest time a phase has taken
+ */
+unsigned int CubeLoop::getPhaseMax(byte phase) {
+    if (phase >= this->PHASE_COUNT) {
+        return 0;
+    }
+
+    return this->phaseMax[phase];
+}
+
+/*
+ * Returns the number of ticks whose input, logic and movement took longer
+ * than the timestep
+ */
+unsigned long CubeLoop::getOverruns() {
+    return this->overruns;
+}
+
+/*
+ * Returns the number of ticks dropped to slow the game down
+ */
+unsigned long CubeLoop::getDroppedTicks() {
+    return this->droppedTicks;
+}
+
+/*
+ * Returns the number of frames not composed while catching up
+ */
+unsigned long CubeLoop::getSkippedFrames() {
+    return this->skippedFrames;
+}
+
+/*
+ * Clears the budget counters
+ */
+void CubeLoop::resetStats() {
+    for (byte i = 0; i < this->PHASE_COUNT; i++) {
+        this->phaseTime[i] = 0;
+        this->phaseMax[i]  = 0;
+    }
+
+    this->overruns      = 0;
+    this->droppedTicks  = 0;
+    this->skippedFrames = 0;
+}
+
+/*
+ * Runs one tick of game logic
+ */
+void CubeLoop::tick() {
+
+    this->tickCount  += 1;
+    this->gameMillis += this->stepMicros / 1000;
+
+    this->runPhase(this->PHASE_INPUT);
+    this->runPhase(this->PHASE_LOGIC);
+    this->runPhase(this->PHASE_MOVEMENT);
+
+    unsigned long used = (unsigned long) this->phaseTime[this->PHASE_INPUT] +
+                         this->phaseTime[this->PHASE_LOGIC] +
+                         this->phaseTime[this->PHASE_MOVEMENT];
+
+    if (used > this->stepMicros) {
+        this->overruns += 1;
+    }
+}
+
+/*
+ * Runs and times one phase
+ */
+void CubeLoop::runPhase(byte phase) {
+
+    unsigned long start = this->engine->getMicros();
+
+    if (phase == this->PHASE_MOVEMENT && this->autoMove) {
+        this->engine->autoMoveSprites(this->getGameMillis());
+    }
+
+    if (this->callbacks[phase] != NULL) {
+        this->callbacks[phase]();
+    }
+
+    if (phase == this->PHASE_LOGIC && this->scheduler != NULL) {
+        this->scheduler->resume(this->gameMillis);
+    }
+
+    unsigned long elapsed = this->engine->getMicros() - start;
+    if (elapsed > 0xFFFF) {
+        elapsed = 0xFFFF;
+    }
+
+    this->phaseTime[phase] = elapsed;
+    if (elapsed > this->phaseMax[phase]) {
+        this->phaseMax[phase] = elapsed;
+    }
+}
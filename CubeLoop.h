@@ -0,0 +1,99 @@
+/*
+* CubeLoop.h - Fixed-timestep game loop for the CubeEngine library.
+*/
+#ifndef CubeLoop_h
+#define CubeLoop_h
+
+#include "Arduino.h"
+#include "CubeEngine.h"
+#include "CubeScheduler.h"
+
+class CubeLoop
+{
+    public:
+
+        // The phases of a tick, in the order they run
+        // Input, logic and movement run once per tick. Compose runs once per
+        // call to run() that ticked, after all the ticks.
+        static const byte PHASE_INPUT    = 0;
+        static const byte PHASE_LOGIC    = 1;
+        static const byte PHASE_MOVEMENT = 2;
+        static const byte PHASE_COMPOSE  = 3;
+        static const byte PHASE_COUNT    = 4;
+
+        // Called for a phase, e.g. void readButtons() { ... }
+        typedef void (*TickCallback)();
+
+        // Game loop constructor
+        CubeLoop(CubeEngine &engine, unsigned int tickMillis);
+
+        // Configuration functions
+        void setTimestep(unsigned int tickMillis);
+        void setCatchUp(byte maxTicks, byte maxFrameSkip);
+        void setAutoMove(bool autoMove);
+        bool setCallback(byte phase, TickCallback callback);
+
+        // The attached scheduler's tasks are resumed in the logic phase of
+        // each tick, after the logic callback
+        void attachScheduler(CubeScheduler *scheduler);
+
+        // Runs the ticks that are due, call this from loop()
+        // Returns true if any ticks ran
+        bool run();
+
+        // Game time
+        unsigned long getTickCount();
+        unsigned long getGameMillis();
+
+        // Microseconds until run() has a tick to run, 0 if one is due
+        unsigned long getMicrosToTick();
+
+        // Budget counters
+        // Phase times are in microseconds and saturate at 65535
+        unsigned int getPhaseTime(byte phase);
+        unsigned int getPhaseMax(byte phase);
+        unsigned long getOverruns();
+        unsigned long getDroppedTicks();
+        unsigned long getSkippedFrames();
+        void resetStats();
+
+    private:
+
+        CubeEngine *engine;
+
+        TickCallback callbacks[PHASE_COUNT];
+        CubeScheduler *scheduler;
+        bool autoMove;
+
+        // Timestep and the time not yet ticked, in microseconds
+        unsigned long stepMicros;
+        unsigned long lag;
+        unsigned long lastTime;
+        bool started;
+
+        // Frame-skip policy
+        // Up to maxTicks ticks run per call. If that doesn't catch up, the
+        // compose phase is skipped for up to maxFrameSkip calls in a row
+        // while the backlog is worked off. After that the backlog is dropped,
+        // so a busy game slows down evenly instead of jumping ahead.
+        byte maxTicks;
+        byte maxFrameSkip;
+        byte frameSkipRun;
+
+        // Game time, which only moves on when a tick runs
+        unsigned long tickCount;
+        unsigned long gameMillis;
+
+        // Budget state
+        unsigned int phaseTime[PHASE_COUNT];
+        unsigned int phaseMax[PHASE_COUNT];
+        unsigned long overruns;
+        unsigned long droppedTicks;
+        unsigned long skippedFrames;
+
+        // Tick functions
+        void tick();
+        void runPhase(byte phase);
+};
+
+#endif
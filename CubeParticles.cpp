@@ -0,0 +1,251 @@
+#include "CubeParticles.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+// Axis steps of a particle that doesn't move, (0, 0, 0)
+static const byte PARTICLE_STILL_STEPS = B00010101;
+
+// A free slot
+static const byte PARTICLE_FREE = 0xFF;
+
+/**
+ * This constructor empties the pool and sets up the default palette,
+ * moving and ageing on every tick
+ */
+CubeParticles::CubeParticles(CubeEngine &engine, CubeParticle *pool, byte poolSize) {
+    this->engine   = &engine;
+    this->pool     = pool;
+    this->poolSize = poolSize;
+
+    this->setVelocity(0, this->STILL);
+    this->setVelocity(1, engine.AV_UP);
+    this->setVelocity(2, engine.AV_DOWN);
+    this->setVelocity(3, engine.AV_LEFT);
+    this->setVelocity(4, engine.AV_RIGHT);
+    this->setVelocity(5, engine.AV_BACK);
+    this->setVelocity(6, engine.AV_FRONT);
+    this->setVelocity(7, this->STILL);
+
+    this->setRates(1, 1);
+
+    for (byte i = 0; i < poolSize; i++) {
+        this->pool[i] = PARTICLE_FREE;
+    }
+
+    for (byte i = 0; i < sizeof(this->drawn); i++) {
+        this->drawn[i] = 0;
+    }
+    engine.overlay = this->drawn;
+}
+
+/*
+ * Sets one entry of the velocity palette
+ */
+void CubeParticles::setVelocity(byte index, byte direction) {
+    if (index > 7) {
+        return;
+    }
+
+    if (direction == this->STILL) {
+        this->velocities[index] = PARTICLE_STILL_STEPS;
+    } else {
+        this->velocities[index] = CubeEngine::getDirectionSteps(direction);
+    }
+}
+
+/*
+ * Sets how many ticks pass between moves and between life counting down
+ */
+void CubeParticles::setRates(byte moveTicks, byte lifeTicks) {
+    this->moveTicks   = (moveTicks == 0) ? 1 : moveTicks;
+    this->lifeTicks   = (lifeTicks == 0) ? 1 : lifeTicks;
+    this->moveCounter = 0;
+    this->lifeCounter = 0;
+}
+
+/*
+ * Adds a particle
+ */
+bool CubeParticles::emit(byte x, byte y, byte z, byte colour, byte velocity, byte life) {
+
+    if (x > 5 || y > 5 || z > 5 || life == 0) {
+        return false;
+    }
+
+    for (byte i = 0; i < this->poolSize; i++) {
+        if ((this->pool[i] & 0xFF) == PARTICLE_FREE) {
+            this->pool[i] = ((x * 36) + (y * 6) + z) |
+                            ((unsigned int) (colour >> 6) << 8) |
+                            ((unsigned int) (velocity & B00000111) << 10) |
+                            ((unsigned int) (life > 7 ? 7 : life) << 13);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Adds up to 'count' particles at one point, each with a random moving
+ * velocity (1-6 in the palette), and returns how many were added
+ */
+byte CubeParticles::burst(byte x, byte y, byte z, byte colour, byte count, byte life) {
+    byte added = 0;
+
+    while (added < count && this->emit(x, y, z, colour, this->engine->getRandom(1, 7), life)) {
+        added += 1;
+    }
+
+    return added;
+}
+
+/*
+ * Removes every particle from the pool and the cube
+ */
+void CubeParticles::clear() {
+    for (byte i = 0; i < this->poolSize; i++) {
+        if ((this->pool[i] & 0xFF) != PARTICLE_FREE) {
+            this->erase(this->pool[i]);
+            this->pool[i] = PARTICLE_FREE;
+        }
+    }
+}
+
+/*
+ * Returns the number of live particles
+ */
+byte CubeParticles::getCount() {
+    byte count = 0;
+
+    for (byte i = 0; i < this->poolSize; i++) {
+        if ((this->pool[i] & 0xFF) != PARTICLE_FREE) {
+            count += 1;
+        }
+    }
+
+    return count;
+}
+
+/*
+ * Ages and moves every particle
+ *
+ * Each particle is taken off the cube before it changes, and dies when its
+ * life runs out or it moves off the cube.
+ */
+void CubeParticles::step() {
+
+    bool move = false;
+    bool age  = false;
+
+    if (++this->moveCounter >= this->moveTicks) {
+        this->moveCounter = 0;
+        move = true;
+    }
+
+    if (++this->lifeCounter >= this->lifeTicks) {
+        this->lifeCounter = 0;
+        age = true;
+    }
+
+    if (!move && !age) {
+        return;
+    }
+
+    for (byte i = 0; i < this->poolSize; i++) {
+        CubeParticle particle = this->pool[i];
+        byte led = particle & 0xFF;
+
+        if (led == PARTICLE_FREE) {
+            continue;
+        }
+
+        this->erase(particle);
+
+        if (age) {
+            particle -= (1U << 13);
+            if ((particle >> 13) == 0) {
+                this->pool[i] = PARTICLE_FREE;
+                continue;
+            }
+        }
+
+        if (move) {
+            byte steps = this->velocities[(particle >> 10) & B00000111];
+
+            byte x = (led / 36) + ((steps >> 4) & B00000011) - 1;
+            byte y = ((led / 6) % 6) + ((steps >> 2) & B00000011) - 1;
+            byte z = (led % 6) + (steps & B00000011) - 1;
+
+            // Stepping below 0 wraps round to 255, so one test covers both walls
+            if (x > 5 || y > 5 || z > 5) {
+                this->pool[i] = PARTICLE_FREE;
+                continue;
+            }
+
+            particle = (particle & 0xFF00) | ((x * 36) + (y * 6) + z);
+        }
+
+        this->pool[i] = particle;
+    }
+}
+
+/*
+ * Draws every particle into the data array
+ *
+ * Particles only go on LEDs that are off or were drawn by a particle, so
+ * they pass behind sprites and anything else in the frame. They're written
+ * a whole LED code at a time, straight into the data array, and each LED
+ * drawn is marked so erase() knows it's the particles' to clear.
+ */
+void CubeParticles::render() {
+
+    byte *data = this->engine->data;
+
+    for (byte i = 0; i < this->poolSize; i++) {
+        CubeParticle particle = this->pool[i];
+        byte led = particle & 0xFF;
+
+        if (led == PARTICLE_FREE) {
+            continue;
+        }
+
+        byte shift = (led & B00000011) << 1;
+        byte code  = (particle >> 8) & B00000011;
+        byte mask  = 1 << (led & B00000111);
+
+        if ((this->drawn[led >> 3] & mask) == 0 && ((data[led >> 2] >> shift) & B00000011) != 0) {
+            continue;
+        }
+
+        // Marked after the write, which gives the engine's mark back if it
+        // changes the LED
+        this->engine->writeData(data, led >> 2, (data[led >> 2] & ~(B00000011 << shift)) | (code << shift));
+        this->drawn[led >> 3] |= mask;
+    }
+}
+
+/*
+ * Takes a particle off the cube
+ *
+ * Only an LED still marked as drawn is cleared. A sprite under the
+ * particle was never marked, and the engine takes the mark off an LED
+ * the game draws over it, even in the same colour. Particles sharing an
+ * LED share its mark, so the first one erased clears it for all.
+ */
+void CubeParticles::erase(CubeParticle particle) {
+
+    byte *data  = this->engine->data;
+    byte led    = particle & 0xFF;
+    byte shift  = (led & B00000011) << 1;
+    byte mask   = 1 << (led & B00000111);
+
+    if ((this->drawn[led >> 3] & mask) == 0) {
+        return;
+    }
+
+    this->engine->writeData(data, led >> 2, data[led >> 2] & ~(B00000011 << shift));
+    this->drawn[led >> 3] &= ~mask;
+}
@@ -0,0 +1,73 @@
+/*
+* CubeParticles.h - Lightweight particles for the CubeEngine library.
+*/
+#ifndef CubeParticles_h
+#define CubeParticles_h
+
+#include "Arduino.h"
+#include "CubeEngine.h"
+
+// One particle, kept in the sketch's pool, e.g. CubeParticle sparks[100];
+//
+// Bits 0 - 7   LED number (x * 36 + y * 6 + z), 255 when the slot is free
+//      8 - 9   colour code
+//      10 - 12 velocity, an index into the velocity palette
+//      13 - 15 life left
+typedef unsigned int CubeParticle;
+
+class CubeParticles
+{
+    public:
+
+        // Velocity palette entry for a particle that doesn't move
+        static const byte STILL = 0xFF;
+
+        // Particle system constructor
+        // The default palette is still, up, down, left, right, back, front
+        // and still again.
+        CubeParticles(CubeEngine &engine, CubeParticle *pool, byte poolSize);
+
+        // Configuration functions
+        // 'direction' is an AV_ direction or STILL. Life counts down once
+        // every 'lifeTicks' ticks and particles move once every 'moveTicks'.
+        void setVelocity(byte index, byte direction);
+        void setRates(byte moveTicks, byte lifeTicks);
+
+        // Emitting functions
+        // 'colour' is an AV_ colour and 'life' is 1-7. These return false
+        // when the pool is full or the position is outside the cube.
+        bool emit(byte x, byte y, byte z, byte colour, byte velocity, byte life);
+        byte burst(byte x, byte y, byte z, byte colour, byte count, byte life);
+        void clear();
+        byte getCount();
+
+        // Frame functions
+        // step() ages and moves every particle once per tick, and render()
+        // draws them in the compose pass. Particles don't cover lit LEDs,
+        // and an LED drawn by the game after a particle is left to the
+        // game when the particle goes. Only the first cube has particles,
+        // and only the last system made for an engine.
+        void step();
+        void render();
+
+    private:
+
+        CubeEngine *engine;
+        CubeParticle *pool;
+        byte poolSize;
+
+        // Axis steps of each velocity, as CubeEngine::getDirectionSteps()
+        byte velocities[8];
+
+        byte moveTicks, lifeTicks;
+        byte moveCounter, lifeCounter;
+
+        // LEDs render() has drawn a particle on, one bit each
+        // The engine clears the bit of an LED anything else writes.
+        byte drawn[27];
+
+        // Particle functions
+        void erase(CubeParticle particle);
+};
+
+#endif
@@ -0,0 +1,313 @@
+#include "CubePath.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+/*
+ * New coordinate after one step along an axis
+ *
+ * Indexed by [wrap][step + 1][coordinate]. 0xFF marks a step off the
+ * edge of the cube.
+ */
+static const byte PATH_AXIS_STEPS[2][3][6] PROGMEM = {
+    {
+        { 0xFF, 0, 1, 2, 3, 4 },
+        { 0, 1, 2, 3, 4, 5 },
+        { 1, 2, 3, 4, 5, 0xFF }
+    },
+    {
+        { 5, 0, 1, 2, 3, 4 },
+        { 0, 1, 2, 3, 4, 5 },
+        { 1, 2, 3, 4, 5, 0 }
+    }
+};
+
+/**
+ * This constructor starts with no obstacles, no wrap and the target at (0,0,0)
+ */
+CubePath::CubePath(CubeEngine &engine) {
+
+    this->engine = &engine;
+    this->target = 0;
+    this->wrap   = false;
+
+    for (int i = 26; i >= 0; i--) {
+        this->obstacles[i] = 0;
+    }
+
+    // No voxel has a direction until the first search reaches it
+    for (int i = 107; i >= 0; i--) {
+        this->flow[i] = 0xFF;
+    }
+
+    this->restart();
+}
+
+/*
+ * Moves the target the sprites are steered towards
+ */
+void CubePath::setTarget(byte x, byte y, byte z) {
+
+    byte voxel = (x * 36) + (y * 6) + z;
+
+    if (x > 5 || y > 5 || z > 5 || voxel == this->target) {
+        return;
+    }
+
+    this->target = voxel;
+    this->restart();
+}
+
+/*
+ * Sets whether routes may wrap around the cube
+ *
+ * This should match the AN_WRAP attribute of the sprites being steered.
+ */
+void CubePath::setWrap(bool wrap) {
+    if (wrap != this->wrap) {
+        this->wrap = wrap;
+        this->restart();
+    }
+}
+
+/*
+ * Blocks or unblocks a voxel
+ */
+void CubePath::setObstacle(byte x, byte y, byte z, bool blocked) {
+
+    if (x > 5 || y > 5 || z > 5) {
+        return;
+    }
+
+    byte voxel = (x * 36) + (y * 6) + z;
+    byte mask  = 1 << (voxel & 7);
+    byte index = voxel >> 3;
+
+    // Nothing to do if the voxel is already in the requested state
+    if (((this->obstacles[index] & mask) != 0) == blocked) {
+        return;
+    }
+
+    this->obstacles[index] ^= mask;
+    this->restart();
+}
+
+/*
+ * Unblocks every voxel
+ */
+void CubePath::clearObstacles() {
+
+    byte any = 0;
+    for (int i = 26; i >= 0; i--) {
+        any |= this->obstacles[i];
+        this->obstacles[i] = 0;
+    }
+
+    if (any) {
+        this->restart();
+    }
+}
+
+/*
+ * Continues the search
+ *
+ * At most 'budget' frontier voxels are expanded, each costing fourteen
+ * neighbour lookups, so the sketch can bound the work done per frame.
+ * Returns true once the field is complete.
+ *
+ * While a search is running, voxels it has not reached yet keep the
+ * direction from the previous field.
+ */
+bool CubePath::update(byte budget) {
+
+    while (budget > 0 && !this->complete) {
+
+        // End of a pass, so the next layer becomes the frontier
+        if (this->scanPos >= this->VOXELS) {
+
+            byte any = 0;
+            for (int i = 26; i >= 0; i--) {
+                this->frontier[i] = this->next[i];
+                any |= this->next[i];
+                this->next[i] = 0;
+            }
+            this->scanPos = 0;
+
+            // Every reachable voxel has been found
+            // Clear the old directions of the voxels which weren't reached
+            if (!any) {
+                for (int v = this->VOXELS - 1; v >= 0; v--) {
+                    if (!(this->visited[v >> 3] & (1 << (v & 7)))) {
+                        this->setFlow(v, 0xF);
+                    }
+                }
+                this->complete = true;
+            }
+
+            continue;
+        }
+
+        // Skip empty parts of the frontier a byte at a time
+        byte bits = this->frontier[this->scanPos >> 3] >> (this->scanPos & 7);
+        if (bits == 0) {
+            this->scanPos = (this->scanPos | 7) + 1;
+            continue;
+        }
+
+        if (bits & 1) {
+            this->expand(this->scanPos);
+            budget -= 1;
+        }
+
+        this->scanPos += 1;
+    }
+
+    return this->complete;
+}
+
+/*
+ * Returns true when every voxel's direction is up to date
+ */
+bool CubePath::isComplete() {
+    return this->complete;
+}
+
+/*
+ * Returns the AV_ direction which moves one step closer to the target
+ */
+byte CubePath::getDirection(byte x, byte y, byte z) {
+
+    if (x > 5 || y > 5 || z > 5) {
+        return this->NO_DIRECTION;
+    }
+
+    byte direction = this->getFlow((x * 36) + (y * 6) + z);
+
+    if (direction == 0xF) {
+        return this->NO_DIRECTION;
+    }
+
+    return direction << 3;
+}
+
+/*
+ * Points a sprite towards the target
+ *
+ * The sprite keeps its direction when it's on the target or has no route.
+ */
+void CubePath::steerSprite(int spriteNum) {
+
+    byte direction = this->getDirection(
+        this->engine->getSpriteAttribute(spriteNum, this->engine->AN_X),
+        this->engine->getSpriteAttribute(spriteNum, this->engine->AN_Y),
+        this->engine->getSpriteAttribute(spriteNum, this->engine->AN_Z));
+
+    if (direction != this->NO_DIRECTION) {
+        this->engine->setSpriteAttribute(spriteNum, this->engine->AN_DIRECTION, direction);
+    }
+}
+
+/*
+ * Returns the voxel one step away in a direction, or VOXELS if the step
+ * leaves the cube
+ *
+ * Diagonal steps need all three axes to move. moveSprite() will still slide
+ * along a wall on a blocked diagonal, but that move is already covered by
+ * one of the straight or shorter directions.
+ */
+byte CubePath::neighbour(byte voxel, byte direction, bool wrap) {
+
+    byte steps = CubeEngine::getDirectionSteps(direction << 3);
+
+    byte x = voxel / 36;
+    byte y = (voxel / 6) % 6;
+    byte z = voxel % 6;
+
+    x = pgm_read_byte(&PATH_AXIS_STEPS[wrap][(steps >> 4) & 3][x]);
+    y = pgm_read_byte(&PATH_AXIS_STEPS[wrap][(steps >> 2) & 3][y]);
+    z = pgm_read_byte(&PATH_AXIS_STEPS[wrap][steps & 3][z]);
+
+    if ((x | y | z) == 0xFF) {
+        return VOXELS;
+    }
+
+    return (x * 36) + (y * 6) + z;
+}
+
+/*
+ * Starts a new search from the target
+ */
+void CubePath::restart() {
+
+    for (int i = 26; i >= 0; i--) {
+        this->visited[i]  = 0;
+        this->frontier[i] = 0;
+        this->next[i]     = 0;
+    }
+
+    this->visited[this->target >> 3]  = 1 << (this->target & 7);
+    this->frontier[this->target >> 3] = 1 << (this->target & 7);
+    this->setFlow(this->target, 0xF);
+
+    this->scanPos  = 0;
+    this->complete = false;
+}
+
+/*
+ * Adds the unvisited neighbours of a frontier voxel to the next layer
+ *
+ * Every move has an exact reverse, so a neighbour reached by moving in
+ * one direction gets to the target by moving in the opposite direction.
+ */
+void CubePath::expand(byte voxel) {
+
+    for (byte direction = 0; direction < this->DIRECTIONS; direction++) {
+
+        byte found = this->neighbour(voxel, direction, this->wrap);
+        if (found == this->VOXELS) {
+            continue;
+        }
+
+        byte index = found >> 3;
+        byte mask  = 1 << (found & 7);
+
+        if ((this->visited[index] | this->obstacles[index]) & mask) {
+            continue;
+        }
+
+        this->visited[index] |= mask;
+        this->next[index]    |= mask;
+
+        // Up/down, left/right and back/front are pairs, and the diagonals
+        // are listed so that opposite directions add up to 19
+        this->setFlow(found, direction < 6 ? direction ^ 1 : 19 - direction);
+    }
+}
+
+/*
+ * Stores a voxel's direction nibble
+ */
+void CubePath::setFlow(byte voxel, byte direction) {
+    byte index = voxel >> 1;
+
+    if (voxel & 1) {
+        this->flow[index] = (this->flow[index] & B00001111) | (direction << 4);
+    } else {
+        this->flow[index] = (this->flow[index] & B11110000) | direction;
+    }
+}
+
+/*
+ * Reads a voxel's direction nibble
+ */
+byte CubePath::getFlow(byte voxel) {
+    byte codes = this->flow[voxel >> 1];
+
+    if (voxel & 1) {
+        return codes >> 4;
+    }
+
+    return codes & B00001111;
+}
@@ -0,0 +1,74 @@
+/*
+* CubePath.h - Flow-field pathfinding for CubeEngine sprites.
+*/
+#ifndef CubePath_h
+#define CubePath_h
+
+#include "Arduino.h"
+#include "CubeEngine.h"
+
+class CubePath
+{
+    public:
+
+        // Returned when a voxel has no route to the target
+        static const byte NO_DIRECTION = 0xFF;
+
+        // Number of voxels in the cube and of directions moveSprite() supports
+        static const byte VOXELS     = 216;
+        static const byte DIRECTIONS = 14;
+
+        // Path finder constructor
+        CubePath(CubeEngine &engine);
+
+        // Field configuration functions
+        // These only restart the search when something actually changes
+        void setTarget(byte x, byte y, byte z);
+        void setWrap(bool wrap);
+        void setObstacle(byte x, byte y, byte z, bool blocked);
+        void clearObstacles();
+
+        // Search functions
+        bool update(byte budget);
+        bool isComplete();
+
+        // Steering functions
+        byte getDirection(byte x, byte y, byte z);
+        void steerSprite(int spriteNum);
+
+        // Neighbour lookup, usable without a field
+        static byte neighbour(byte voxel, byte direction, bool wrap);
+
+    private:
+
+        CubeEngine *engine;
+
+        // Target voxel and whether routes may wrap around the cube
+        // Voxels are numbered x * 36 + y * 6 + z, the same order as setLED()
+        byte target;
+        bool wrap;
+
+        // One bit per voxel
+        byte obstacles[27];
+        byte visited[27];
+        byte frontier[27];
+        byte next[27];
+
+        // Direction of travel towards the target, one nibble per voxel
+        // The nibble holds the direction number (AV_ value >> 3) or 0xF for none
+        byte flow[108];
+
+        // Search progress
+        // The search expands one breadth-first layer per pass over the frontier,
+        // and update() can stop part way through a pass.
+        byte scanPos;
+        bool complete;
+
+        // Search helpers
+        void restart();
+        void expand(byte voxel);
+        void setFlow(byte voxel, byte direction);
+        byte getFlow(byte voxel);
+};
+
+#endif
@@ -0,0 +1,454 @@
+/*
+* CubePins.h - Compile-time pin mapping for the CubeEngine library.
+*
+* Include this in the sketch to wire the cube to pins other than the
+* defaults while keeping direct port speed:
+*
+*   typedef CubePinMap<A1, A3, A2, 2, 3, 4, 5, 6, 7> MyPins;
+*   CubeEngine cube((MyPins()));
+*
+* Every pin is resolved to its port register and bit-mask by the compiler,
+* so each pin change in mplex() is a single sbi/cbi instruction.
+*/
+#ifndef CubePins_h
+#define CubePins_h
+
+#include "Arduino.h"
+#include "CubeEngine.h"
+
+// Boards whose pin numbering is known at compile time
+// The host stand-in in extras/host sets CUBE_HOST_PORTS and numbers its pins
+// the same way, so tests can watch the ports.
+#ifndef CUBE_HOST_PORTS
+  #define CUBE_HOST_PORTS 0
+#endif
+
+#if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328__) || \
+    defined(__AVR_ATmega168__) || defined(__AVR_ATmega168P__) || CUBE_HOST_PORTS
+  #define CUBE_PINS_SUPPORTED 1
+#else
+  #define CUBE_PINS_SUPPORTED 0
+#endif
+
+// Boards with 8-bit port registers behind portOutputRegister()
+// Anywhere else a wiring given by pin numbers goes through digitalWrite(),
+// and there are no parallel chains.
+#if defined(__AVR__) || CUBE_HOST_PORTS
+  #define CUBE_PORTS_SUPPORTED 1
+#else
+  #define CUBE_PORTS_SUPPORTED 0
+#endif
+
+// Access to a port register by its data memory address
+#define CUBE_PIN_REG(address) _SFR_MEM8(address)
+
+/*
+ * ATmega328P pin numbering
+ *
+ * Digital pins 0-7 are PORTD, 8-13 are PORTB and 14-19 (A0-A5) are PORTC.
+ * The port values are the data memory address of each PORTx register and
+ * the Arduino port number (PB, PC, PD) used by digitalPinToPort().
+ */
+static constexpr byte cubePinAddress(byte pin) {
+    return (pin < 8) ? 0x2B : ((pin < 14) ? 0x25 : 0x28);
+}
+
+static constexpr byte cubePinPort(byte pin) {
+    return (pin < 8) ? 4 : ((pin < 14) ? 2 : 3);
+}
+
+static constexpr byte cubePinMask(byte pin) {
+    return 1 << ((pin < 8) ? pin : ((pin < 14) ? pin - 8 : pin - 14));
+}
+
+// True on boards whose pin numbering is known
+// It takes a pin so a pin map is only checked when it's used, and other
+// boards can still include this file for the runtime pins.
+template <byte PIN>
+struct CubePinsKnown
+{
+    static const bool value = CUBE_PINS_SUPPORTED;
+};
+
+/*
+ * A cube wiring fixed at compile time
+ */
+template <byte LATCH, byte CLOCK, byte DATA,
+          byte LAYER0, byte LAYER1, byte LAYER2,
+          byte LAYER3, byte LAYER4, byte LAYER5>
+struct CubePinMap
+{
+    static_assert(CubePinsKnown<LATCH>::value, "CubePinMap doesn't know this board's pin numbering");
+    static_assert(LATCH < 20 && CLOCK < 20 && DATA < 20 &&
+                  LAYER0 < 20 && LAYER1 < 20 && LAYER2 < 20 &&
+                  LAYER3 < 20 && LAYER4 < 20 && LAYER5 < 20, "CubePinMap pins must be 0-19");
+
+    static const byte LATCH_PORT = cubePinAddress(LATCH);
+    static const byte LATCH_MASK = cubePinMask(LATCH);
+    static const byte CLOCK_PORT = cubePinAddress(CLOCK);
+    static const byte CLOCK_MASK = cubePinMask(CLOCK);
+    static const byte DATA_PORT  = cubePinAddress(DATA);
+    static const byte DATA_MASK  = cubePinMask(DATA);
+
+    // When all the layers are on one port they can be switched off together
+    static const bool LAYERS_SHARE_PORT =
+        cubePinAddress(LAYER0) == cubePinAddress(LAYER1) && cubePinAddress(LAYER0) == cubePinAddress(LAYER2) &&
+        cubePinAddress(LAYER0) == cubePinAddress(LAYER3) && cubePinAddress(LAYER0) == cubePinAddress(LAYER4) &&
+        cubePinAddress(LAYER0) == cubePinAddress(LAYER5);
+    static const byte LAYER_MASK =
+        cubePinMask(LAYER0) | cubePinMask(LAYER1) | cubePinMask(LAYER2) |
+        cubePinMask(LAYER3) | cubePinMask(LAYER4) | cubePinMask(LAYER5);
+
+    // Sets the pins to outputs, all low
+    static void setup(CubeEngine *) {
+        setupPin(LATCH); setupPin(CLOCK); setupPin(DATA);
+        setupPin(LAYER0); setupPin(LAYER1); setupPin(LAYER2);
+        setupPin(LAYER3); setupPin(LAYER4); setupPin(LAYER5);
+    }
+
+    static void latchLow(CubeEngine *)  { CUBE_PIN_REG(LATCH_PORT) &= ~LATCH_MASK; }
+    static void latchHigh(CubeEngine *) { CUBE_PIN_REG(LATCH_PORT) |= LATCH_MASK; }
+    static void dataLow(CubeEngine *)   { CUBE_PIN_REG(DATA_PORT) &= ~DATA_MASK; }
+    static void dataHigh(CubeEngine *)  { CUBE_PIN_REG(DATA_PORT) |= DATA_MASK; }
+    static void clockLow(CubeEngine *)  { CUBE_PIN_REG(CLOCK_PORT) &= ~CLOCK_MASK; }
+    static void clockHigh(CubeEngine *) { CUBE_PIN_REG(CLOCK_PORT) |= CLOCK_MASK; }
+
+    // Port and clock bit used by the parallel chains
+    // The clock bit is 0 when the clock is on another port.
+    static byte readDataPort(CubeEngine *) { return CUBE_PIN_REG(DATA_PORT); }
+    static void writeDataPort(CubeEngine *, byte value) { CUBE_PIN_REG(DATA_PORT) = value; }
+    static byte clockOnDataPort(CubeEngine *) {
+        return (CLOCK_PORT == DATA_PORT) ? CLOCK_MASK : 0;
+    }
+
+    static void layersOff(CubeEngine *) {
+        if (LAYERS_SHARE_PORT) {
+            CUBE_PIN_REG(cubePinAddress(LAYER0)) &= (byte) ~LAYER_MASK;
+        } else {
+            CUBE_PIN_REG(cubePinAddress(LAYER0)) &= ~cubePinMask(LAYER0);
+            CUBE_PIN_REG(cubePinAddress(LAYER1)) &= ~cubePinMask(LAYER1);
+            CUBE_PIN_REG(cubePinAddress(LAYER2)) &= ~cubePinMask(LAYER2);
+            CUBE_PIN_REG(cubePinAddress(LAYER3)) &= ~cubePinMask(LAYER3);
+            CUBE_PIN_REG(cubePinAddress(LAYER4)) &= ~cubePinMask(LAYER4);
+            CUBE_PIN_REG(cubePinAddress(LAYER5)) &= ~cubePinMask(LAYER5);
+        }
+    }
+
+    static void layerOn(CubeEngine *, byte layer) {
+        switch (layer) {
+            case 0: CUBE_PIN_REG(cubePinAddress(LAYER0)) |= cubePinMask(LAYER0); break;
+            case 1: CUBE_PIN_REG(cubePinAddress(LAYER1)) |= cubePinMask(LAYER1); break;
+            case 2: CUBE_PIN_REG(cubePinAddress(LAYER2)) |= cubePinMask(LAYER2); break;
+            case 3: CUBE_PIN_REG(cubePinAddress(LAYER3)) |= cubePinMask(LAYER3); break;
+            case 4: CUBE_PIN_REG(cubePinAddress(LAYER4)) |= cubePinMask(LAYER4); break;
+            case 5: CUBE_PIN_REG(cubePinAddress(LAYER5)) |= cubePinMask(LAYER5); break;
+        }
+    }
+
+    // Arduino port number of the data pin, and the bits of that port which
+    // the parallel chains can't use
+    static byte chainPort() { return cubePinPort(DATA); }
+    static byte chainReserved() {
+        return ((LATCH_PORT == DATA_PORT) ? LATCH_MASK : 0) | ((CLOCK_PORT == DATA_PORT) ? CLOCK_MASK : 0);
+    }
+
+    private:
+
+        static void setupPin(byte pin) {
+            CUBE_PIN_REG(cubePinAddress(pin) - 1) |= cubePinMask(pin);  // DDRx
+            CUBE_PIN_REG(cubePinAddress(pin)) &= ~cubePinMask(pin);     // PORTx
+        }
+};
+
+// The wiring used by the original cube and the default constructor
+typedef CubePinMap<A1, A3, A2, 2, 3, 4, 5, 6, 7> CubeDefaultPins;
+
+/*
+ * A cube wiring only known at run time
+ *
+ * Used by the pin number constructor when the pins aren't the default
+ * wiring, or on boards whose numbering isn't known. The engine keeps one
+ * of these on the heap, so every pin change is a load through two
+ * pointers rather than a single instruction. Boards without AVR port
+ * registers call digitalWrite(), which is slower still.
+ */
+struct CubeRuntimePins
+{
+    // Pins in the order latch, clock, data, then layers 0-5
+#if CUBE_PORTS_SUPPORTED
+    volatile byte *ports[9];
+    byte masks[9];
+#else
+    byte pins[9];
+#endif
+
+    CubeRuntimePins(const int *numbers) {
+        for (byte i = 0; i < 9; i++) {
+#if CUBE_PORTS_SUPPORTED
+            this->ports[i] = portOutputRegister(digitalPinToPort(numbers[i]));
+            this->masks[i] = digitalPinToBitMask(numbers[i]);
+#else
+            this->pins[i] = numbers[i];
+#endif
+        }
+    }
+
+    static void latchLow(CubeEngine *engine)  { low(engine, 0); }
+    static void latchHigh(CubeEngine *engine) { high(engine, 0); }
+    static void clockLow(CubeEngine *engine)  { low(engine, 1); }
+    static void clockHigh(CubeEngine *engine) { high(engine, 1); }
+    static void dataLow(CubeEngine *engine)   { low(engine, 2); }
+    static void dataHigh(CubeEngine *engine)  { high(engine, 2); }
+
+#if CUBE_PORTS_SUPPORTED
+    static byte readDataPort(CubeEngine *engine) { return *engine->runtimePins->ports[2]; }
+    static void writeDataPort(CubeEngine *engine, byte value) { *engine->runtimePins->ports[2] = value; }
+    static byte clockOnDataPort(CubeEngine *engine) {
+        CubeRuntimePins *pins = engine->runtimePins;
+        return (pins->ports[1] == pins->ports[2]) ? pins->masks[1] : 0;
+    }
+#else
+    // setShiftChains() refuses parallel chains without a port, so these
+    // are never used
+    static byte readDataPort(CubeEngine *) { return 0; }
+    static void writeDataPort(CubeEngine *, byte) {}
+    static byte clockOnDataPort(CubeEngine *) { return 0; }
+#endif
+
+    static void layersOff(CubeEngine *engine) {
+        for (byte i = 3; i < 9; i++) {
+            low(engine, i);
+        }
+    }
+
+    static void layerOn(CubeEngine *engine, byte layer) {
+        high(engine, layer + 3);
+    }
+
+    private:
+
+#if CUBE_PORTS_SUPPORTED
+        static void low(CubeEngine *engine, byte pin) {
+            *engine->runtimePins->ports[pin] &= ~engine->runtimePins->masks[pin];
+        }
+
+        static void high(CubeEngine *engine, byte pin) {
+            *engine->runtimePins->ports[pin] |= engine->runtimePins->masks[pin];
+        }
+#else
+        static void low(CubeEngine *engine, byte pin) {
+            digitalWrite(engine->runtimePins->pins[pin], LOW);
+        }
+
+        static void high(CubeEngine *engine, byte pin) {
+            digitalWrite(engine->runtimePins->pins[pin], HIGH);
+        }
+#endif
+};
+
+/*
+ * Builds a cube driven through a compile-time pin map
+ */
+template <class Pins>
+CubeEngine::CubeEngine(Pins) {
+
+    // Set pins to output, all low
+    Pins::setup(this);
+
+    // Only the parallel chain data pins are checked at run time
+    this->chainPort     = Pins::chainPort();
+    this->chainReserved = Pins::chainReserved();
+
+    this->runtimePins    = NULL;
+    this->driveRegisters = &CubeEngine::drive<Pins>;
+
+    this->initialise();
+}
+
+/*
+ * Drives the registers and layers through a pin map
+ *
+ * This is everything mplex() does that touches a pin. The pass is
+ * PASS_BLUE_GREEN or PASS_RED to shift out and show the current layer,
+ * PASS_DARK to leave every layer off until the next pass, or PASS_BLANK
+ * to push off LEDs into every register.
+ */
+template <class Pins>
+void CubeEngine::drive(byte pass) {
+
+    // Keep the layers off for a pass dimmed by equalisation
+    if (pass == this->PASS_DARK) {
+        Pins::layersOff(this);
+        return;
+    }
+
+    // Blank the registers, every data line high
+    if (pass == this->PASS_BLANK) {
+        Pins::dataHigh(this);
+        if (this->shiftChains > 1) {
+            Pins::writeDataPort(this, Pins::readDataPort(this) | this->chainDataMask);
+        }
+        for (int i = (36 * this->cubeCount) - 1; i >= 0; i--) {
+            Pins::clockHigh(this);
+            Pins::clockLow(this);
+            Pins::clockHigh(this);
+            Pins::clockLow(this);
+            Pins::clockHigh(this);
+            Pins::clockLow(this);
+        }
+        return;
+    }
+
+    bool red = (pass == this->PASS_RED);
+    const byte *patterns = red ? SHIFT_PATTERNS_RED : SHIFT_PATTERNS_BLUE_GREEN;
+
+    // Turn off power to all layers
+    Pins::layersOff(this);
+
+    // Prepare registers for data
+    Pins::latchLow(this);
+
+    if (this->shiftChains > 1) {
+        this->shiftParallel<Pins>(this->layerCounter * 36, patterns);
+
+    } else {
+
+        // Set which elements of the data array the LED codes are found in
+        int lower = (this->layerCounter * 72) / 8;
+        int upper = lower + 8;
+
+        // The last cube is furthest along the chain so it goes first
+        for (int cube = this->cubeCount - 1; cube >= 0; cube--) {
+            byte *frame = this->getCubeData(cube);
+
+            for (int i = upper; i >= lower; i--) {
+
+                // Get the current element
+                // Bit-shifting the data array directly mutates it, so work on a copy
+                byte element = frame[i];
+
+                // Cycle through the codes in each byte, last LED first
+                for (int j = 0; j < 8; j += 2) {
+
+                    byte pattern = pgm_read_byte(&patterns[element >> 6]);
+                    element = element << 2;
+
+                    // Shift out the three register bits of the LED
+                    if (pattern & B00000100) { Pins::dataHigh(this); } else { Pins::dataLow(this); }
+                    Pins::clockHigh(this);
+                    Pins::clockLow(this);
+
+                    if (pattern & B00000010) { Pins::dataHigh(this); } else { Pins::dataLow(this); }
+                    Pins::clockHigh(this);
+                    Pins::clockLow(this);
+
+                    if (pattern & B00000001) { Pins::dataHigh(this); } else { Pins::dataLow(this); }
+                    Pins::clockHigh(this);
+                    Pins::clockLow(this);
+                }
+            }
+        }
+    }
+
+    // Signal end of data
+    Pins::latchHigh(this);
+
+    // Supply power to the active layer
+    Pins::layerOn(this, this->layerCounter);
+}
+
+/*
+ * Shifts one pass of a layer into every chain at once
+ *
+ * For each LED slot the 3-bit patterns of all chains are first transposed
+ * into three port values, one per clock. When the clock is on the same
+ * port as the data pins, each clock then costs one write to set the data
+ * bits of every chain and one to raise the clock, however many chains
+ * there are.
+ *
+ * Only the clocking is shared. Every LED is still looked up and its
+ * pattern transposed one at a time, so the time saved isn't the chain
+ * count: a pass takes 328 port writes with one chain, 113 with two and 59
+ * with four, but the 36 lookups per layer stay.
+ */
+template <class Pins>
+void CubeEngine::shiftParallel(int firstLED, const byte *patterns) {
+
+    byte chains = this->shiftChains;
+    int  total  = 36 * this->cubeCount;
+    byte slots  = (total + chains - 1) / chains;
+
+    // Where each chain's last slot is, as a cube and an LED within the layer
+    // These count down with the slots, which avoids a divide per LED
+    byte chainCube[8];
+    byte chainLED[8];
+    for (byte k = 0; k < chains; k++) {
+        int led = (k * slots) + slots - 1;
+        chainCube[k] = led / 36;
+        chainLED[k]  = led % 36;
+    }
+
+    // Everything on the port except the data and clock bits stays as it is
+    byte clock = Pins::clockOnDataPort(this);
+    byte base  = Pins::readDataPort(this) & ~(this->chainDataMask | clock);
+
+    // The last LED of every chain goes out first, like the single chain
+    for (int slot = slots - 1; slot >= 0; slot--) {
+
+        byte first  = base;
+        byte second = base;
+        byte third  = base;
+
+        for (byte k = 0; k < chains; k++) {
+
+            // Slots past the end of a short chain shift out as off
+            byte code = this->REG_OFF;
+            if (chainCube[k] < this->cubeCount) {
+                int n = firstLED + chainLED[k];
+                code = (this->getCubeData(chainCube[k])[n >> 2] >> ((n & 3) << 1)) & B00000011;
+            }
+
+            // Step back to the previous LED of the chain
+            if (chainLED[k] == 0) {
+                chainLED[k]   = 35;
+                chainCube[k] -= 1;
+            } else {
+                chainLED[k] -= 1;
+            }
+
+            byte pattern = pgm_read_byte(&patterns[code]);
+            byte mask    = this->chainMasks[k];
+
+            if (pattern & B00000100) { first  |= mask; }
+            if (pattern & B00000010) { second |= mask; }
+            if (pattern & B00000001) { third  |= mask; }
+        }
+
+        // Set the data bits with the clock low, then raise the clock
+        if (clock) {
+            Pins::writeDataPort(this, first);
+            Pins::writeDataPort(this, first | clock);
+            Pins::writeDataPort(this, second);
+            Pins::writeDataPort(this, second | clock);
+            Pins::writeDataPort(this, third);
+            Pins::writeDataPort(this, third | clock);
+        } else {
+            Pins::writeDataPort(this, first);
+            Pins::clockHigh(this);
+            Pins::clockLow(this);
+            Pins::writeDataPort(this, second);
+            Pins::clockHigh(this);
+            Pins::clockLow(this);
+            Pins::writeDataPort(this, third);
+            Pins::clockHigh(this);
+            Pins::clockLow(this);
+        }
+    }
+
+    // Leave the clock low
+    if (clock) {
+        Pins::writeDataPort(this, base);
+    }
+}
+
+#endif
@@ -0,0 +1,274 @@
+#include "CubeRaycast.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+/*
+ * Ray tables for the 14 directions
+ *
+ * Each entry is the change in voxel number for one step (x * 36 + y * 6
+ * + z). Entry n is the AV_ direction with value n << 3. Along with the
+ * axis steps from CubeEngine::getDirectionSteps() this lets a ray walk
+ * the bitmap with one add per voxel.
+ */
+static const signed char RAY_VOXEL_STEPS[14] PROGMEM = {
+      6,  -6, -36,  36,   1,  -1,  // up, down, left, right, back, front
+    -29,  43, -41,  31,            // back up left/right, back down left/right
+    -31,  41, -43,  29             // front up left/right, front down left/right
+};
+
+// Bit-masks of the voxels within an occupancy byte
+static const byte RAY_BIT_MASKS[8] PROGMEM = {
+    B00000001, B00000010, B00000100, B00001000,
+    B00010000, B00100000, B01000000, B10000000
+};
+
+/**
+ * This constructor starts with nothing occupied
+ */
+CubeRaycast::CubeRaycast(CubeEngine &engine) {
+    this->engine = &engine;
+    this->clear();
+}
+
+/*
+ * Marks the lit LEDs of the first cube as occupied
+ *
+ * Each data byte holds four LEDs, so two data bytes make one occupancy
+ * byte. A code is lit if either of its bits is set.
+ */
+void CubeRaycast::capture() {
+
+    byte *data = this->engine->data;
+
+    for (byte i = 0; i < 27; i++) {
+        byte bits = 0;
+
+        for (byte half = 0; half < 2; half++) {
+            byte codes = data[(i * 2) + half];
+            byte lit   = (codes | (codes >> 1)) & B01010101;
+
+            // Gather bits 0, 2, 4 and 6 into bits 0-3
+            lit = (lit | (lit >> 1)) & B00110011;
+            lit = (lit | (lit >> 2)) & B00001111;
+
+            bits |= lit << (half * 4);
+        }
+
+        this->occupancy[i] = bits;
+    }
+}
+
+/*
+ * Marks every voxel as empty
+ */
+void CubeRaycast::clear() {
+    for (byte i = 0; i < 27; i++) {
+        this->occupancy[i] = 0;
+    }
+}
+
+/*
+ * Marks one voxel as occupied or empty
+ */
+void CubeRaycast::setOccupied(byte x, byte y, byte z, bool occupied) {
+
+    if (x > 5 || y > 5 || z > 5) {
+        return;
+    }
+
+    byte voxel = (x * 36) + (y * 6) + z;
+    byte mask  = pgm_read_byte(&RAY_BIT_MASKS[voxel & 7]);
+
+    if (occupied) {
+        this->occupancy[voxel >> 3] |= mask;
+    } else {
+        this->occupancy[voxel >> 3] &= ~mask;
+    }
+}
+
+/*
+ * Returns true if a voxel is occupied
+ */
+bool CubeRaycast::isOccupied(byte x, byte y, byte z) {
+
+    if (x > 5 || y > 5 || z > 5) {
+        return false;
+    }
+
+    return this->test((x * 36) + (y * 6) + z);
+}
+
+/*
+ * Casts a ray from a voxel in one of the 14 move directions
+ *
+ * The ray stops at the wall or after 'range' steps. The number of steps
+ * is worked out before the walk, so the loop itself has no bounds checks.
+ */
+byte CubeRaycast::castDirection(byte x, byte y, byte z, byte direction, byte range) {
+
+    if (x > 5 || y > 5 || z > 5) {
+        return this->NO_HIT;
+    }
+
+    byte index = (direction >> 3) % 14;
+    byte steps = CubeEngine::getDirectionSteps(direction);
+
+    // Steps left before each axis reaches the wall
+    byte axes[3]  = {x, y, z};
+    byte limit    = range;
+
+    for (byte axis = 0; axis < 3; axis++) {
+        byte step = (steps >> (4 - (axis * 2))) & B00000011;
+
+        if (step == 2 && (5 - axes[axis]) < limit) {
+            limit = 5 - axes[axis];
+        } else if (step == 0 && axes[axis] < limit) {
+            limit = axes[axis];
+        }
+    }
+
+    signed char delta = pgm_read_byte(&RAY_VOXEL_STEPS[index]);
+    byte voxel = (x * 36) + (y * 6) + z;
+
+    while (limit > 0) {
+        voxel += delta;
+        if (this->test(voxel)) {
+            return voxel;
+        }
+        limit -= 1;
+    }
+
+    return this->NO_HIT;
+}
+
+/*
+ * Casts a ray between two voxels
+ *
+ * This is an integer DDA: the axis with the longest run takes one step
+ * per voxel and the others step when their error passes half a voxel.
+ * The end points aren't tested, so a sprite doesn't block its own view.
+ *
+ * An error exactly at half a voxel steps one way walking forwards and
+ * the other walking back, so the path is always walked from the lower
+ * numbered end. That way A to B and B to A cross the same voxels. When
+ * that's the far end, the hit nearest the start is the last one found.
+ */
+byte CubeRaycast::castLine(byte x0, byte y0, byte z0, byte x1, byte y1, byte z1) {
+
+    if (x0 > 5 || y0 > 5 || z0 > 5 || x1 > 5 || y1 > 5 || z1 > 5) {
+        return this->NO_HIT;
+    }
+
+    bool reversed = ((x0 * 36) + (y0 * 6) + z0) > ((x1 * 36) + (y1 * 6) + z1);
+    if (reversed) {
+        byte swap;
+        swap = x0; x0 = x1; x1 = swap;
+        swap = y0; y0 = y1; y1 = swap;
+        swap = z0; z0 = z1; z1 = swap;
+    }
+
+    int dx = x1 - x0;
+    int dy = y1 - y0;
+    int dz = z1 - z0;
+
+    byte ax = abs(dx);
+    byte ay = abs(dy);
+    byte az = abs(dz);
+
+    // Voxel number changes for a step on each axis
+    signed char sx = (dx > 0) ? 36 : -36;
+    signed char sy = (dy > 0) ? 6 : -6;
+    signed char sz = (dz > 0) ? 1 : -1;
+
+    byte run = ax;
+    if (ay > run) { run = ay; }
+    if (az > run) { run = az; }
+
+    // Errors start at half a voxel so the line passes through centres
+    byte twiceRun = run * 2;
+    byte ex = run;
+    byte ey = run;
+    byte ez = run;
+
+    byte voxel = (x0 * 36) + (y0 * 6) + z0;
+    byte hit   = this->NO_HIT;
+
+    for (byte i = 1; i < run; i++) {
+
+        ex += ax * 2;
+        if (ex >= twiceRun) { ex -= twiceRun; voxel += sx; }
+
+        ey += ay * 2;
+        if (ey >= twiceRun) { ey -= twiceRun; voxel += sy; }
+
+        ez += az * 2;
+        if (ez >= twiceRun) { ez -= twiceRun; voxel += sz; }
+
+        if (this->test(voxel)) {
+            if (!reversed) {
+                return voxel;
+            }
+            hit = voxel;
+        }
+    }
+
+    return hit;
+}
+
+/*
+ * Returns true if nothing occupies the straight path between two voxels
+ */
+bool CubeRaycast::lineOfSight(byte x0, byte y0, byte z0, byte x1, byte y1, byte z1) {
+    return this->castLine(x0, y0, z0, x1, y1, z1) == this->NO_HIT;
+}
+
+/*
+ * Casts a ray along a sprite's direction of travel
+ *
+ * Only the first cube is covered, so sprites in other cubes never hit.
+ */
+byte CubeRaycast::castSprite(int spriteNum, byte range) {
+
+    CubeEngine *engine = this->engine;
+
+    if (engine->getSpriteAttribute(spriteNum, engine->AN_CUBE) != 0) {
+        return this->NO_HIT;
+    }
+
+    return this->castDirection(engine->getSpriteAttribute(spriteNum, engine->AN_X),
+                               engine->getSpriteAttribute(spriteNum, engine->AN_Y),
+                               engine->getSpriteAttribute(spriteNum, engine->AN_Z),
+                               engine->getSpriteAttribute(spriteNum, engine->AN_DIRECTION),
+                               range);
+}
+
+/*
+ * Casts a ray for each of a list of sprites
+ *
+ * 'hits' gets one result per sprite. Capture once before the batch, and
+ * every ray is tested against the same frame.
+ */
+void CubeRaycast::castSprites(const int *sprites, byte count, byte range, byte *hits) {
+    for (byte i = 0; i < count; i++) {
+        hits[i] = this->castSprite(sprites[i], range);
+    }
+}
+
+/*
+ * Splits a voxel number into its coordinates
+ */
+void CubeRaycast::getPosition(byte voxel, byte *x, byte *y, byte *z) {
+    *x = voxel / 36;
+    *y = (voxel / 6) % 6;
+    *z = voxel % 6;
+}
+
+/*
+ * Returns true if the voxel's bit is set
+ */
+bool CubeRaycast::test(byte voxel) {
+    return this->occupancy[voxel >> 3] & pgm_read_byte(&RAY_BIT_MASKS[voxel & 7]);
+}
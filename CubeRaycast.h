@@ -0,0 +1,55 @@
+/*
+* CubeRaycast.h - Line-of-sight and raycast queries for the CubeEngine library.
+*/
+#ifndef CubeRaycast_h
+#define CubeRaycast_h
+
+#include "Arduino.h"
+#include "CubeEngine.h"
+
+class CubeRaycast
+{
+    public:
+
+        // Returned when a ray reaches the wall or its range without a hit
+        static const byte NO_HIT = 0xFF;
+
+        // Raycaster constructor
+        CubeRaycast(CubeEngine &engine);
+
+        // Occupancy functions
+        // capture() marks every lit LED of the first cube as occupied. The
+        // queries only see the bitmap, so capture again after the frame
+        // changes, or mark voxels by hand.
+        void capture();
+        void clear();
+        void setOccupied(byte x, byte y, byte z, bool occupied);
+        bool isOccupied(byte x, byte y, byte z);
+
+        // Ray functions
+        // These return the voxel (x * 36 + y * 6 + z) of the first occupied
+        // voxel after the start, or NO_HIT
+        byte castDirection(byte x, byte y, byte z, byte direction, byte range);
+        byte castLine(byte x0, byte y0, byte z0, byte x1, byte y1, byte z1);
+        bool lineOfSight(byte x0, byte y0, byte z0, byte x1, byte y1, byte z1);
+
+        // Sprite functions
+        // These cast from a sprite's position along its direction of travel
+        byte castSprite(int spriteNum, byte range);
+        void castSprites(const int *sprites, byte count, byte range, byte *hits);
+
+        // Splits a voxel number into its coordinates
+        static void getPosition(byte voxel, byte *x, byte *y, byte *z);
+
+    private:
+
+        CubeEngine *engine;
+
+        // One bit per voxel, in the same order as the voxel numbers
+        byte occupancy[27];
+
+        // Occupancy test by voxel number
+        bool test(byte voxel);
+};
+
+#endif
@@ -0,0 +1,374 @@
+#include "CubeRecorder.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+/**
+ * This constructor only stores the engine and the output, begin() starts
+ * the stream
+ */
+CubeRecorder::CubeRecorder(CubeEngine &engine, Print &out) {
+    this->engine = &engine;
+    this->out    = &out;
+
+    for (byte i = 0; i < 54; i++) {
+        this->shadow[i] = 0;
+    }
+}
+
+/*
+ * Writes the header and starts from a blank frame
+ *
+ * The first frame() records every lit byte, so a replay can start from
+ * any point in a game.
+ */
+void CubeRecorder::begin() {
+    this->out->write('C');
+    this->out->write('R');
+    this->out->write(this->VERSION);
+
+    for (byte i = 0; i < 54; i++) {
+        this->shadow[i] = 0;
+    }
+}
+
+/*
+ * Seeds random() and records the seed
+ *
+ * An engine with a CubeHost takes its random numbers from the host, so
+ * seed the host's generator as well.
+ */
+void CubeRecorder::seed(unsigned long seed) {
+    randomSeed(seed);
+
+    this->out->write('S');
+    this->writeLong(seed);
+}
+
+/*
+ * Records the changed bytes of the frame
+ *
+ * A frame where nothing changed costs six bytes, for the time.
+ */
+void CubeRecorder::frame() {
+
+    byte *data = this->engine->data;
+
+    byte count = 0;
+    for (byte i = 0; i < 54; i++) {
+        if (data[i] != this->shadow[i]) {
+            count += 1;
+        }
+    }
+
+    this->out->write('F');
+    this->writeLong(this->engine->getMillis());
+    this->out->write(count);
+
+    for (byte i = 0; i < 54 && count > 0; i++) {
+        if (data[i] != this->shadow[i]) {
+            this->shadow[i] = data[i];
+            this->out->write(i);
+            this->out->write(this->shadow[i]);
+            count -= 1;
+        }
+    }
+}
+
+/*
+ * Writes a number, low byte first
+ */
+void CubeRecorder::writeLong(unsigned long value) {
+    for (byte i = 0; i < 4; i++) {
+        this->out->write((byte) (value >> (i * 8)));
+    }
+}
+
+/**
+ * This constructor checks the header and starts from a blank frame
+ */
+CubeReplay::CubeReplay(const byte *stream, unsigned long length) {
+    this->stream     = stream;
+    this->length     = length;
+    this->timer      = micros;
+    this->engineHost = NULL;
+    this->rewind();
+}
+
+/*
+ * Returns true if the stream has a header this version can read
+ */
+bool CubeReplay::isValid() {
+    return this->valid;
+}
+
+/*
+ * Reads the next record
+ *
+ * Frame records are applied to the replayed frame, so getFrame() is the
+ * frame as it was when it was recorded.
+ */
+byte CubeReplay::next() {
+
+    if (!this->valid || this->offset >= this->length) {
+        return this->RECORD_END;
+    }
+
+    byte type = this->stream[this->offset];
+    this->offset += 1;
+
+    if (type == 'S' && this->offset + 4 <= this->length) {
+        this->seedValue = this->readLong();
+        return this->RECORD_SEED;
+    }
+
+    if (type == 'F' && this->offset + 5 <= this->length) {
+        this->millisValue = this->readLong();
+
+        byte count = this->stream[this->offset];
+        this->offset += 1;
+
+        if (this->offset + (count * 2UL) > this->length) {
+            this->valid = false;
+            return this->RECORD_ERROR;
+        }
+
+        for (byte i = 0; i < count; i++) {
+            byte index = this->stream[this->offset];
+            byte value = this->stream[this->offset + 1];
+            this->offset += 2;
+
+            if (index < 54) {
+                this->frame[index] = value;
+            }
+        }
+
+        return this->RECORD_FRAME;
+    }
+
+    // Unknown or cut short
+    this->valid = false;
+    return this->RECORD_ERROR;
+}
+
+/*
+ * Returns the time of the current frame
+ */
+unsigned long CubeReplay::getMillis() {
+    return this->millisValue;
+}
+
+/*
+ * Returns the last seed read
+ */
+unsigned long CubeReplay::getSeed() {
+    return this->seedValue;
+}
+
+/*
+ * Returns the replayed frame, 54 bytes in data array order
+ */
+const byte *CubeReplay::getFrame() {
+    return this->frame;
+}
+
+/*
+ * Checks an engine's first cube against the current frame, bit for bit
+ */
+bool CubeReplay::check(CubeEngine &engine) {
+    return memcmp(engine.data, this->frame, 54) == 0;
+}
+
+/*
+ * Replays the whole stream through the engine
+ *
+ * The engine should start in the state it was in when recording began,
+ * and 'step' should use 'now' wherever the game used millis(). For the
+ * run the engine gets a host of the replay's, so whatever reads its clock
+ * sees the recorded time, and its random numbers follow the recorded
+ * seeds even if its own host has a generator of its own. The engine's
+ * host is put back afterwards.
+ */
+unsigned long CubeReplay::run(CubeEngine &engine, ReplayStep step) {
+
+    this->rewind();
+
+    if (!this->valid) {
+        this->addMismatch();
+        return this->mismatches;
+    }
+
+    this->engineHost = engine.host;
+
+    CubeHost replayHost;
+    replayHost.millis  = replayMillis;
+    replayHost.micros  = replayMicros;
+    replayHost.random  = replayRandom;
+    replayHost.output  = replayOutput;
+    replayHost.context = this;
+    engine.setHost(&replayHost);
+
+    byte type;
+    while ((type = this->next()) != this->RECORD_END) {
+
+        if (type == this->RECORD_ERROR) {
+            this->addMismatch();
+            break;
+        }
+
+        if (type == this->RECORD_SEED) {
+            randomSeed(this->seedValue);
+            continue;
+        }
+
+        unsigned long start = this->timer();
+        step(engine, this->millisValue);
+        unsigned long elapsed = this->timer() - start;
+
+        if (elapsed < this->minMicros) {
+            this->minMicros = elapsed;
+        }
+        if (elapsed > this->maxMicros) {
+            this->maxMicros = elapsed;
+        }
+        this->totalMicros += elapsed;
+
+        if (!this->check(engine)) {
+            this->addMismatch();
+        }
+
+        this->frameCount += 1;
+    }
+
+    engine.setHost(this->engineHost);
+    this->engineHost = NULL;
+
+    return this->mismatches;
+}
+
+/*
+ * Sets the clock the calls to 'step' are timed with
+ */
+void CubeReplay::setTimer(unsigned long (*timer)()) {
+    this->timer = (timer == NULL) ? micros : timer;
+}
+
+/*
+ * Returns the number of frames replayed by run()
+ */
+unsigned long CubeReplay::getFrameCount() {
+    return this->frameCount;
+}
+
+/*
+ * Returns the number of frames that didn't match, plus one if the stream
+ * was bad
+ */
+unsigned long CubeReplay::getMismatches() {
+    return this->mismatches;
+}
+
+/*
+ * Returns the number of the first frame that didn't match, or -1
+ */
+long CubeReplay::getFirstMismatch() {
+    return this->firstMismatch;
+}
+
+/*
+ * Returns the quickest call to 'step'
+ */
+unsigned long CubeReplay::getMinMicros() {
+    return (this->frameCount == 0) ? 0 : this->minMicros;
+}
+
+/*
+ * Returns the slowest call to 'step'
+ */
+unsigned long CubeReplay::getMaxMicros() {
+    return this->maxMicros;
+}
+
+/*
+ * Returns the time of every call to 'step' added together
+ */
+unsigned long CubeReplay::getTotalMicros() {
+    return this->totalMicros;
+}
+
+/*
+ * Goes back to the start of the stream and clears the results
+ */
+void CubeReplay::rewind() {
+
+    this->valid = this->length >= 3 && this->stream[0] == 'C' && this->stream[1] == 'R' &&
+                  this->stream[2] == CubeRecorder::VERSION;
+    this->offset = 3;
+
+    for (byte i = 0; i < 54; i++) {
+        this->frame[i] = 0;
+    }
+
+    this->millisValue   = 0;
+    this->seedValue     = 0;
+    this->frameCount    = 0;
+    this->mismatches    = 0;
+    this->firstMismatch = -1;
+    this->minMicros     = 0xFFFFFFFFUL;
+    this->maxMicros     = 0;
+    this->totalMicros   = 0;
+}
+
+/*
+ * Counts a frame that didn't match, or a stream that couldn't be read
+ */
+void CubeReplay::addMismatch() {
+    if (this->mismatches == 0) {
+        this->firstMismatch = this->frameCount;
+    }
+    this->mismatches += 1;
+}
+
+/*
+ * Host hooks of the engine during run()
+ *
+ * The clock is the time of the frame being replayed. Random numbers come
+ * from random(), which run() reseeds at each seed record, as the
+ * recorder's seed() did when the game was recorded. Output goes on to the
+ * engine's own host, if it has one.
+ */
+unsigned long CubeReplay::replayMillis(void *context) {
+    return ((CubeReplay *) context)->millisValue;
+}
+
+unsigned long CubeReplay::replayMicros(void *context) {
+    return ((CubeReplay *) context)->millisValue * 1000;
+}
+
+long CubeReplay::replayRandom(void *, long howBig) {
+    return random(howBig);
+}
+
+void CubeReplay::replayOutput(void *context, byte layer, byte pass, const byte *data) {
+    CubeHost *host = ((CubeReplay *) context)->engineHost;
+
+    if (host != NULL && host->output != NULL) {
+        host->output(host->context, layer, pass, data);
+    }
+}
+
+/*
+ * Reads a number, low byte first
+ */
+unsigned long CubeReplay::readLong() {
+    unsigned long value = 0;
+
+    for (byte i = 0; i < 4; i++) {
+        value |= (unsigned long) this->stream[this->offset + i] << (i * 8);
+    }
+
+    this->offset += 4;
+    return value;
+}
@@ -0,0 +1,142 @@
+/*
+* CubeRecorder.h - Frame recording and replay for the CubeEngine library.
+*
+* The recorder writes a stream of records to any Print, such as Serial or
+* an SD card file:
+*
+*   'C' 'R' version                      header
+*   'S' seed (4 bytes)                   a call to seed()
+*   'F' millis (4 bytes) count           a frame, followed by 'count'
+*       index value ...                  changed bytes of the data array
+*
+* Numbers are little-endian. The replayer reads the stream back from
+* memory, rebuilds every frame and checks an engine against them, so a
+* recorded session can be run again as a test and as a benchmark.
+* extras/replay runs a recording on a PC, against the stand-in core.
+*/
+#ifndef CubeRecorder_h
+#define CubeRecorder_h
+
+#include "Arduino.h"
+#include "CubeEngine.h"
+
+class CubeRecorder
+{
+    public:
+
+        // Stream format version
+        static const byte VERSION = 1;
+
+        // Recorder constructor
+        CubeRecorder(CubeEngine &engine, Print &out);
+
+        // Writes the header and starts from a blank frame
+        void begin();
+
+        // Seeds random() and records the seed
+        void seed(unsigned long seed);
+
+        // Records the bytes of the first cube's frame that changed since the
+        // last call, with the time. Call this once per composed frame.
+        void frame();
+
+    private:
+
+        CubeEngine *engine;
+        Print *out;
+
+        // The frame as last recorded
+        byte shadow[54];
+
+        // Stream helpers
+        void writeLong(unsigned long value);
+};
+
+class CubeReplay
+{
+    public:
+
+        // Record types returned by next()
+        static const byte RECORD_END   = 0;
+        static const byte RECORD_FRAME = 1;
+        static const byte RECORD_SEED  = 2;
+        static const byte RECORD_ERROR = 3;
+
+        // Called for each recorded frame with the frame's time
+        // It should run the game for that frame, as loop() did
+        typedef void (*ReplayStep)(CubeEngine &engine, unsigned long now);
+
+        // Replayer constructor
+        // The stream is read in place, from RAM
+        CubeReplay(const byte *stream, unsigned long length);
+
+        // Record functions
+        bool isValid();
+        byte next();
+        unsigned long getMillis();
+        unsigned long getSeed();
+        const byte *getFrame();
+
+        // Checks an engine's first cube against the current frame
+        bool check(CubeEngine &engine);
+
+        // Replays the whole stream through the engine
+        // While it runs, the engine's getMillis() is the recorded time and
+        // its random numbers come from random(), reseeded by the stream's
+        // seeds. Each frame is run with 'step' and timed, then checked.
+        // Returns the number of frames that didn't match, counting a bad
+        // header or a stream cut short as one more, so a bad recording
+        // never passes.
+        unsigned long run(CubeEngine &engine, ReplayStep step);
+
+        // Times the calls to 'step' with another clock than micros()
+        // A host build passes a real clock, as its micros() is virtual.
+        void setTimer(unsigned long (*timer)());
+
+        // Replay results
+        // Times are microseconds per call to 'step'
+        unsigned long getFrameCount();
+        unsigned long getMismatches();
+        long getFirstMismatch();
+        unsigned long getMinMicros();
+        unsigned long getMaxMicros();
+        unsigned long getTotalMicros();
+
+    private:
+
+        const byte *stream;
+        unsigned long length;
+        unsigned long offset;
+        bool valid;
+
+        // The current record
+        byte frame[54];
+        unsigned long millisValue;
+        unsigned long seedValue;
+
+        // Results
+        unsigned long frameCount;
+        unsigned long mismatches;
+        long firstMismatch;
+        unsigned long minMicros;
+        unsigned long maxMicros;
+        unsigned long totalMicros;
+
+        unsigned long (*timer)();
+
+        // The engine's own host, which keeps its output during run()
+        CubeHost *engineHost;
+
+        // Stream helpers
+        void rewind();
+        unsigned long readLong();
+        void addMismatch();
+
+        // Host hooks used by run(), 'context' is the replay
+        static unsigned long replayMillis(void *context);
+        static unsigned long replayMicros(void *context);
+        static long replayRandom(void *context, long howBig);
+        static void replayOutput(void *context, byte layer, byte pass, const byte *data);
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include "CubeScheduler.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+/**
+ * This constructor frees every task in the pool
+ */
+CubeScheduler::CubeScheduler(CubeTask *pool, byte poolSize) {
+    this->pool     = pool;
+    this->poolSize = poolSize;
+
+    for (byte i = 0; i < poolSize; i++) {
+        this->pool[i].function = NULL;
+    }
+}
+
+/*
+ * Starts a task and returns its number
+ *
+ * The task first runs on the next resume. 'value' is copied into the
+ * task's value for it to use.
+ */
+byte CubeScheduler::spawn(CubeTaskFunction function, int value) {
+
+    if (function == NULL) {
+        return this->NO_TASK;
+    }
+
+    for (byte i = 0; i < this->poolSize; i++) {
+        CubeTask &task = this->pool[i];
+
+        if (task.function == NULL) {
+            task.function = function;
+            task.line     = 0;
+            task.wake     = 0;
+            task.wait     = CubeTask::WAIT_TICK;
+            task.event    = 0;
+            task.value    = value;
+            return i;
+        }
+    }
+
+    return this->NO_TASK;
+}
+
+/*
+ * Stops a task and frees its slot
+ */
+void CubeScheduler::kill(byte task) {
+    if (task < this->poolSize) {
+        this->pool[task].function = NULL;
+    }
+}
+
+/*
+ * Returns true if the task hasn't ended
+ */
+bool CubeScheduler::isRunning(byte task) {
+    return task < this->poolSize && this->pool[task].function != NULL;
+}
+
+/*
+ * Returns the number of tasks that haven't ended
+ */
+byte CubeScheduler::getTaskCount() {
+    byte count = 0;
+
+    for (byte i = 0; i < this->poolSize; i++) {
+        if (this->pool[i].function != NULL) {
+            count += 1;
+        }
+    }
+
+    return count;
+}
+
+/*
+ * Wakes every task waiting for the event
+ *
+ * The tasks carry on at the next resume, not inside this call, so it's
+ * safe to signal from a task or a callback.
+ */
+void CubeScheduler::signal(byte event) {
+    for (byte i = 0; i < this->poolSize; i++) {
+        CubeTask &task = this->pool[i];
+
+        if (task.function != NULL && task.wait == CubeTask::WAIT_EVENT && task.event == event) {
+            task.wait = CubeTask::WAIT_TICK;
+        }
+    }
+}
+
+/*
+ * Resumes every task that's ready
+ *
+ * A task runs until its next wait, so each resume costs one call and a
+ * jump to where the task left off.
+ */
+void CubeScheduler::resume(unsigned long now) {
+
+    for (byte i = 0; i < this->poolSize; i++) {
+        CubeTask &task = this->pool[i];
+
+        if (task.function == NULL || task.wait == CubeTask::WAIT_EVENT) {
+            continue;
+        }
+
+        // Compare as a difference so the clock can wrap
+        if (task.wait == CubeTask::WAIT_TIME && (long) (now - task.wake) < 0) {
+            continue;
+        }
+
+        task.wait = CubeTask::WAIT_TICK;
+        task.function(task);
+
+        // A delay becomes a wake time, counted from this resume
+        if (task.wait == CubeTask::WAIT_DELAY) {
+            task.wake += now;
+            task.wait  = CubeTask::WAIT_TIME;
+        } else if (task.wait == CubeTask::WAIT_DONE) {
+            task.function = NULL;
+        }
+    }
+}
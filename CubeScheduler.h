@@ -0,0 +1,102 @@
+/*
+* CubeScheduler.h - Cooperative game script tasks for the CubeEngine library.
+*
+* A task is a function that picks up where it left off each time it's
+* resumed, e.g.
+*
+*   void blinkThenSpawn(CubeTask &task) {
+*       TASK_BEGIN(task);
+*       for (task.value = 0; task.value < 3; task.value++) {
+*           cube.setSpriteAttribute(1, cube.AN_VISIBILITY, cube.AV_VISIBLE);
+*           TASK_WAIT_MS(task, 200);
+*           cube.setSpriteAttribute(1, cube.AN_VISIBILITY, cube.AV_INVISIBLE);
+*           TASK_WAIT_MS(task, 200);
+*       }
+*       TASK_WAIT_EVENT(task, EVENT_READY);
+*       spawnWave();
+*       TASK_END(task);
+*   }
+*
+* Tasks are stackless, so local variables don't survive a wait. Keep state
+* in task.value or in globals. Waits can't be used inside a switch
+* statement of the task's own.
+*/
+#ifndef CubeScheduler_h
+#define CubeScheduler_h
+
+#include "Arduino.h"
+
+struct CubeTask;
+
+// A task's body
+typedef void (*CubeTaskFunction)(CubeTask &task);
+
+struct CubeTask
+{
+    // What the task is waiting for
+    static const byte WAIT_TICK  = 0; // the next resume
+    static const byte WAIT_DELAY = 1; // 'wake' milliseconds, set by TASK_WAIT_MS
+    static const byte WAIT_TIME  = 2; // the time in 'wake'
+    static const byte WAIT_EVENT = 3; // a signal() of 'event'
+    static const byte WAIT_DONE  = 4; // nothing, the task has ended
+
+    CubeTaskFunction function; // NULL when the slot is free
+    unsigned int line;         // where to resume, 0 to start
+    unsigned long wake;
+    byte wait;
+    byte event;
+
+    // Free for the task to use, e.g. as a loop counter
+    // This is set by spawn()
+    int value;
+};
+
+// Task body macros
+// The resume point is the source line of the wait, as in protothreads.
+#define TASK_BEGIN(task) switch ((task).line) { case 0:
+
+#define TASK_YIELD(task) \
+    do { (task).line = __LINE__; (task).wait = CubeTask::WAIT_TICK; return; case __LINE__:; } while (0)
+
+#define TASK_WAIT_MS(task, ms) \
+    do { (task).line = __LINE__; (task).wait = CubeTask::WAIT_DELAY; (task).wake = (ms); return; case __LINE__:; } while (0)
+
+#define TASK_WAIT_EVENT(task, id) \
+    do { (task).line = __LINE__; (task).wait = CubeTask::WAIT_EVENT; (task).event = (id); return; case __LINE__:; } while (0)
+
+#define TASK_EXIT(task) \
+    do { (task).wait = CubeTask::WAIT_DONE; return; } while (0)
+
+#define TASK_END(task) } (task).wait = CubeTask::WAIT_DONE
+
+class CubeScheduler
+{
+    public:
+
+        // Returned by spawn when the pool is full
+        static const byte NO_TASK = 0xFF;
+
+        // Scheduler constructor
+        // The pool is the sketch's array of tasks, e.g. CubeTask tasks[8];
+        CubeScheduler(CubeTask *pool, byte poolSize);
+
+        // Task functions
+        byte spawn(CubeTaskFunction function, int value);
+        void kill(byte task);
+        bool isRunning(byte task);
+        byte getTaskCount();
+
+        // Wakes every task waiting for the event
+        void signal(byte event);
+
+        // Resumes the tasks that are ready, 'now' is in milliseconds
+        // CubeLoop calls this on each tick with its game time
+        void resume(unsigned long now);
+
+    private:
+
+        CubeTask *pool;
+        byte poolSize;
+};
+
+#endif
@@ -0,0 +1,398 @@
+#include "CubeSnapshot.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+#if defined(__AVR__)
+  #include <avr/eeprom.h>
+#else
+  #include <EEPROM.h>
+#endif
+
+/*
+ * EEPROM access by address
+ *
+ * On AVR these go straight to avr-libc, which can tell when a write is
+ * still under way. Other cores go through the EEPROM library, where a
+ * write has finished by the time it returns. Cores that keep the EEPROM
+ * in flash need EEPROM.begin() and EEPROM.commit() from the sketch.
+ */
+static byte readSnapshotByte(int address) {
+#if defined(__AVR__)
+    return eeprom_read_byte((const uint8_t *) address);
+#else
+    return EEPROM.read(address);
+#endif
+}
+
+static void writeSnapshotByte(int address, byte value) {
+#if defined(__AVR__)
+    eeprom_write_byte((uint8_t *) address, value);
+#else
+    EEPROM.write(address, value);
+#endif
+}
+
+// Skips the write if the byte already holds the value
+static void updateSnapshotByte(int address, byte value) {
+#if defined(__AVR__)
+    eeprom_update_byte((uint8_t *) address, value);
+#else
+    if (EEPROM.read(address) != value) {
+        EEPROM.write(address, value);
+    }
+#endif
+}
+
+static bool isSnapshotReady() {
+#if defined(__AVR__)
+    return eeprom_is_ready();
+#else
+    return true;
+#endif
+}
+
+/**
+ * This constructor only stores where the slots are, nothing is read until
+ * a save or restore
+ */
+CubeSnapshot::CubeSnapshot(CubeEngine &engine, int address, byte slots) {
+    this->engine      = &engine;
+    this->address     = address;
+    this->slots       = (slots == 0) ? 1 : slots;
+    this->buffer      = NULL;
+    this->position    = -1;
+    this->slotAddress = address;
+}
+
+/*
+ * Saves the game to the next slot
+ *
+ * updateSnapshotByte() skips bytes that already hold the right value, so
+ * a slot last written a few saves ago only costs the bytes that changed.
+ */
+void CubeSnapshot::save() {
+
+    // A background save would be writing the same slot
+    if (this->isSaving()) {
+        this->position = -1;
+    }
+
+    unsigned long now = this->engine->getMillis();
+    unsigned int checksum;
+    this->prepareSave(&checksum);
+
+    int image = this->slotAddress + this->HEADER_SIZE;
+
+    for (int i = 0; i < this->IMAGE_SIZE; i++) {
+        byte value = this->getImageByte(i, now);
+        checksum = addChecksum(checksum, value);
+        updateSnapshotByte(image + i, value);
+    }
+
+    // The header goes last, so a save cut short fails its checksum and the
+    // slot before it is used instead
+    this->finishHeader(checksum);
+
+    for (byte i = 0; i < this->HEADER_SIZE; i++) {
+        updateSnapshotByte(this->slotAddress + i, this->header[i]);
+    }
+}
+
+/*
+ * Starts a save in the background
+ *
+ * Returns false if one is already under way.
+ */
+bool CubeSnapshot::beginSave(byte *buffer) {
+
+    if (this->isSaving() || buffer == NULL) {
+        return false;
+    }
+
+    unsigned long now = this->engine->getMillis();
+    unsigned int checksum;
+    this->prepareSave(&checksum);
+
+    for (int i = 0; i < this->IMAGE_SIZE; i++) {
+        buffer[i] = this->getImageByte(i, now);
+        checksum = addChecksum(checksum, buffer[i]);
+    }
+
+    this->finishHeader(checksum);
+
+    this->buffer   = buffer;
+    this->position = 0;
+
+    return true;
+}
+
+/*
+ * Carries on with a background save
+ *
+ * Bytes that already hold the right value are passed over in the same
+ * call, and the first one that differs starts a write. The EEPROM does
+ * the rest on its own, so nothing here waits.
+ */
+bool CubeSnapshot::step() {
+
+    if (this->position < 0) {
+        return false;
+    }
+
+    int total = this->IMAGE_SIZE + this->HEADER_SIZE;
+
+    while (this->position < total) {
+
+        if (!isSnapshotReady()) {
+            return true;
+        }
+
+        int target;
+        byte value;
+
+        // The image first and the header last, as in save()
+        if (this->position < this->IMAGE_SIZE) {
+            target = this->slotAddress + this->HEADER_SIZE + this->position;
+            value  = this->buffer[this->position];
+        } else {
+            target = this->slotAddress + (this->position - this->IMAGE_SIZE);
+            value  = this->header[this->position - this->IMAGE_SIZE];
+        }
+
+        this->position += 1;
+
+        if (readSnapshotByte(target) != value) {
+            writeSnapshotByte(target, value);
+            return true;
+        }
+    }
+
+    this->position = -1;
+    this->buffer   = NULL;
+
+    return false;
+}
+
+/*
+ * Returns true while a background save is under way
+ */
+bool CubeSnapshot::isSaving() {
+    return this->position >= 0;
+}
+
+/*
+ * Loads the newest good snapshot
+ *
+ * The timers are put back by age, so sprites carry on moving as if the
+ * power had never gone, whatever millis() is now.
+ */
+bool CubeSnapshot::restore() {
+
+    byte slot;
+    unsigned int sequence;
+
+    if (!this->findNewest(&slot, &sequence)) {
+        return false;
+    }
+
+    CubeEngine *engine = this->engine;
+    unsigned long now  = engine->getMillis();
+    int image = this->address + (slot * this->SLOT_SIZE) + this->HEADER_SIZE;
+
+    for (int s = 0; s < CUBE_SPRITE_COUNT; s++) {
+        unsigned long value = 0;
+
+        for (byte b = 0; b < 4; b++) {
+            value |= (unsigned long) readSnapshotByte(image) << (b * 8);
+            image += 1;
+        }
+
+        engine->sprites[s] = value;
+    }
+
+    for (byte i = 0; i < 54; i++) {
+        engine->writeData(engine->data, i, readSnapshotByte(image));
+        image += 1;
+    }
+
+    for (byte t = 0; t < 7; t++) {
+        unsigned int age = readSnapshotByte(image) |
+                           (readSnapshotByte(image + 1) << 8);
+        image += 2;
+
+        *engine->getMoveTimer(t) = now - age;
+    }
+
+    return true;
+}
+
+/*
+ * Returns true if any slot holds a good snapshot
+ */
+bool CubeSnapshot::hasSnapshot() {
+    byte slot;
+    unsigned int sequence;
+
+    return this->findNewest(&slot, &sequence);
+}
+
+/*
+ * Spoils every slot
+ *
+ * Only the marker bytes are written.
+ */
+void CubeSnapshot::erase() {
+
+    this->position = -1;
+
+    for (byte slot = 0; slot < this->slots; slot++) {
+        updateSnapshotByte(this->address + (slot * this->SLOT_SIZE), 0xFF);
+    }
+}
+
+/*
+ * Returns one byte of the snapshot image
+ *
+ * The image is the sprites, low byte first, then the data array, then
+ * the age of each automove timer in milliseconds (at most 65535).
+ */
+byte CubeSnapshot::getImageByte(int index, unsigned long now) {
+
+    CubeEngine *engine = this->engine;
+
+    if (index < CUBE_SPRITE_COUNT * 4) {
+        return (byte) (engine->sprites[index >> 2] >> ((index & 3) * 8));
+    }
+    index -= CUBE_SPRITE_COUNT * 4;
+
+    if (index < 54) {
+        return engine->data[index];
+    }
+    index -= 54;
+
+    unsigned long age = now - *engine->getMoveTimer(index >> 1);
+    if (age > 0xFFFF) {
+        age = 0xFFFF;
+    }
+
+    return (index & 1) ? (byte) (age >> 8) : (byte) age;
+}
+
+/*
+ * Finds the good slot with the highest sequence number
+ *
+ * Sequence numbers wrap, so one is newer if it is less than half the
+ * range ahead. The slot and sequence are only written if a good slot is
+ * found, so the caller needn't set them first.
+ */
+bool CubeSnapshot::findNewest(byte *slot, unsigned int *sequence) {
+
+    bool found = false;
+
+    for (byte i = 0; i < this->slots; i++) {
+        unsigned int candidate;
+
+        if (!this->checkSlot(i, &candidate)) {
+            continue;
+        }
+
+        // Only compare once *sequence holds a slot's number
+        if (found) {
+            unsigned int ahead = (candidate - *sequence) & 0xFFFF;
+            if (ahead == 0 || ahead >= 0x8000) {
+                continue;
+            }
+        }
+
+        *slot     = i;
+        *sequence = candidate;
+        found     = true;
+    }
+
+    return found;
+}
+
+/*
+ * Checks a slot's marker and checksum
+ */
+bool CubeSnapshot::checkSlot(byte slot, unsigned int *sequence) {
+
+    int base = this->address + (slot * this->SLOT_SIZE);
+
+    if (readSnapshotByte(base) != this->MARKER) {
+        return false;
+    }
+
+    *sequence = readSnapshotByte(base + 1) |
+                (readSnapshotByte(base + 2) << 8);
+
+    unsigned int checksum = startChecksum(*sequence);
+    for (int i = 0; i < this->IMAGE_SIZE; i++) {
+        checksum = addChecksum(checksum, readSnapshotByte(base + this->HEADER_SIZE + i));
+    }
+
+    unsigned int stored = readSnapshotByte(base + 3) |
+                          (readSnapshotByte(base + 4) << 8);
+
+    return checksum == stored;
+}
+
+/*
+ * Picks the slot after the newest one and starts the header and checksum
+ */
+void CubeSnapshot::prepareSave(unsigned int *checksum) {
+
+    byte slot = this->slots - 1;
+    unsigned int sequence = 0;
+    this->findNewest(&slot, &sequence);
+
+    slot     = (slot + 1) % this->slots;
+    sequence = (sequence + 1) & 0xFFFF;
+
+    this->slotAddress = this->address + (slot * this->SLOT_SIZE);
+
+    this->header[0] = this->MARKER;
+    this->header[1] = (byte) sequence;
+    this->header[2] = (byte) (sequence >> 8);
+
+    *checksum = startChecksum(sequence);
+}
+
+/*
+ * Puts the finished checksum in the header
+ */
+void CubeSnapshot::finishHeader(unsigned int checksum) {
+    this->header[3] = (byte) checksum;
+    this->header[4] = (byte) (checksum >> 8);
+}
+
+/*
+ * Starts a checksum with the image size and the sequence number
+ *
+ * Including the size means a snapshot from a build with a different
+ * CUBE_SPRITE_COUNT is never loaded.
+ */
+unsigned int CubeSnapshot::startChecksum(unsigned int sequence) {
+    unsigned int checksum = 0;
+
+    checksum = addChecksum(checksum, (byte) IMAGE_SIZE);
+    checksum = addChecksum(checksum, (byte) (IMAGE_SIZE >> 8));
+    checksum = addChecksum(checksum, (byte) sequence);
+    checksum = addChecksum(checksum, (byte) (sequence >> 8));
+
+    return checksum;
+}
+
+/*
+ * Adds a byte to a Fletcher-16 checksum
+ *
+ * Unlike a plain sum this catches bytes that are swapped or moved.
+ */
+unsigned int CubeSnapshot::addChecksum(unsigned int checksum, byte value) {
+    unsigned int low  = ((checksum & 0xFF) + value) % 255;
+    unsigned int high = ((checksum >> 8) + low) % 255;
+
+    return (high << 8) | low;
+}
@@ -0,0 +1,75 @@
+/*
+* CubeSnapshot.h - EEPROM snapshots of a CubeEngine game.
+*/
+#ifndef CubeSnapshot_h
+#define CubeSnapshot_h
+
+#include "Arduino.h"
+#include "CubeEngine.h"
+
+class CubeSnapshot
+{
+    public:
+
+        // Marks a slot that has been written
+        static const byte MARKER = 0xC5;
+
+        // A snapshot is the sprites, the first cube's frame and the age of
+        // each automove timer. Each slot holds one, after a 5 byte header
+        // of a marker, a sequence number and a checksum.
+        static const int IMAGE_SIZE  = (CUBE_SPRITE_COUNT * 4) + 54 + 14;
+        static const int HEADER_SIZE = 5;
+        static const int SLOT_SIZE   = HEADER_SIZE + IMAGE_SIZE;
+
+        // Snapshot constructor
+        // The slots are SLOT_SIZE bytes each, from 'address' up. Saves go to
+        // each slot in turn to spread the wear.
+        CubeSnapshot(CubeEngine &engine, int address, byte slots);
+
+        // Saves the game now
+        // This waits for each EEPROM write, a few milliseconds a byte, but
+        // the refresh interrupt keeps running.
+        void save();
+
+        // Saves the game a byte at a time
+        // The state is copied to 'buffer' (IMAGE_SIZE bytes) straight away,
+        // then each call to step() starts at most one EEPROM write and never
+        // waits, so it can be called every loop(). step() returns true
+        // while the save is still going.
+        bool beginSave(byte *buffer);
+        bool step();
+        bool isSaving();
+
+        // Loads the newest good snapshot into the engine
+        // Returns false, leaving the engine alone, if no slot checks out.
+        bool restore();
+        bool hasSnapshot();
+
+        // Spoils every slot so the next restore() fails
+        void erase();
+
+    private:
+
+        CubeEngine *engine;
+        int address;
+        byte slots;
+
+        // The save under way
+        byte *buffer;
+        int position;
+        int slotAddress;
+        byte header[HEADER_SIZE];
+
+        // Snapshot functions
+        byte getImageByte(int index, unsigned long now);
+        bool findNewest(byte *slot, unsigned int *sequence);
+        bool checkSlot(byte slot, unsigned int *sequence);
+        void prepareSave(unsigned int *checksum);
+        void finishHeader(unsigned int checksum);
+
+        // Checksum functions
+        static unsigned int startChecksum(unsigned int sequence);
+        static unsigned int addChecksum(unsigned int checksum, byte value);
+};
+
+#endif
@@ -0,0 +1,289 @@
+#include "CubeText.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+/*
+ * 5x5 font
+ *
+ * Each glyph is 5 columns, left to right. Bit y of a column lights the LED
+ * at height y, so rows 1-5 hold the glyph and the bottom row stays blank.
+ * The glyphs are space, 0-9, A-Z, then ! - . : and ?
+ */
+static const byte TEXT_FONT[42][5] PROGMEM = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, // space
+    {0x1C, 0x26, 0x2A, 0x32, 0x1C}, // 0
+    {0x00, 0x12, 0x3E, 0x02, 0x00}, // 1
+    {0x12, 0x26, 0x2A, 0x2A, 0x12}, // 2
+    {0x22, 0x2A, 0x2A, 0x2A, 0x14}, // 3
+    {0x38, 0x08, 0x08, 0x3E, 0x08}, // 4
+    {0x3A, 0x2A, 0x2A, 0x2A, 0x24}, // 5
+    {0x1C, 0x2A, 0x2A, 0x2A, 0x04}, // 6
+    {0x20, 0x26, 0x28, 0x30, 0x20}, // 7
+    {0x14, 0x2A, 0x2A, 0x2A, 0x14}, // 8
+    {0x10, 0x2A, 0x2A, 0x2A, 0x1C}, // 9
+    {0x1E, 0x28, 0x28, 0x28, 0x1E}, // A
+    {0x3E, 0x2A, 0x2A, 0x2A, 0x14}, // B
+    {0x1C, 0x22, 0x22, 0x22, 0x22}, // C
+    {0x3E, 0x22, 0x22, 0x22, 0x1C}, // D
+    {0x3E, 0x2A, 0x2A, 0x2A, 0x22}, // E
+    {0x3E, 0x28, 0x28, 0x28, 0x20}, // F
+    {0x1C, 0x22, 0x22, 0x2A, 0x2C}, // G
+    {0x3E, 0x08, 0x08, 0x08, 0x3E}, // H
+    {0x00, 0x22, 0x3E, 0x22, 0x00}, // I
+    {0x04, 0x02, 0x22, 0x3C, 0x20}, // J
+    {0x3E, 0x08, 0x08, 0x14, 0x22}, // K
+    {0x3E, 0x02, 0x02, 0x02, 0x02}, // L
+    {0x3E, 0x10, 0x08, 0x10, 0x3E}, // M
+    {0x3E, 0x10, 0x08, 0x04, 0x3E}, // N
+    {0x1C, 0x22, 0x22, 0x22, 0x1C}, // O
+    {0x3E, 0x28, 0x28, 0x28, 0x10}, // P
+    {0x1C, 0x22, 0x2A, 0x24, 0x1A}, // Q
+    {0x3E, 0x28, 0x28, 0x2C, 0x12}, // R
+    {0x12, 0x2A, 0x2A, 0x2A, 0x24}, // S
+    {0x20, 0x20, 0x3E, 0x20, 0x20}, // T
+    {0x3C, 0x02, 0x02, 0x02, 0x3C}, // U
+    {0x38, 0x04, 0x02, 0x04, 0x38}, // V
+    {0x3E, 0x04, 0x08, 0x04, 0x3E}, // W
+    {0x22, 0x14, 0x08, 0x14, 0x22}, // X
+    {0x20, 0x10, 0x0E, 0x10, 0x20}, // Y
+    {0x22, 0x26, 0x2A, 0x32, 0x22}, // Z
+    {0x00, 0x00, 0x3A, 0x00, 0x00}, // !
+    {0x08, 0x08, 0x08, 0x08, 0x08}, // -
+    {0x00, 0x00, 0x02, 0x00, 0x00}, // .
+    {0x00, 0x00, 0x14, 0x00, 0x00}, // :
+    {0x10, 0x20, 0x2A, 0x28, 0x10}  // ?
+};
+
+// First LED (at y = 0) of each column around the vertical faces
+// Front left to right, then right, back and left, as in the FACE_ order.
+static const byte TEXT_PERIMETER[20] PROGMEM = {
+      0,  36,  72, 108, 144, 180, // front,  z = 0
+    181, 182, 183, 184, 185,      // right,  x = 5
+    149, 113,  77,  41,   5,      // back,   z = 5
+      4,   3,   2,   1            // left,   x = 0
+};
+
+// Marks a perimeter column as unknown, so the next step() redraws it
+static const byte TEXT_UNKNOWN = 0xFF;
+
+/*
+ * Returns the font entry of a character
+ */
+static byte textGlyphIndex(char c) {
+
+    if (c >= 'a' && c <= 'z') {
+        c = c - 'a' + 'A';
+    }
+
+    if (c == ' ') {
+        return 0;
+    } else if (c >= '0' && c <= '9') {
+        return 1 + (c - '0');
+    } else if (c >= 'A' && c <= 'Z') {
+        return 11 + (c - 'A');
+    } else if (c == '!') {
+        return 37;
+    } else if (c == '-') {
+        return 38;
+    } else if (c == '.') {
+        return 39;
+    } else if (c == ':') {
+        return 40;
+    }
+
+    return 41; // ?
+}
+
+/**
+ * This constructor starts without a message, drawing in red
+ */
+CubeText::CubeText(CubeEngine &engine) {
+    this->engine   = &engine;
+    this->message  = NULL;
+    this->inFlash  = false;
+    this->length   = 0;
+    this->position = 0;
+
+    this->setColour(engine.AV_RED);
+}
+
+/*
+ * Draws a glyph upright on one of the vertical faces
+ */
+void CubeText::drawGlyph(char c, byte face, int column, byte colour) {
+
+    byte code = colour >> 6;
+
+    for (byte j = 0; j < this->GLYPH_WIDTH; j++) {
+        int i = column + j;
+
+        if (i < 0 || i > 5) {
+            continue;
+        }
+
+        // First LED of the face column
+        byte first;
+        if (face == this->FACE_FRONT) {
+            first = i * 36;
+        } else if (face == this->FACE_RIGHT) {
+            first = 180 + i;
+        } else if (face == this->FACE_BACK) {
+            first = ((5 - i) * 36) + 5;
+        } else {
+            first = 5 - i;
+        }
+
+        this->writeLEDs(first, 6, this->getGlyphColumn(c, j), code);
+    }
+}
+
+/*
+ * Draws a glyph lying flat on a layer, read from above
+ *
+ * Columns run along x and the top of the glyph is at the back (z = 5).
+ */
+void CubeText::drawLayerGlyph(char c, byte y, int column, byte colour) {
+
+    if (y > 5) {
+        return;
+    }
+
+    byte code = colour >> 6;
+
+    for (byte j = 0; j < this->GLYPH_WIDTH; j++) {
+        int x = column + j;
+
+        if (x < 0 || x > 5) {
+            continue;
+        }
+
+        this->writeLEDs((x * 36) + (y * 6), 1, this->getGlyphColumn(c, j), code);
+    }
+}
+
+/*
+ * Sets the message to scroll and starts it from the beginning
+ *
+ * The message isn't copied, so it must stay in place while it scrolls.
+ * With 'inFlash' it's read from PROGMEM, e.g. setMessage(PSTR("HI"), true).
+ */
+void CubeText::setMessage(const char *message, bool inFlash) {
+    this->message  = message;
+    this->inFlash  = inFlash;
+    this->position = 0;
+
+    if (message == NULL) {
+        this->length = 0;
+    } else {
+        this->length = inFlash ? strlen_P(message) : strlen(message);
+    }
+}
+
+/*
+ * Sets the colour of the scrolling message
+ */
+void CubeText::setColour(byte colour) {
+    this->code = colour >> 6;
+
+    // Every lit column needs redrawing in the new colour
+    for (byte p = 0; p < 20; p++) {
+        this->shown[p] = TEXT_UNKNOWN;
+    }
+}
+
+/*
+ * Scrolls the message one column
+ *
+ * The message travels round the faces against the reading order, so it
+ * reads left to right on each face. Only the columns whose bits differ
+ * from what's already shown are written.
+ */
+void CubeText::step() {
+
+    if (this->message == NULL) {
+        return;
+    }
+
+    int columns = this->length * this->GLYPH_PITCH;
+
+    for (byte p = 0; p < 20; p++) {
+
+        // The first column of the message starts at the last position
+        int t = this->position + p - 19;
+
+        byte bits = 0;
+        if (t >= 0 && t < columns) {
+            bits = this->getGlyphColumn(this->getMessageChar(t / this->GLYPH_PITCH), t % this->GLYPH_PITCH);
+        }
+
+        if (bits != this->shown[p]) {
+            this->writeLEDs(pgm_read_byte(&TEXT_PERIMETER[p]), 6, bits, this->code);
+            this->shown[p] = bits;
+        }
+    }
+
+    // Start again once the message has gone all the way round
+    this->position += 1;
+    if (this->position >= columns + 20) {
+        this->position = 0;
+    }
+}
+
+/*
+ * Takes the scrolling message off the faces and rewinds it
+ */
+void CubeText::clear() {
+    for (byte p = 0; p < 20; p++) {
+        if (this->shown[p] != 0) {
+            this->writeLEDs(pgm_read_byte(&TEXT_PERIMETER[p]), 6, 0, this->code);
+            this->shown[p] = 0;
+        }
+    }
+
+    this->position = 0;
+}
+
+/*
+ * Returns one column of a glyph, or a blank column past its width
+ */
+byte CubeText::getGlyphColumn(char c, byte column) {
+    if (column >= this->GLYPH_WIDTH) {
+        return 0;
+    }
+
+    return pgm_read_byte(&TEXT_FONT[textGlyphIndex(c)][column]);
+}
+
+/*
+ * Returns a character of the scrolling message
+ */
+char CubeText::getMessageChar(int index) {
+    if (this->inFlash) {
+        return pgm_read_byte(this->message + index);
+    }
+
+    return this->message[index];
+}
+
+/*
+ * Writes six LEDs from a column of bits
+ *
+ * LED k is 'first' + k * 'stride' and is lit if bit k is set. Each write
+ * only touches the two bits of its LED.
+ */
+void CubeText::writeLEDs(byte first, byte stride, byte bits, byte code) {
+
+    byte *data = this->engine->data;
+    byte led   = first;
+
+    for (byte k = 0; k < 6; k++) {
+        byte shift = (led & B00000011) << 1;
+        byte value = ((bits >> k) & 1) ? code : 0;
+
+        this->engine->writeData(data, led >> 2, (data[led >> 2] & ~(B00000011 << shift)) | (value << shift));
+        led += stride;
+    }
+}
@@ -0,0 +1,64 @@
+/*
+* CubeText.h - Glyphs and scrolling text for the CubeEngine library.
+*/
+#ifndef CubeText_h
+#define CubeText_h
+
+#include "Arduino.h"
+#include "CubeEngine.h"
+
+class CubeText
+{
+    public:
+
+        // The vertical faces, in reading order around the cube
+        // Text stands upright along y, the AV_UP axis.
+        static const byte FACE_FRONT = 0; // z = 0, left to right along x
+        static const byte FACE_RIGHT = 1; // x = 5, front to back along z
+        static const byte FACE_BACK  = 2; // z = 5, right to left along x
+        static const byte FACE_LEFT  = 3; // x = 0, back to front along z
+
+        // Glyphs are 5 columns of 5 rows, plus a blank column between them
+        static const byte GLYPH_WIDTH = 5;
+        static const byte GLYPH_PITCH = 6;
+
+        // Text renderer constructor
+        CubeText(CubeEngine &engine);
+
+        // Glyph functions
+        // 'column' is where the glyph's first column goes, and may be off the
+        // face so a glyph can be partly shown. Glyphs replace everything in
+        // the columns they cover. Characters without a glyph show as '?'.
+        void drawGlyph(char c, byte face, int column, byte colour);
+        void drawLayerGlyph(char c, byte y, int column, byte colour);
+
+        // Scroller functions
+        // The message comes in at the end of the left face and travels round
+        // all four faces, one column per call to step().
+        void setMessage(const char *message, bool inFlash);
+        void setColour(byte colour);
+        void step();
+        void clear();
+
+    private:
+
+        CubeEngine *engine;
+
+        // Scrolling message
+        const char *message;
+        bool inFlash;
+        int length;
+        int position;
+        byte code;
+
+        // The column bits last drawn at each of the 20 positions around the
+        // faces, so step() only writes the columns that change
+        byte shown[20];
+
+        // Drawing functions
+        byte getGlyphColumn(char c, byte column);
+        char getMessageChar(int index);
+        void writeLEDs(byte first, byte stride, byte bits, byte code);
+};
+
+#endif
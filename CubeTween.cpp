@@ -0,0 +1,247 @@
+#include "CubeTween.h"
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+/*
+ * Easing curves
+ *
+ * Each curve is sampled at 33 evenly spaced points from start (0) to end
+ * (255). Values in between are interpolated, so a tween costs two table
+ * reads and two small multiplies per tick.
+ */
+static const byte EASING_CURVES[5][33] PROGMEM = {
+    // linear
+    {  0,   8,  16,  24,  32,  40,  48,  56,  64,  72,  80,  88,  96, 104, 112, 120, 128,
+     135, 143, 151, 159, 167, 175, 183, 191, 199, 207, 215, 223, 231, 239, 247, 255},
+    // in, t^2
+    {  0,   0,   1,   2,   4,   6,   9,  12,  16,  20,  25,  30,  36,  42,  49,  56,  64,
+      72,  81,  90, 100, 110, 121, 132, 143, 156, 168, 182, 195, 209, 224, 239, 255},
+    // out, 1 - (1 - t)^2
+    {  0,  16,  31,  46,  60,  73,  87,  99, 112, 123, 134, 145, 155, 165, 174, 183, 191,
+     199, 206, 213, 219, 225, 230, 235, 239, 243, 246, 249, 251, 253, 254, 255, 255},
+    // in out, smoothstep
+    {  0,   1,   3,   6,  11,  17,  24,  31,  40,  49,  59,  70,  81,  92, 104, 116, 128,
+     139, 151, 163, 174, 185, 196, 206, 215, 224, 231, 238, 244, 249, 252, 254, 255},
+    // bounce
+    {  0,   2,   8,  17,  30,  47,  68,  92, 121, 153, 188, 228, 247, 229, 214, 203, 195,
+     192, 192, 196, 203, 215, 230, 249, 248, 242, 239, 240, 245, 254, 252, 251, 255}
+};
+
+/**
+ * This constructor frees every tween in the pool
+ */
+CubeTweens::CubeTweens(CubeEngine &engine, CubeTween *pool, byte poolSize) {
+    this->engine   = &engine;
+    this->pool     = pool;
+    this->poolSize = poolSize;
+
+    for (byte i = 0; i < poolSize; i++) {
+        this->pool[i].target = this->TARGET_NONE;
+    }
+}
+
+/*
+ * Moves a sprite along one axis from where it is now
+ *
+ * Any tween already moving the sprite on that axis is replaced. Returns
+ * the tween's number, or NO_TWEEN if the pool is full.
+ */
+byte CubeTweens::tweenSprite(int spriteNum, byte target, byte to, unsigned int ticks, byte easing) {
+
+    byte name;
+    if (target == this->TARGET_X) {
+        name = this->engine->AN_X;
+    } else if (target == this->TARGET_Y) {
+        name = this->engine->AN_Y;
+    } else if (target == this->TARGET_Z) {
+        name = this->engine->AN_Z;
+    } else {
+        return this->NO_TWEEN;
+    }
+
+    for (byte i = 0; i < this->poolSize; i++) {
+        if (this->pool[i].target == target && this->pool[i].sprite == spriteNum) {
+            this->pool[i].target = this->TARGET_NONE;
+        }
+    }
+
+    byte from = this->engine->getSpriteAttribute(spriteNum, name);
+    return this->start(target, spriteNum, NULL, from, to, ticks, easing);
+}
+
+/*
+ * Moves one of the sketch's bytes from its current value
+ *
+ * Any tween already driving the byte is replaced.
+ */
+byte CubeTweens::tweenValue(byte *value, byte to, unsigned int ticks, byte easing) {
+
+    if (value == NULL) {
+        return this->NO_TWEEN;
+    }
+
+    for (byte i = 0; i < this->poolSize; i++) {
+        if (this->pool[i].target == this->TARGET_VALUE && this->pool[i].value == value) {
+            this->pool[i].target = this->TARGET_NONE;
+        }
+    }
+
+    return this->start(this->TARGET_VALUE, 0, value, *value, to, ticks, easing);
+}
+
+/*
+ * Stops a tween
+ */
+void CubeTweens::stop(byte tween) {
+    if (tween < this->poolSize) {
+        this->pool[tween].target = this->TARGET_NONE;
+    }
+}
+
+/*
+ * Stops every tween moving a sprite
+ */
+void CubeTweens::stopSprite(int spriteNum) {
+    for (byte i = 0; i < this->poolSize; i++) {
+        CubeTween &tween = this->pool[i];
+
+        if (tween.target != this->TARGET_NONE && tween.target != this->TARGET_VALUE &&
+            tween.sprite == spriteNum) {
+            tween.target = this->TARGET_NONE;
+        }
+    }
+}
+
+/*
+ * Returns true if the tween hasn't finished
+ */
+bool CubeTweens::isActive(byte tween) {
+    return tween < this->poolSize && this->pool[tween].target != this->TARGET_NONE;
+}
+
+/*
+ * Advances every tween by one tick
+ *
+ * Targets are only written when their value changes, so a slow sprite
+ * tween doesn't repaint the sprite on every tick.
+ */
+void CubeTweens::step() {
+
+    for (byte i = 0; i < this->poolSize; i++) {
+        CubeTween &tween = this->pool[i];
+
+        if (tween.target == this->TARGET_NONE) {
+            continue;
+        }
+
+        // Progress after n ticks is n * 65535 / ticks, rounded down, with
+        // the remainder carried from tick to tick as in a line drawing
+        tween.progress += tween.rate;
+        if (tween.error >= tween.ticks - tween.spare) {
+            tween.error    -= tween.ticks - tween.spare;
+            tween.progress += 1;
+        } else {
+            tween.error += tween.spare;
+        }
+
+        // The last tick lands exactly on the end value
+        if (tween.progress == 0xFFFF) {
+            this->apply(tween, tween.to);
+            tween.target = this->TARGET_NONE;
+            continue;
+        }
+
+        // Scale the distance by the curve
+        // Working on the size of the distance keeps the product in 16 bits
+        byte curve = this->ease(tween.easing, tween.progress);
+
+        if (tween.to >= tween.from) {
+            byte distance = tween.to - tween.from;
+            this->apply(tween, tween.from + ((distance * (unsigned int) curve + 128) >> 8));
+        } else {
+            byte distance = tween.from - tween.to;
+            this->apply(tween, tween.from - ((distance * (unsigned int) curve + 128) >> 8));
+        }
+    }
+}
+
+/*
+ * Returns a curve's value (0-255) at a progress of 0-65535
+ *
+ * The top 5 bits of the progress pick a pair of points on the curve and
+ * the next 8 bits interpolate between them.
+ */
+byte CubeTweens::ease(byte easing, unsigned int progress) {
+
+    if (easing >= EASE_COUNT) {
+        easing = EASE_LINEAR;
+    }
+
+    byte index    = progress >> 11;
+    byte fraction = progress >> 3;
+
+    int a = pgm_read_byte(&EASING_CURVES[easing][index]);
+    int b = pgm_read_byte(&EASING_CURVES[easing][index + 1]);
+
+    return a + (((b - a) * fraction) >> 8);
+}
+
+/*
+ * Fills in a free tween and returns its number
+ */
+byte CubeTweens::start(byte target, int spriteNum, byte *value, byte from, byte to,
+                       unsigned int ticks, byte easing) {
+
+    if (ticks == 0) {
+        ticks = 1;
+    }
+
+    for (byte i = 0; i < this->poolSize; i++) {
+        CubeTween &tween = this->pool[i];
+
+        if (tween.target != this->TARGET_NONE) {
+            continue;
+        }
+
+        tween.target   = target;
+        tween.easing   = easing;
+        tween.sprite   = spriteNum;
+        tween.value    = value;
+        tween.from     = from;
+        tween.to       = to;
+        tween.current  = from;
+        tween.progress = 0;
+        tween.rate     = 0xFFFFUL / ticks;
+        tween.spare    = 0xFFFFUL % ticks;
+        tween.error    = 0;
+        tween.ticks    = ticks;
+
+        return i;
+    }
+
+    return this->NO_TWEEN;
+}
+
+/*
+ * Writes a tween's value to its target if it has changed
+ */
+void CubeTweens::apply(CubeTween &tween, byte value) {
+
+    if (value == tween.current) {
+        return;
+    }
+    tween.current = value;
+
+    if (tween.target == this->TARGET_X) {
+        this->engine->setSpriteAttribute(tween.sprite, this->engine->AN_X, value);
+    } else if (tween.target == this->TARGET_Y) {
+        this->engine->setSpriteAttribute(tween.sprite, this->engine->AN_Y, value);
+    } else if (tween.target == this->TARGET_Z) {
+        this->engine->setSpriteAttribute(tween.sprite, this->engine->AN_Z, value);
+    } else {
+        *tween.value = value;
+    }
+}
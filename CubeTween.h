@@ -0,0 +1,83 @@
+/*
+* CubeTween.h - Eased transitions for the CubeEngine library.
+*/
+#ifndef CubeTween_h
+#define CubeTween_h
+
+#include "Arduino.h"
+#include "CubeEngine.h"
+
+// One transition, kept in the sketch's pool, e.g. CubeTween tweens[16];
+struct CubeTween
+{
+    byte target;         // TARGET_ constant, TARGET_NONE when the slot is free
+    byte easing;         // EASE_ constant
+    int sprite;          // for sprite targets
+    byte *value;         // for TARGET_VALUE
+    byte from, to;
+    byte current;        // last value written
+    unsigned int progress; // 0-65535 through the transition
+    unsigned int rate;     // whole progress per tick
+    unsigned int spare;    // progress per tick left over, in 1/ticks
+    unsigned int error;    // spare progress so far, in 1/ticks
+    unsigned int ticks;    // length of the transition
+};
+
+class CubeTweens
+{
+    public:
+
+        // What a tween drives
+        // The sprite targets are the position attributes. TARGET_VALUE drives
+        // a byte of the sketch's, such as a brightness level.
+        static const byte TARGET_NONE  = 0;
+        static const byte TARGET_X     = 1;
+        static const byte TARGET_Y     = 2;
+        static const byte TARGET_Z     = 3;
+        static const byte TARGET_VALUE = 4;
+
+        // Easing curves
+        static const byte EASE_LINEAR = 0;
+        static const byte EASE_IN     = 1; // starts slow
+        static const byte EASE_OUT    = 2; // ends slow
+        static const byte EASE_IN_OUT = 3; // starts and ends slow
+        static const byte EASE_BOUNCE = 4; // bounces into place
+        static const byte EASE_COUNT  = 5;
+
+        // Returned when the pool is full
+        static const byte NO_TWEEN = 0xFF;
+
+        // Tween engine constructor
+        CubeTweens(CubeEngine &engine, CubeTween *pool, byte poolSize);
+
+        // Starting tweens
+        // 'ticks' is the length of the transition in calls to step()
+        byte tweenSprite(int spriteNum, byte target, byte to, unsigned int ticks, byte easing);
+        byte tweenValue(byte *value, byte to, unsigned int ticks, byte easing);
+
+        // Stopping tweens
+        // These leave the target where it is
+        void stop(byte tween);
+        void stopSprite(int spriteNum);
+        bool isActive(byte tween);
+
+        // Advances every tween by one tick
+        // With CubeLoop call this from the movement callback
+        void step();
+
+        // Returns a curve's value (0-255) at a progress of 0-65535
+        static byte ease(byte easing, unsigned int progress);
+
+    private:
+
+        CubeEngine *engine;
+        CubeTween *pool;
+        byte poolSize;
+
+        // Tween functions
+        byte start(byte target, int spriteNum, byte *value, byte from, byte to,
+                   unsigned int ticks, byte easing);
+        void apply(CubeTween &tween, byte value);
+};
+
+#endif
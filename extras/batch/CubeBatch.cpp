@@ -0,0 +1,217 @@
+#include "CubeBatch.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+/*
+ * Virtual clock and random generator of one run
+ *
+ * The generator is xorshift32, which is quick and needs four bytes of
+ * state, so runs never contend for a shared generator.
+ */
+struct CubeBatchHost
+{
+    unsigned long long micros;
+    unsigned long state;
+};
+
+static unsigned long batchMillis(void *context) {
+    return (unsigned long) (((CubeBatchHost *) context)->micros / 1000);
+}
+
+static unsigned long batchMicros(void *context) {
+    return (unsigned long) ((CubeBatchHost *) context)->micros;
+}
+
+static long batchRandom(void *context, long howBig) {
+    CubeBatchHost *host = (CubeBatchHost *) context;
+
+    unsigned long x = host->state;
+    x ^= (x << 13) & 0xFFFFFFFFUL;
+    x ^= x >> 17;
+    x ^= (x << 5) & 0xFFFFFFFFUL;
+    host->state = x;
+
+    return (long) (x % (unsigned long) howBig);
+}
+
+/**
+ * This constructor only stores the thread count, run() starts the threads
+ */
+CubeBatch::CubeBatch(unsigned int threads) {
+
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    this->threads       = threads;
+    this->tickMillis    = 20;
+    this->maxTicks      = 100000;
+    this->baseSeed      = 1;
+    this->refreshPasses = 0;
+    this->wallSeconds   = 0;
+    this->totalTicks    = 0;
+}
+
+/*
+ * Sets how far the virtual clock moves on each tick
+ */
+void CubeBatch::setTimestep(unsigned int tickMillis) {
+    this->tickMillis = tickMillis;
+}
+
+/*
+ * Sets the most ticks a run can take, in case a game never ends
+ */
+void CubeBatch::setTickLimit(unsigned long maxTicks) {
+    this->maxTicks = maxTicks;
+}
+
+/*
+ * Sets the seed of run 0
+ *
+ * Run n is seeded with baseSeed + n, so any run can be repeated alone.
+ */
+void CubeBatch::setSeed(unsigned long baseSeed) {
+    this->baseSeed = baseSeed;
+}
+
+/*
+ * Sets how many mplex() passes each tick runs
+ *
+ * The output is discarded. Leave this at 0 to time the game logic only,
+ * or set it to 12 per frame shown to include the refresh.
+ */
+void CubeBatch::setRefresh(unsigned int passesPerTick) {
+    this->refreshPasses = passesPerTick;
+}
+
+/*
+ * Runs the games
+ *
+ * Threads take the next run number as they finish, so a few long games
+ * don't leave the other threads idle.
+ */
+const std::vector<CubeBatchRun> &CubeBatch::run(unsigned long count, BatchSetup setup, BatchTick tick) {
+
+    this->results.assign(count, CubeBatchRun());
+    for (unsigned long i = 0; i < count; i++) {
+        this->results[i].index = i;
+        this->results[i].seed  = this->baseSeed + i;
+    }
+
+    std::atomic<unsigned long> next(0);
+    std::vector<std::thread> workers;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (unsigned int t = 0; t < this->threads; t++) {
+        workers.push_back(std::thread([this, &next, count, setup, tick]() {
+            unsigned long i;
+            while ((i = next.fetch_add(1)) < count) {
+
+                // Neighbouring results share cache lines, so each run is
+                // played on a copy and stored once it's over
+                CubeBatchRun run = this->results[i];
+                this->simulate(run, setup, tick);
+                this->results[i] = run;
+            }
+        }));
+    }
+
+    for (unsigned int t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+
+    this->wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    this->totalTicks = 0;
+    for (unsigned long i = 0; i < count; i++) {
+        this->totalTicks += this->results[i].ticks;
+    }
+
+    return this->results;
+}
+
+/*
+ * Returns the number of worker threads
+ */
+unsigned int CubeBatch::getThreadCount() {
+    return this->threads;
+}
+
+/*
+ * Returns the real time the last batch took
+ */
+double CubeBatch::getWallSeconds() {
+    return this->wallSeconds;
+}
+
+/*
+ * Returns the ticks simulated by every run of the last batch
+ */
+unsigned long CubeBatch::getTotalTicks() {
+    return this->totalTicks;
+}
+
+/*
+ * Returns the ticks simulated per real second, over all threads
+ */
+double CubeBatch::getTicksPerSecond() {
+    return (this->wallSeconds > 0) ? this->totalTicks / this->wallSeconds : 0;
+}
+
+/*
+ * Simulates one run
+ *
+ * The engine, its host and the result live on this thread's stack and
+ * nothing else touches them.
+ */
+void CubeBatch::simulate(CubeBatchRun &run, BatchSetup setup, BatchTick tick) {
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // xorshift32 can't start from 0
+    CubeBatchHost state;
+    state.micros = 0;
+    state.state  = (run.seed & 0xFFFFFFFFUL) != 0 ? (run.seed & 0xFFFFFFFFUL) : 0x9E3779B9UL;
+
+    CubeHost host;
+    host.millis  = batchMillis;
+    host.micros  = batchMicros;
+    host.random  = batchRandom;
+    host.output  = NULL;
+    host.context = &state;
+
+    CubeEngine engine(&host);
+
+    run.ticks = 0;
+    run.score = 0;
+
+    if (setup != NULL) {
+        setup(engine, run);
+    }
+
+    while (run.ticks < this->maxTicks) {
+
+        bool playing = tick(engine, run);
+
+        for (unsigned int i = 0; i < this->refreshPasses; i++) {
+            engine.mplex();
+        }
+
+        run.ticks    += 1;
+        state.micros += this->tickMillis * 1000ULL;
+
+        if (!playing) {
+            break;
+        }
+    }
+
+    run.gameMillis  = batchMillis(&state);
+    run.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,98 @@
+/*
+* CubeBatch.h - Runs many headless CubeEngine games at once, off the board.
+*
+* Every run gets its own engine, built with a CubeHost that holds the
+* run's virtual clock and random generator, so runs share nothing and a
+* worker thread per core can simulate them as fast as the CPU allows.
+* Time only moves when a tick ends, by the timestep, so a run gives the
+* same result on any machine and with any number of threads.
+*
+* This is host code (C++11 threads), not part of the Arduino library.
+* Build it with the library sources and the stand-in for the Arduino core
+* in extras/host:
+*
+*     g++ -O2 -std=gnu++11 -pthread -DARDUINO=10819 \
+*         -I<library>/extras/host -I<library> mygame.cpp CubeBatch.cpp \
+*         <library>/CubeEngine.cpp ... <library>/extras/host/Arduino.cpp
+*
+* extras/host/tests/test_batch.cpp is a small example.
+*
+* A game is a setup function and a tick function:
+*
+*     void setup(CubeEngine &engine, CubeBatchRun &run) {
+*         engine.setRandomSpritePosition(1);
+*     }
+*
+*     bool tick(CubeEngine &engine, CubeBatchRun &run) {
+*         engine.autoMoveSprites(engine.getMillis());
+*         run.score += ...;
+*         return stillPlaying;
+*     }
+*
+*     CubeBatch batch(0);
+*     batch.run(10000, setup, tick);
+*/
+#ifndef CubeBatch_h
+#define CubeBatch_h
+
+#include <vector>
+#include "CubeEngine.h"
+
+// The result of one run
+struct CubeBatchRun
+{
+    unsigned long index;      // run number, from 0
+    unsigned long seed;       // seed of the run's random generator
+    unsigned long ticks;      // ticks simulated
+    unsigned long gameMillis; // virtual time when the run ended
+    long score;               // for the game to fill in
+    double wallSeconds;       // real time the run took
+};
+
+class CubeBatch
+{
+    public:
+
+        // Puts a new engine in its starting state
+        typedef void (*BatchSetup)(CubeEngine &engine, CubeBatchRun &run);
+
+        // Runs one tick, returning false when the game is over
+        typedef bool (*BatchTick)(CubeEngine &engine, CubeBatchRun &run);
+
+        // Batch constructor
+        // 0 threads uses one per core
+        CubeBatch(unsigned int threads);
+
+        // Settings
+        void setTimestep(unsigned int tickMillis);
+        void setTickLimit(unsigned long maxTicks);
+        void setSeed(unsigned long baseSeed);
+        void setRefresh(unsigned int passesPerTick);
+
+        // Runs 'count' games across the threads and returns their results,
+        // in run order
+        const std::vector<CubeBatchRun> &run(unsigned long count, BatchSetup setup, BatchTick tick);
+
+        // Batch results
+        unsigned int getThreadCount();
+        double getWallSeconds();
+        unsigned long getTotalTicks();
+        double getTicksPerSecond();
+
+    private:
+
+        unsigned int threads;
+        unsigned int tickMillis;
+        unsigned long maxTicks;
+        unsigned long baseSeed;
+        unsigned int refreshPasses;
+
+        std::vector<CubeBatchRun> results;
+        double wallSeconds;
+        unsigned long totalTicks;
+
+        // Simulates one run on the calling thread
+        void simulate(CubeBatchRun &run, BatchSetup setup, BatchTick tick);
+};
+
+#endif
@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+"""
+cubeasm.py - Assembler for CubeBehaviours programs.
+
+Turns a behaviour listing into a PROGMEM array for the sketch:
+
+    python3 cubeasm.py patrol.cas > patrol.h
+
+Each line is an optional label, an instruction and its operands, with ';'
+starting a comment:
+
+    patrol: STEP
+            IF_BLOCKED turn      ; jump if the next LED is lit or a wall
+            WAIT 2
+            GOTO patrol
+    turn:   REVERSE
+            GOTO patrol
+
+Operands are numbers, labels (for addresses), AV_ direction names such as
+UP or FRONT_DOWN_LEFT, AN_ attribute names such as COLOUR, or AV_ value
+names such as RED, without their prefixes. The opcodes must match the
+OP_ constants in CubeBehaviour.h.
+"""
+
+import os
+import re
+import sys
+
+# Opcode and operand kinds ('a' address, 'n' number or name)
+OPCODES = {
+    'END':        (0x00, ''),
+    'YIELD':      (0x01, ''),
+    'WAIT':       (0x02, 'n'),
+    'GOTO':       (0x03, 'a'),
+    'COUNT':      (0x04, 'n'),
+    'LOOP':       (0x05, 'a'),
+    'MOVE':       (0x06, 'n'),
+    'STEP':       (0x07, ''),
+    'SET':        (0x08, 'nn'),
+    'FACE':       (0x09, 'n'),
+    'REVERSE':    (0x0A, ''),
+    'RANDOM_DIR': (0x0B, ''),
+    'IF_BLOCKED': (0x0C, 'a'),
+    'IF_EDGE':    (0x0D, 'a'),
+    'IF_RANDOM':  (0x0E, 'na'),
+    'CHASE':      (0x0F, 'n'),
+    'IF_NEAR':    (0x10, 'nna'),
+}
+
+# AV_ directions, in the order of their values (index << 3)
+DIRECTIONS = ['UP', 'DOWN', 'LEFT', 'RIGHT', 'BACK', 'FRONT',
+              'BACK_UP_LEFT', 'BACK_UP_RIGHT', 'BACK_DOWN_LEFT', 'BACK_DOWN_RIGHT',
+              'FRONT_UP_LEFT', 'FRONT_UP_RIGHT', 'FRONT_DOWN_LEFT', 'FRONT_DOWN_RIGHT']
+
+# AN_ attribute names
+ATTRIBUTES = ['STATE', 'COLOUR', 'VISIBILITY', 'X', 'Y', 'Z', 'WRAP', 'MOVE',
+              'DIRECTION', 'SPEED', 'DEFEND', 'ATTACK', 'CUBE']
+
+# AV_ values other than the directions
+VALUES = {
+    'LIVE': 0x08, 'DEAD': 0x00,
+    'OFF': 0x00, 'RED': 0x40, 'GREEN': 0x80, 'BLUE': 0xC0,
+    'VISIBLE': 0x80, 'INVISIBLE': 0x00,
+    'NOWRAP': 0x00, 'NOMOVE': 0x00,
+    'SPEED0': 0, 'SPEED1': 1, 'SPEED2': 2, 'SPEED3': 3,
+    'SPEED4': 4, 'SPEED5': 5, 'SPEED6': 7,
+    'KEEP_ALIVE': 0, 'KILL': 1, 'JUMP': 2, 'ENDGAME': 3,
+}
+
+
+class AsmError(Exception):
+    pass
+
+
+def value_of(token, position):
+    """Returns the byte for a number or name operand."""
+    name = token.upper()
+
+    if re.match(r'^(0x[0-9a-f]+|0b[01]+|\d+)$', token, re.I):
+        number = int(token, 0)
+    elif name in DIRECTIONS:
+        number = DIRECTIONS.index(name) << 3
+    elif position == 0 and name in ATTRIBUTES:
+        number = ATTRIBUTES.index(name)
+    elif name in VALUES:
+        number = VALUES[name]
+    elif name == 'WRAP':
+        number = 0x40
+    elif name == 'MOVE':
+        number = 0x80
+    else:
+        raise AsmError('unknown operand "%s"' % token)
+
+    if number < 0 or number > 255:
+        raise AsmError('operand "%s" is not a byte' % token)
+
+    return number
+
+
+def parse(lines):
+    """Splits the listing into (line number, labels, opcode, operands)."""
+    statements = []
+    labels = []
+
+    for number, line in enumerate(lines, 1):
+        line = line.split(';', 1)[0].strip()
+
+        while True:
+            match = re.match(r'^([A-Za-z_]\w*):\s*(.*)$', line)
+            if not match:
+                break
+            labels.append(match.group(1))
+            line = match.group(2)
+
+        if not line:
+            continue
+
+        tokens = line.replace(',', ' ').split()
+        statements.append((number, labels, tokens[0].upper(), tokens[1:]))
+        labels = []
+
+    if labels:
+        statements.append((len(lines), labels, 'END', []))
+
+    return statements
+
+
+def assemble(lines):
+    """Returns the program bytes for a listing."""
+    statements = parse(lines)
+
+    # First pass places the labels
+    addresses = {}
+    offset = 0
+    for number, labels, opcode, operands in statements:
+        if opcode not in OPCODES:
+            raise AsmError('line %d: unknown instruction "%s"' % (number, opcode))
+
+        kinds = OPCODES[opcode][1]
+        if len(operands) != len(kinds):
+            raise AsmError('line %d: %s takes %d operands' % (number, opcode, len(kinds)))
+
+        for label in labels:
+            if label in addresses:
+                raise AsmError('line %d: label "%s" is already used' % (number, label))
+            addresses[label] = offset
+
+        offset += 1 + len(kinds)
+
+    if offset > 256:
+        raise AsmError('program is %d bytes, the most is 256' % offset)
+
+    # Second pass emits the bytes
+    program = []
+    for number, labels, opcode, operands in statements:
+        code, kinds = OPCODES[opcode]
+        program.append(code)
+
+        for position, (kind, token) in enumerate(zip(kinds, operands)):
+            try:
+                if kind == 'a' and token in addresses:
+                    program.append(addresses[token])
+                else:
+                    program.append(value_of(token, position))
+            except AsmError as error:
+                raise AsmError('line %d: %s' % (number, error))
+
+    return program
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.stderr.write('usage: cubeasm.py listing [array name]\n')
+        return 2
+
+    with open(argv[1]) as listing:
+        lines = listing.read().splitlines()
+
+    name = argv[2] if len(argv) > 2 else os.path.splitext(os.path.basename(argv[1]))[0]
+    name = re.sub(r'\W', '_', name).upper()
+
+    try:
+        program = assemble(lines)
+    except AsmError as error:
+        sys.stderr.write('%s: %s\n' % (argv[1], error))
+        return 1
+
+    print('// Assembled from %s by cubeasm.py' % os.path.basename(argv[1]))
+    print('const byte %s[] PROGMEM = {' % name)
+    for start in range(0, len(program), 12):
+        row = ', '.join('0x%02X' % b for b in program[start:start + 12])
+        last = start + 12 >= len(program)
+        print('    %s%s' % (row, '' if last else ','))
+    print('};')
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,134 @@
+#include "Arduino.h"
+#include "EEPROM.h"
+
+volatile uint8_t hostRegisters[0x100];
+unsigned long hostMicros = 0;
+void (*hostDigitalWrite)(uint8_t pin, uint8_t value) = NULL;
+
+uint8_t hostEeprom[1024];
+unsigned long hostEepromWrites = 0;
+EEPROMClass EEPROM;
+
+// State of the random generator, as avr-libc's
+static uint32_t hostRandomState = 1;
+
+/*
+ * Finds the port and bit of a pin, numbered as on an Uno
+ */
+uint8_t digitalPinToPort(uint8_t pin) {
+    if (pin >= NUM_DIGITAL_PINS) {
+        return NOT_A_PORT;
+    }
+
+    return (pin < 8) ? PD : ((pin < 14) ? PB : PC);
+}
+
+uint8_t digitalPinToBitMask(uint8_t pin) {
+    return 1 << ((pin < 8) ? pin : ((pin < 14) ? pin - 8 : pin - 14));
+}
+
+/*
+ * Returns a port's registers, PINx, DDRx and PORTx in that order from
+ * 0x23 for PORTB
+ */
+static volatile uint8_t *portRegister(uint8_t port, uint8_t offset) {
+    return &hostRegisters[0x23 + ((port - PB) * 3) + offset];
+}
+
+volatile uint8_t *portInputRegister(uint8_t port)  { return portRegister(port, 0); }
+volatile uint8_t *portModeRegister(uint8_t port)   { return portRegister(port, 1); }
+volatile uint8_t *portOutputRegister(uint8_t port) { return portRegister(port, 2); }
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    volatile uint8_t *ddr = portModeRegister(digitalPinToPort(pin));
+
+    if (mode == OUTPUT) {
+        *ddr |= digitalPinToBitMask(pin);
+    } else {
+        *ddr &= ~digitalPinToBitMask(pin);
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    volatile uint8_t *port = portOutputRegister(digitalPinToPort(pin));
+
+    if (value == LOW) {
+        *port &= ~digitalPinToBitMask(pin);
+    } else {
+        *port |= digitalPinToBitMask(pin);
+    }
+
+    if (hostDigitalWrite != NULL) {
+        hostDigitalWrite(pin, value);
+    }
+}
+
+int digitalRead(uint8_t pin) {
+    return (*portInputRegister(digitalPinToPort(pin)) & digitalPinToBitMask(pin)) ? HIGH : LOW;
+}
+
+unsigned long millis() {
+    return hostMicros / 1000;
+}
+
+unsigned long micros() {
+    return hostMicros;
+}
+
+void delay(unsigned long ms) {
+    hostMicros += ms * 1000;
+}
+
+void delayMicroseconds(unsigned int us) {
+    hostMicros += us;
+}
+
+/*
+ * avr-libc's random(), the "minimal standard" generator of Park and
+ * Miller: x = 16807 * x mod (2^31 - 1), worked without overflowing 31
+ * bits. It has the same state and sequence as on a board, so a game
+ * recorded there replays here number for number.
+ */
+static long hostRandomNext() {
+    int32_t x = hostRandomState;
+
+    // It can't start from 0
+    if (x == 0) {
+        x = 123459876L;
+    }
+
+    int32_t hi = x / 127773L;
+    int32_t lo = x % 127773L;
+    x = (16807L * lo) - (2836L * hi);
+    if (x < 0) {
+        x += 0x7FFFFFFFL;
+    }
+
+    hostRandomState = x;
+    return x;
+}
+
+/*
+ * Random numbers in [howsmall, howbig), as the Arduino core
+ */
+long random(long howbig) {
+    if (howbig == 0) {
+        return 0;
+    }
+
+    return hostRandomNext() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+    if (howsmall >= howbig) {
+        return howsmall;
+    }
+
+    return howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) {
+    if (seed != 0) {
+        hostRandomState = seed;
+    }
+}
@@ -0,0 +1,134 @@
+/*
+* Arduino.h - A host stand-in for the Arduino core, for the CubeEngine extras.
+*
+* The library and the tools under extras build on a PC against this in
+* place of the real core:
+*
+*     g++ -O2 -std=gnu++11 -DARDUINO=10819 -I<library>/extras/host -I<library> \
+*         mytool.cpp <library>/CubeEngine.cpp ... <library>/extras/host/Arduino.cpp
+*
+* It has only what the library uses, modelled on an ATmega328P. The port
+* registers are bytes of hostRegisters[], at their data memory addresses,
+* so a test can watch the pins. Time is virtual: millis() and micros()
+* read hostMicros, which only moves when the program moves it. random()
+* is avr-libc's generator, seeded the same way, so every run is the same
+* and gives the numbers a board would.
+*
+* The Makefile beside this builds the tests under tests/.
+*/
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "binary.h"
+
+// The ports below are laid out as on an ATmega328P, so the library drives
+// them as it would on the board. Build with -DCUBE_HOST_PORTS=0 to treat
+// this as a board without port registers, which uses digitalWrite().
+#ifndef CUBE_HOST_PORTS
+  #define CUBE_HOST_PORTS 1
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef unsigned int word;
+
+#define HIGH 1
+#define LOW  0
+
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+
+// Program memory is ordinary memory on the host
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(address)  (*(const uint8_t *) (address))
+#define pgm_read_word(address)  (*(const uint16_t *) (address))
+#define pgm_read_dword(address) (*(const uint32_t *) (address))
+#define strlen_P(s) strlen(s)
+
+#ifndef constrain
+  #define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#endif
+
+// Registers, by data memory address
+extern volatile uint8_t hostRegisters[0x100];
+#define _SFR_MEM8(address) (hostRegisters[(address)])
+
+#define PINB  _SFR_MEM8(0x23)
+#define DDRB  _SFR_MEM8(0x24)
+#define PORTB _SFR_MEM8(0x25)
+#define PINC  _SFR_MEM8(0x26)
+#define DDRC  _SFR_MEM8(0x27)
+#define PORTC _SFR_MEM8(0x28)
+#define PIND  _SFR_MEM8(0x29)
+#define DDRD  _SFR_MEM8(0x2A)
+#define PORTD _SFR_MEM8(0x2B)
+#define SREG  _SFR_MEM8(0x5F)
+
+#define noInterrupts() ((void) 0)
+#define interrupts()   ((void) 0)
+#define cli()          ((void) 0)
+#define sei()          ((void) 0)
+
+// Pin numbering, as on an Uno
+// Digital pins 0-7 are PORTD, 8-13 PORTB and 14-19 (A0-A5) PORTC.
+#define NUM_DIGITAL_PINS 20
+#define NOT_A_PORT 0
+#define PB 2
+#define PC 3
+#define PD 4
+
+static const uint8_t A0 = 14;
+static const uint8_t A1 = 15;
+static const uint8_t A2 = 16;
+static const uint8_t A3 = 17;
+static const uint8_t A4 = 18;
+static const uint8_t A5 = 19;
+
+uint8_t digitalPinToPort(uint8_t pin);
+uint8_t digitalPinToBitMask(uint8_t pin);
+volatile uint8_t *portOutputRegister(uint8_t port);
+volatile uint8_t *portInputRegister(uint8_t port);
+volatile uint8_t *portModeRegister(uint8_t port);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+// Called by digitalWrite() after it sets a pin, unless NULL
+extern void (*hostDigitalWrite)(uint8_t pin, uint8_t value);
+
+// The virtual clock
+// delay() and delayMicroseconds() move it on, nothing else does.
+extern unsigned long hostMicros;
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+// Streams, without the formatting
+class Print
+{
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t value) = 0;
+};
+
+class Stream : public Print
+{
+    public:
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+};
+
+#endif
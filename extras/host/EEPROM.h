@@ -0,0 +1,25 @@
+/*
+* EEPROM.h - A host stand-in for the Arduino EEPROM library.
+*
+* The 1K of an ATmega328P, in memory. hostEepromWrites counts the bytes
+* written, so a test can see how much wear a save costs.
+*/
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include "Arduino.h"
+
+extern uint8_t hostEeprom[1024];
+extern unsigned long hostEepromWrites;
+
+struct EEPROMClass
+{
+    uint8_t read(int address) { return hostEeprom[address]; }
+    void write(int address, uint8_t value) { hostEeprom[address] = value; hostEepromWrites += 1; }
+    void update(int address, uint8_t value) { if (read(address) != value) { write(address, value); } }
+    uint16_t length() { return sizeof(hostEeprom); }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,75 @@
+/*
+* test_batch.cpp - CubeBatch gives the same results on any number of threads.
+*/
+#include <stdio.h>
+#include "CubeBatch.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+// Sprites wander the cube, and the game ends at random
+static void setup(CubeEngine &engine, CubeBatchRun &run) {
+    for (int i = 1; i < 10; i++) {
+        engine.setRandomSpritePosition(i);
+        engine.setRandomSpriteColour(i);
+        engine.setRandomSpriteDirection(i);
+        engine.setSpriteAttribute(i, engine.AN_MOVE, engine.AV_MOVE);
+        engine.setSpriteAttribute(i, engine.AN_SPEED, engine.AV_SPEED6);
+    }
+}
+
+static bool tick(CubeEngine &engine, CubeBatchRun &run) {
+    engine.autoMoveSprites(engine.getMillis());
+    run.score += engine.getLED(0, 0, 0) + engine.getLED(5, 5, 5);
+
+    return engine.getRandom(500) != 0;
+}
+
+int main() {
+
+    CubeBatch single(1);
+    single.setRefresh(4);
+    single.setTickLimit(2000);
+    std::vector<CubeBatchRun> expected = single.run(64, setup, tick);
+
+    check(expected.size() == 64, "every run has a result");
+
+    bool ended = false;
+    for (unsigned long i = 0; i < expected.size(); i++) {
+        check(expected[i].index == i, "results are in run order");
+        check(expected[i].ticks > 0 && expected[i].ticks <= 2000, "runs stop by the tick limit");
+        check(expected[i].gameMillis == expected[i].ticks * 20, "the clock moves one timestep a tick");
+        ended = ended || expected[i].ticks < 2000;
+    }
+    check(ended, "some games end before the limit");
+
+    CubeBatch threaded(4);
+    threaded.setRefresh(4);
+    threaded.setTickLimit(2000);
+    const std::vector<CubeBatchRun> &results = threaded.run(64, setup, tick);
+
+    check(threaded.getTotalTicks() == single.getTotalTicks(), "threads simulate the same ticks");
+    for (unsigned long i = 0; i < results.size() && i < expected.size(); i++) {
+        check(results[i].seed == expected[i].seed &&
+              results[i].ticks == expected[i].ticks &&
+              results[i].score == expected[i].score, "threads give the same results");
+    }
+
+    // How the batch scales with threads, on a longer run
+    for (unsigned int threads = 1; threads <= 8; threads *= 2) {
+        CubeBatch timed(threads);
+        timed.setRefresh(12);
+        timed.setTickLimit(5000);
+        timed.run(256, setup, tick);
+        printf("%u threads: %.0f ticks a second\n", threads, timed.getTicksPerSecond());
+    }
+
+    printf("test_batch: %lu ticks, %s\n", threaded.getTotalTicks(), failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+/*
+* test_digital.cpp - On a board without port registers the cube is driven through digitalWrite().
+*
+* Built with CUBE_HOST_PORTS=0, against a copy of CubeEngine.cpp built the
+* same way, so the stand-in looks like a board the library knows nothing
+* about.
+*/
+#include <stdio.h>
+#include <vector>
+#include "CubeEngine.h"
+#include "CubePins.h"
+
+static_assert(!CUBE_PINS_SUPPORTED && !CUBE_PORTS_SUPPORTED, "test_digital needs CUBE_HOST_PORTS=0");
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+// The wiring under test, latch, clock, data, then layers 0-5
+static int wiring[9];
+
+// One latched pass: the data pin at each rise of the clock, and the
+// layer powered after it
+struct Pass
+{
+    std::vector<bool> clocks;
+    int layer;
+};
+
+static std::vector<Pass> passes;
+static Pass current;
+static bool dataLevel;
+
+static void follow(uint8_t pin, uint8_t value) {
+    if (pin == wiring[2]) {
+        dataLevel = value;
+    } else if (pin == wiring[1] && value == HIGH) {
+        current.clocks.push_back(dataLevel);
+    } else if (pin == wiring[0] && value == HIGH) {
+        passes.push_back(current);
+        current = Pass();
+    }
+
+    for (int layer = 0; layer < 6; layer++) {
+        if (pin == wiring[layer + 3] && value == HIGH && !passes.empty()) {
+            passes.back().layer = layer;
+        }
+    }
+}
+
+// The bits a pass should shift out for a layer, last LED first
+// The registers are active low, and each LED takes three bits.
+static std::vector<bool> expected(CubeEngine &engine, int layer, bool red) {
+    std::vector<bool> bits;
+
+    for (int led = 35; led >= 0; led--) {
+        byte colour = engine.getLED(layer, led / 6, led % 6);
+        byte pattern = B00000111;
+
+        if (red && colour == engine.AV_RED) {
+            pattern = B00000110;
+        } else if (!red && colour == engine.AV_GREEN) {
+            pattern = B00000101;
+        } else if (!red && colour == engine.AV_BLUE) {
+            pattern = B00000011;
+        }
+
+        bits.push_back(pattern & B00000100);
+        bits.push_back(pattern & B00000010);
+        bits.push_back(pattern & B00000001);
+    }
+
+    return bits;
+}
+
+static void drive(const int *pins) {
+
+    for (int i = 0; i < 9; i++) {
+        wiring[i] = pins[i];
+    }
+    hostDigitalWrite = follow;
+
+    CubeEngine engine(pins[0], pins[1], pins[2], pins[3], pins[4], pins[5], pins[6], pins[7], pins[8]);
+    engine.setEqualisation(NULL);
+
+    int dataPins[2] = {A4, A5};
+    check(!engine.setShiftChains(2, dataPins), "parallel chains are refused without a port");
+
+    for (int i = 0; i < 216; i++) {
+        engine.setLED(i / 36, (i / 6) % 6, i % 6, random(4) << 6);
+    }
+
+    passes.clear();
+    current = Pass();
+    for (int i = 0; i < 12; i++) {
+        engine.mplex();
+    }
+
+    // Blue and green go first and the layer moves on after them, so the
+    // red pass of each layer is followed by its blue and green pass
+    bool same = passes.size() == 12;
+    for (int p = 0; same && p < 12; p++) {
+        int layer = ((p + 1) / 2) % 6;
+        same = passes[p].layer == layer && passes[p].clocks == expected(engine, layer, p & 1);
+    }
+    check(same, "every pass shifts out its layer through digitalWrite()");
+
+    hostDigitalWrite = NULL;
+}
+
+int main() {
+
+    // The default wiring, which a known board would drive through its ports
+    int defaults[9] = {A1, A3, A2, 2, 3, 4, 5, 6, 7};
+    drive(defaults);
+
+    // Some other wiring
+    int others[9] = {8, 9, 10, A0, A1, A2, A3, 2, 3};
+    drive(others);
+
+    printf("test_digital: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,157 @@
+/*
+* test_idle.cpp - CubeIdle sleeps most of the time without missing a deadline.
+*/
+#include <stdio.h>
+#include "CubeEngine.h"
+#include "CubeLoop.h"
+#include "CubeIdle.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+// The refresh interrupt, every millisecond
+static const unsigned long REFRESH = 1000;
+
+static CubeEngine *cube;
+static unsigned long refreshes = 0;
+static unsigned long overslept = 0;
+
+// Sleeps on the virtual clock until the next refresh, which wakes the CPU
+// and runs mplex() as the interrupt would
+static void sleepToRefresh(unsigned long maxMicros) {
+    unsigned long nap = REFRESH - (hostMicros % REFRESH);
+
+    if (nap > maxMicros) {
+        overslept += 1;
+    }
+
+    hostMicros += nap;
+    cube->mplex();
+    refreshes += 1;
+}
+
+static unsigned long ticks = 0;
+
+static void logic() {
+    ticks += 1;
+}
+
+static void setup(CubeEngine &engine) {
+    for (int i = 1; i < 5; i++) {
+        engine.setRandomSpritePosition(i);
+        engine.setSpriteAttribute(i, engine.AN_MOVE, engine.AV_MOVE);
+        engine.setSpriteAttribute(i, engine.AN_SPEED, engine.AV_SPEED6);
+    }
+}
+
+int main() {
+
+    CubeEngine engine(A1, A3, A2, 2, 3, 4, 5, 6, 7);
+    cube = &engine;
+    setup(engine);
+
+    // Against a 20ms game loop, with 300us of work each time round
+    CubeLoop loop(engine, 20);
+    loop.setCallback(loop.PHASE_LOGIC, logic);
+
+    CubeIdle idler(engine, REFRESH);
+    idler.setSleep(sleepToRefresh);
+    idler.attachLoop(&loop);
+
+    loop.run();
+    unsigned long due = hostMicros + 20000;
+    unsigned long start = hostMicros;
+    unsigned long late = 0;
+    ticks = 0;
+
+    while (hostMicros - start < 5000000UL) {
+        if (loop.run()) {
+            if ((long) (hostMicros - due) > (long) late) {
+                late = hostMicros - due;
+            }
+            due += 20000;
+            hostMicros += 300;
+        }
+
+        hostMicros += 5;
+        idler.idle();
+    }
+
+    check(ticks >= 249 && ticks <= 250, "the loop ticks every 20ms");
+    check(late <= 100, "no tick is later than the guard");
+    check(overslept == 0, "no sleep runs past its limit");
+    check(idler.getIdleRatio() >= 90, "the CPU sleeps most of the time");
+    printf("loop: %lu ticks, worst %lu us late, %u%% idle, %lu sleeps\n",
+           ticks, late, idler.getIdleRatio(), idler.getSleeps());
+
+    // Against the automove timers, with no loop
+    CubeIdle mover(engine, REFRESH);
+    mover.setSleep(sleepToRefresh);
+
+    start = hostMicros;
+    late = 0;
+    unsigned long moves = 0;
+    unsigned long dueMillis = millis() + engine.getMillisToMove();
+
+    while (hostMicros - start < 5000000UL) {
+        if (engine.getMillisToMove() == 0) {
+            if ((long) (hostMicros - (dueMillis * 1000)) > (long) late) {
+                late = hostMicros - (dueMillis * 1000);
+            }
+            engine.autoMoveSprites();
+            moves += 1;
+            dueMillis = millis() + engine.getMillisToMove();
+        }
+
+        hostMicros += 50;
+        mover.idle();
+    }
+
+    check(moves > 90, "sprites keep moving");
+    check(late <= 1000, "no move is more than a millisecond late");
+    check(overslept == 0, "no sleep runs past its limit");
+    check(mover.getIdleRatio() >= 80, "the CPU sleeps between moves");
+    printf("moves: %lu, worst %lu us late, %u%% idle\n", moves, late, mover.getIdleRatio());
+
+    for (int i = 1; i < 5; i++) {
+        engine.setSpriteAttribute(i, engine.AN_MOVE, engine.AV_NOMOVE);
+    }
+    check(mover.getMicrosToDeadline() == 0xFFFFFFFF, "nothing moving means no deadline");
+
+    // The default sleep, which off AVR and ARM waits with delay() on the
+    // virtual clock rather than spinning
+    CubeIdle waiter(engine, REFRESH);
+    waiter.attachLoop(&loop);
+
+    loop.run();
+    due = hostMicros + 20000;
+    start = hostMicros;
+    late = 0;
+    ticks = 0;
+
+    while (hostMicros - start < 1000000UL) {
+        if (loop.run()) {
+            if ((long) (hostMicros - due) > (long) late) {
+                late = hostMicros - due;
+            }
+            due += 20000;
+            hostMicros += 300;
+        }
+
+        hostMicros += 5;
+        waiter.idle();
+    }
+
+    check(ticks >= 49 && ticks <= 50, "the default sleep keeps the loop ticking");
+    check(late <= 100, "the default sleep wakes by the guard");
+    check(waiter.getSleeps() <= ticks + 1, "the default sleep waits once a tick");
+
+    printf("test_idle: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+/*
+* test_journal.cpp - Rewinding and replaying puts every sprite back on the cube.
+*/
+#include <stdio.h>
+#include "CubeEngine.h"
+#include "CubeJournal.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+// Places a live, visible sprite
+static void place(CubeEngine &engine, int sprite, byte x, byte y, byte z, byte colour) {
+    engine.setSpriteAttribute(sprite, engine.AN_X, x);
+    engine.setSpriteAttribute(sprite, engine.AN_Y, y);
+    engine.setSpriteAttribute(sprite, engine.AN_Z, z);
+    engine.setSpriteAttribute(sprite, engine.AN_COLOUR, colour);
+    engine.setSpriteAttribute(sprite, engine.AN_STATE, engine.AV_LIVE);
+    engine.setSpriteAttribute(sprite, engine.AN_VISIBILITY, engine.AV_VISIBLE);
+}
+
+// A sprite moves onto another, then the move is rewound
+static void rewindOver(int still, int mover) {
+
+    CubeEngine engine(A1, A3, A2, 2, 3, 4, 5, 6, 7);
+    byte history[128];
+    CubeJournal journal(engine, history, sizeof(history));
+
+    place(engine, still, 3, 3, 3, engine.AV_GREEN);
+    place(engine, mover, 1, 3, 3, engine.AV_RED);
+    engine.attachJournal(&journal);
+    journal.endTick();
+
+    engine.setSpriteAttribute(mover, engine.AN_X, 3);
+    journal.endTick();
+
+    char what[80];
+    snprintf(what, sizeof(what), "sprite %d is red on sprite %d's LED", mover, still);
+    check(engine.getLED(3, 3, 3) == engine.AV_RED, what);
+
+    journal.rewind(1);
+    snprintf(what, sizeof(what), "rewinding puts sprite %d back (%d moved off it)", still, mover);
+    check(engine.getLED(3, 3, 3) == engine.AV_GREEN, what);
+    snprintf(what, sizeof(what), "rewinding puts sprite %d back where it was", mover);
+    check(engine.getLED(1, 3, 3) == engine.AV_RED, what);
+
+    // Which of two sprites on one LED shows after a redraw is down to
+    // their numbers, so only check it's lit
+    journal.replay(1);
+    snprintf(what, sizeof(what), "replaying moves sprite %d onto sprite %d again", mover, still);
+    check(engine.getLED(3, 3, 3) != engine.AV_OFF && engine.getLED(1, 3, 3) == engine.AV_OFF, what);
+}
+
+int main() {
+
+    rewindOver(0, 5);
+    rewindOver(1, 5);
+    rewindOver(5, 0);
+
+    // A longer game, rewound to the start, leaves every sprite as it was
+    CubeEngine engine(A1, A3, A2, 2, 3, 4, 5, 6, 7);
+    byte history[512];
+    CubeJournal journal(engine, history, sizeof(history));
+
+    for (int i = 0; i < 6; i++) {
+        place(engine, i, i, 5 - i, i, (i % 3 + 1) << 6);
+    }
+    engine.attachJournal(&journal);
+    journal.endTick();
+
+    byte before[216];
+    for (int i = 0; i < 216; i++) {
+        before[i] = engine.getLED(i / 36, (i / 6) % 6, i % 6);
+    }
+
+    for (int tick = 0; tick < 30; tick++) {
+        engine.moveSprite(tick % 6, (tick * 3 % 6) << 3);
+        journal.endTick();
+    }
+
+    check(journal.rewind(30) == 30, "the whole game rewinds");
+
+    bool same = true;
+    for (int i = 0; i < 216; i++) {
+        same = same && before[i] == engine.getLED(i / 36, (i / 6) % 6, i % 6);
+    }
+    check(same, "rewinding to the start puts every sprite back");
+
+    printf("test_journal: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
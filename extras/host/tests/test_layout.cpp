@@ -0,0 +1,180 @@
+/*
+* test_layout.cpp - Chained and parallel cubes shift out each cube's own stream.
+*/
+#include <stdio.h>
+#include <vector>
+#include "CubeEngine.h"
+#include "CubePins.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+// One latched pass: the data port at each rise of the clock, and the
+// layer powered after it
+struct Pass
+{
+    std::vector<byte> clocks;
+    int layer;
+};
+
+// A pin map that records the passes rather than driving pins
+// It models PORTC with the default wiring: latch on bit 1, data on bit 2
+// and clock on bit 3, so the chains' data pins can go on bits 4 and 5.
+struct RecordingPins
+{
+    static byte port;
+    static std::vector<Pass> passes;
+    static Pass current;
+
+    static const byte LATCH = B00000010;
+    static const byte DATA  = B00000100;
+    static const byte CLOCK = B00001000;
+
+    static void setup(CubeEngine *) {
+        port = 0;
+        passes.clear();
+        current = Pass();
+    }
+
+    static void latchLow(CubeEngine *)  { port &= ~LATCH; }
+    static void latchHigh(CubeEngine *) {
+        port |= LATCH;
+        passes.push_back(current);
+        current = Pass();
+    }
+    static void dataLow(CubeEngine *)   { port &= ~DATA; }
+    static void dataHigh(CubeEngine *)  { port |= DATA; }
+    static void clockLow(CubeEngine *)  { port &= ~CLOCK; }
+    static void clockHigh(CubeEngine *engine) { writeDataPort(engine, port | CLOCK); }
+
+    static byte readDataPort(CubeEngine *) { return port; }
+    static void writeDataPort(CubeEngine *, byte value) {
+        if ((port & CLOCK) == 0 && (value & CLOCK) != 0) {
+            current.clocks.push_back(value);
+        }
+        port = value;
+    }
+    static byte clockOnDataPort(CubeEngine *) { return CLOCK; }
+
+    static void layersOff(CubeEngine *) {}
+    static void layerOn(CubeEngine *, byte layer) {
+        passes.back().layer = layer;
+    }
+
+    static byte chainPort() { return PC; }
+    static byte chainReserved() { return LATCH | CLOCK; }
+};
+
+byte RecordingPins::port;
+std::vector<Pass> RecordingPins::passes;
+Pass RecordingPins::current;
+
+// Colours for one cube
+static void fill(byte *colours) {
+    for (int i = 0; i < 216; i++) {
+        colours[i] = random(4) << 6;
+    }
+}
+
+// Draws a cube's colours
+static void draw(CubeEngine &engine, byte cube, const byte *colours) {
+    for (int i = 0; i < 216; i++) {
+        engine.setLED(i / 36, (i / 6) % 6, (cube * 6) + (i % 6), colours[i]);
+    }
+}
+
+// Records twelve passes, two per layer
+static std::vector<Pass> record(CubeEngine &engine) {
+
+    // Leave out the blanking done when the engine was set up
+    RecordingPins::passes.clear();
+    RecordingPins::current = Pass();
+
+    for (int i = 0; i < 12; i++) {
+        engine.mplex();
+    }
+    return RecordingPins::passes;
+}
+
+// Returns one data bit of each clock in a run of a pass
+static std::vector<bool> stream(const Pass &pass, int first, int count, byte bit) {
+    std::vector<bool> bits;
+    for (int i = first; i < first + count; i++) {
+        bits.push_back((pass.clocks[i] & bit) != 0);
+    }
+    return bits;
+}
+
+int main() {
+
+    static byte frames[54];
+    byte colours[2][216];
+    int dataPins[2] = {A2, A4};
+
+    for (int round = 0; round < 20; round++) {
+
+        fill(colours[0]);
+        fill(colours[1]);
+
+        // Each cube on its own
+        std::vector<Pass> single[2];
+        for (int cube = 0; cube < 2; cube++) {
+            CubeEngine engine((RecordingPins()));
+            engine.setEqualisation(NULL);
+            draw(engine, 0, colours[cube]);
+            single[cube] = record(engine);
+        }
+
+        // Both on one chain, the second cube furthest along it
+        CubeEngine chained((RecordingPins()));
+        chained.setEqualisation(NULL);
+        chained.setCubeCount(2, frames);
+        draw(chained, 0, colours[0]);
+        draw(chained, 1, colours[1]);
+        std::vector<Pass> both = record(chained);
+
+        bool same = both.size() == 12 && single[0].size() == 12 && single[1].size() == 12;
+        for (size_t p = 0; same && p < 12; p++) {
+            same = both[p].clocks.size() == 216 && single[0][p].clocks.size() == 108 &&
+                   both[p].layer == single[0][p].layer && both[p].layer == single[1][p].layer &&
+                   stream(both[p], 0, 108, RecordingPins::DATA) == stream(single[1][p], 0, 108, RecordingPins::DATA) &&
+                   stream(both[p], 108, 108, RecordingPins::DATA) == stream(single[0][p], 0, 108, RecordingPins::DATA);
+        }
+        check(same, "a chain of two cubes shifts out the second cube's stream, then the first's");
+
+        // Each cube on a chain of its own, blanked when the second cube
+        // is added
+        CubeEngine parallel((RecordingPins()));
+        parallel.setEqualisation(NULL);
+        check(parallel.setShiftChains(2, dataPins), "two chains fit beside the latch and clock");
+        RecordingPins::current = Pass();
+        parallel.setCubeCount(2, frames);
+
+        bool blank = RecordingPins::current.clocks.size() >= 216;
+        for (size_t i = 0; i < RecordingPins::current.clocks.size(); i++) {
+            blank = blank && (RecordingPins::current.clocks[i] & B00010100) == B00010100;
+        }
+        check(blank, "blanking shifts off into every chain");
+
+        draw(parallel, 0, colours[0]);
+        draw(parallel, 1, colours[1]);
+        both = record(parallel);
+
+        same = both.size() == 12;
+        for (size_t p = 0; same && p < 12; p++) {
+            same = both[p].clocks.size() == 108 && both[p].layer == single[0][p].layer &&
+                   stream(both[p], 0, 108, B00000100) == stream(single[0][p], 0, 108, RecordingPins::DATA) &&
+                   stream(both[p], 0, 108, B00010000) == stream(single[1][p], 0, 108, RecordingPins::DATA);
+        }
+        check(same, "two parallel chains each shift out their own cube's stream");
+    }
+
+    printf("test_layout: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
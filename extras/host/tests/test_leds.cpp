@@ -0,0 +1,129 @@
+/*
+* test_leds.cpp - setLEDs() matches setLED() in any order, and how long each takes.
+*/
+#include <stdio.h>
+#include <chrono>
+#include "CubeEngine.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+// Shuffles a list of LED numbers
+static void shuffle(unsigned int *leds, int count) {
+    for (int i = count - 1; i > 0; i--) {
+        int j = random(i + 1);
+        unsigned int swap = leds[i];
+        leds[i] = leds[j];
+        leds[j] = swap;
+    }
+}
+
+// Sets a list through setLED(), one LED at a time
+static void setEach(CubeEngine &engine, const unsigned int *leds, const byte *colours, int count) {
+    for (int i = 0; i < count; i++) {
+        unsigned int led = leds[i] % 216;
+        engine.setLED(led / 36, (led / 6) % 6, ((leds[i] / 216) * 6) + (led % 6), colours[i]);
+    }
+}
+
+// Returns true if two engines show the same LEDs and lit counts
+static bool same(CubeEngine &a, CubeEngine &b, int cubes) {
+    for (int i = 0; i < cubes * 216; i++) {
+        int led = i % 216;
+        if (a.getLED(led / 36, (led / 6) % 6, ((i / 216) * 6) + (led % 6)) !=
+            b.getLED(led / 36, (led / 6) % 6, ((i / 216) * 6) + (led % 6))) {
+            return false;
+        }
+    }
+    for (byte layer = 0; layer < 6; layer++) {
+        if (a.getLitCount(layer, a.PASS_RED) != b.getLitCount(layer, b.PASS_RED) ||
+            a.getLitCount(layer, a.PASS_BLUE_GREEN) != b.getLitCount(layer, b.PASS_BLUE_GREEN)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Nanoseconds per LED to set a list, the best of five runs
+static double timeList(CubeEngine &engine, const unsigned int *leds, const byte *colours, int count, bool batched) {
+
+    const int rounds = 20000;
+    double best = 0;
+
+    for (int run = 0; run < 5; run++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for (int round = 0; round < rounds; round++) {
+            if (batched) {
+                engine.setLEDs(leds, colours, count);
+            } else {
+                setEach(engine, leds, colours, count);
+            }
+        }
+
+        std::chrono::duration<double, std::nano> taken = std::chrono::steady_clock::now() - start;
+        double perLED = taken.count() / ((double) rounds * count);
+        if (run == 0 || perLED < best) {
+            best = perLED;
+        }
+    }
+
+    return best;
+}
+
+int main() {
+
+    CubeHost host = {NULL, NULL, NULL, NULL, NULL};
+    static byte framesA[54 * 3], framesB[54 * 3];
+
+    unsigned int leds[1200];
+    byte colours[1200];
+
+    // Random lists over one to four cubes, with repeats, in any order
+    for (int round = 0; round < 500; round++) {
+
+        int cubes = 1 + (round % 4);
+        int count = random(1, 1200);
+
+        CubeEngine each(&host);
+        CubeEngine batched(&host);
+        each.setCubeCount(cubes, framesA);
+        batched.setCubeCount(cubes, framesB);
+
+        for (int i = 0; i < count; i++) {
+            leds[i]    = random(cubes * 216);
+            colours[i] = random(4) << 6;
+        }
+        if (round % 2 == 0) {
+            setEach(each, leds, colours, count);
+            setEach(batched, leds, colours, count);
+        }
+
+        setEach(each, leds, colours, count);
+        batched.setLEDs(leds, colours, count);
+        check(same(each, batched, cubes), "setLEDs() sets the same LEDs as setLED()");
+    }
+
+    // A full frame of one cube, in storage order and shuffled
+    CubeEngine engine(&host);
+    for (int i = 0; i < 216; i++) {
+        leds[i]    = i;
+        colours[i] = random(4) << 6;
+    }
+
+    double each    = timeList(engine, leds, colours, 216, false);
+    double ordered = timeList(engine, leds, colours, 216, true);
+    shuffle(leds, 216);
+    double shuffled = timeList(engine, leds, colours, 216, true);
+
+    printf("per LED: setLED() %.1f ns, setLEDs() %.1f ns in order, %.1f ns shuffled\n", each, ordered, shuffled);
+
+    printf("test_leds: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+/*
+* test_life.cpp - Both CubeLife kernels match a cell-by-cell 3D life, and how fast each is.
+*/
+#include <stdio.h>
+#include <chrono>
+
+// The Makefile builds CubeLife.cpp a second time with the 8-bit kernel
+// and the class renamed, so both kernels can be run side by side
+#define CubeLife CubeLifeBytes
+#include "CubeLife.h"
+#undef CubeLife
+#undef CubeLife_h
+#include "CubeLife.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+// One generation of 3D life, a cell at a time
+static void naiveStep(bool cells[6][6][6], unsigned long birth, unsigned long survive, bool wrap) {
+
+    bool next[6][6][6];
+
+    for (int x = 0; x < 6; x++) {
+        for (int y = 0; y < 6; y++) {
+            for (int z = 0; z < 6; z++) {
+
+                int neighbours = 0;
+                for (int dx = -1; dx <= 1; dx++) {
+                    for (int dy = -1; dy <= 1; dy++) {
+                        for (int dz = -1; dz <= 1; dz++) {
+                            int nx = x + dx, ny = y + dy, nz = z + dz;
+                            if (dx == 0 && dy == 0 && dz == 0) {
+                                continue;
+                            }
+                            if (wrap) {
+                                nx = (nx + 6) % 6;
+                                ny = (ny + 6) % 6;
+                                nz = (nz + 6) % 6;
+                            } else if (nx < 0 || nx > 5 || ny < 0 || ny > 5 || nz < 0 || nz > 5) {
+                                continue;
+                            }
+                            neighbours += cells[nx][ny][nz];
+                        }
+                    }
+                }
+
+                unsigned long rule = cells[x][y][z] ? survive : birth;
+                next[x][y][z] = (rule >> neighbours) & 1;
+            }
+        }
+    }
+
+    memcpy(cells, next, sizeof(next));
+}
+
+// Returns true if a CubeLife holds the same cells as the reference
+template <class Life>
+static bool matches(Life &life, bool cells[6][6][6]) {
+    for (int x = 0; x < 6; x++) {
+        for (int y = 0; y < 6; y++) {
+            for (int z = 0; z < 6; z++) {
+                if (life.getCell(x, y, z) != cells[x][y][z]) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Microseconds per generation, the best of five runs
+template <class Life>
+static double timeSteps(Life &life) {
+
+    const int generations = 20000;
+    double best = 0;
+
+    for (int run = 0; run < 5; run++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < generations; i++) {
+            life.step();
+        }
+
+        std::chrono::duration<double, std::micro> taken = std::chrono::steady_clock::now() - start;
+        double perStep = taken.count() / generations;
+        if (run == 0 || perStep < best) {
+            best = perStep;
+        }
+    }
+
+    return best;
+}
+
+int main() {
+
+    CubeHost host = {NULL, NULL, NULL, NULL, NULL};
+    CubeEngine engine(&host);
+    CubeLife words(engine);
+    CubeLifeBytes bytes(engine);
+    bool cells[6][6][6];
+
+    // Random rules and starts, with and without wrap
+    for (int round = 0; round < 400; round++) {
+
+        unsigned long birth   = (round == 0) ? CubeLife::RULE_4555_BIRTH : (unsigned long) random(0x7FFFFFFL);
+        unsigned long survive = (round == 0) ? CubeLife::RULE_4555_SURVIVE : (unsigned long) random(0x7FFFFFFL);
+        bool wrap = round & 1;
+        int density = random(10, 60);
+
+        words.setRules(birth, survive);
+        bytes.setRules(birth, survive);
+        words.setWrap(wrap);
+        bytes.setWrap(wrap);
+
+        for (int x = 0; x < 6; x++) {
+            for (int y = 0; y < 6; y++) {
+                for (int z = 0; z < 6; z++) {
+                    cells[x][y][z] = random(100) < density;
+                    words.setCell(x, y, z, cells[x][y][z]);
+                    bytes.setCell(x, y, z, cells[x][y][z]);
+                }
+            }
+        }
+
+        bool same = true;
+        for (int generation = 0; generation < 8; generation++) {
+            naiveStep(cells, birth, survive, wrap);
+            words.step();
+            bytes.step();
+            same = same && matches(words, cells) && matches(bytes, cells);
+        }
+
+        check(same, wrap ? "both kernels match the reference with wrap" : "both kernels match the reference");
+    }
+
+    // A random soup under the 4555 rules, wrapped, for the timing
+    words.setRules(CubeLife::RULE_4555_BIRTH, CubeLife::RULE_4555_SURVIVE);
+    bytes.setRules(CubeLife::RULE_4555_BIRTH, CubeLife::RULE_4555_SURVIVE);
+    words.setWrap(true);
+    bytes.setWrap(true);
+    for (int x = 0; x < 6; x++) {
+        for (int y = 0; y < 6; y++) {
+            for (int z = 0; z < 6; z++) {
+                cells[x][y][z] = random(3) == 0;
+                words.setCell(x, y, z, cells[x][y][z]);
+                bytes.setCell(x, y, z, cells[x][y][z]);
+            }
+        }
+    }
+
+    double wordTime = timeSteps(words);
+    double byteTime = timeSteps(bytes);
+
+    const int naiveGenerations = 2000;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < naiveGenerations; i++) {
+        naiveStep(cells, CubeLife::RULE_4555_BIRTH, CubeLife::RULE_4555_SURVIVE, true);
+    }
+    std::chrono::duration<double, std::micro> taken = std::chrono::steady_clock::now() - start;
+
+    printf("per generation: 64-bit kernel %.2f us, 8-bit kernel %.2f us, cell by cell %.2f us\n",
+           wordTime, byteTime, taken.count() / naiveGenerations);
+
+    printf("test_life: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
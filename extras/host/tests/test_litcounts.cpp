@@ -0,0 +1,128 @@
+/*
+* test_litcounts.cpp - The kept lit counts match a recount after any mix of writes.
+*/
+#include <stdio.h>
+#include "CubeEngine.h"
+#include "CubeParticles.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+static const byte COLOURS[4] = {CubeEngine::AV_OFF, CubeEngine::AV_RED, CubeEngine::AV_GREEN, CubeEngine::AV_BLUE};
+
+// Returns true if every layer's kept counts match the LEDs lit on it
+static bool countsMatch(CubeEngine &engine, int cubes) {
+    for (int layer = 0; layer < 6; layer++) {
+        unsigned int red = 0;
+        unsigned int blueGreen = 0;
+
+        for (int row = 0; row < 6; row++) {
+            for (int column = 0; column < cubes * 6; column++) {
+                byte colour = engine.getLED(layer, row, column);
+                red       += (colour == engine.AV_RED) ? 1 : 0;
+                blueGreen += (colour == engine.AV_GREEN || colour == engine.AV_BLUE) ? 1 : 0;
+            }
+        }
+
+        if (engine.getLitCount(layer, engine.PASS_RED) != red ||
+            engine.getLitCount(layer, engine.PASS_BLUE_GREEN) != blueGreen) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Makes one random change through one of the writers
+static void change(CubeEngine &engine, CubeParticles &particles, int cubes) {
+
+    unsigned int leds[40];
+    byte colours[40];
+    int count = random(40) + 1;
+
+    switch (random(8)) {
+        case 0:
+            engine.setLED(random(6), random(6), random(cubes * 6), COLOURS[random(4)]);
+            break;
+        case 1:
+            for (int i = 0; i < count; i++) {
+                leds[i] = random(cubes * 216);
+            }
+            engine.setLEDs(leds, count, COLOURS[random(4)]);
+            break;
+        case 2:
+            for (int i = 0; i < count; i++) {
+                leds[i]    = random(cubes * 216);
+                colours[i] = COLOURS[random(4)];
+            }
+            engine.setLEDs(leds, colours, count);
+            break;
+        case 3:
+            // Voxels, with the same LED often listed twice
+            for (int i = 0; i < count; i++) {
+                unsigned int led = (i > 0 && random(3) == 0) ? (leds[i - 1] & 0x3FFF) : random(cubes * 216);
+                leds[i] = led | ((unsigned int) COLOURS[random(4)] << 8);
+            }
+            engine.setLEDs(leds, count);
+            break;
+        case 4:
+            engine.setRandomSpritePosition(random(CUBE_SPRITE_COUNT - 1) + 1);
+            break;
+        case 5:
+            engine.moveSprite(random(CUBE_SPRITE_COUNT - 1) + 1, random(14) << 3);
+            break;
+        case 6:
+            particles.burst(random(6), random(6), random(6), COLOURS[random(3) + 1], random(6) + 1, random(8) + 1);
+            particles.render();
+            break;
+        default:
+            particles.step();
+            particles.render();
+            if (random(10) == 0) {
+                particles.clear();
+            }
+            break;
+    }
+}
+
+int main() {
+
+    randomSeed(45);
+
+    for (int cubes = 1; cubes <= 3; cubes++) {
+
+        CubeHost host = {NULL, NULL, NULL, NULL, NULL};
+        CubeEngine engine(&host);
+        CubeParticle pool[12];
+        CubeParticles particles(engine, pool, 12);
+
+        byte frames[54 * 2];
+        check(engine.setCubeCount(cubes, frames), "the cubes can be set");
+
+        // Sprites to move about
+        for (int i = 1; i < CUBE_SPRITE_COUNT; i++) {
+            engine.setRandomSpriteColour(i);
+            engine.setSpriteAttribute(i, engine.AN_CUBE, random(cubes));
+            engine.setRandomSpritePosition(i);
+            engine.setSpriteAttribute(i, engine.AN_VISIBILITY, random(2) ? engine.AV_VISIBLE : engine.AV_INVISIBLE);
+        }
+
+        bool matched = countsMatch(engine, cubes);
+        for (int i = 0; i < 20000 && matched; i++) {
+            change(engine, particles, cubes);
+            matched = countsMatch(engine, cubes);
+        }
+
+        char what[60];
+        snprintf(what, sizeof(what), "the counts match a recount on %d cubes", cubes);
+        check(matched, what);
+    }
+
+    printf("test_litcounts: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,244 @@
+/*
+* test_lockstep.cpp - Two cubes in lockstep stay in step over a bad link.
+*/
+#include <stdio.h>
+#include <deque>
+#include "CubeEngine.h"
+#include "CubeLockstep.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+// Milliseconds since the start of a run
+static unsigned long now = 0;
+
+// Noise on the link, from a generator of its own so the games' random
+// numbers aren't touched
+static unsigned long noise = 1;
+
+static unsigned long nextNoise() {
+    noise ^= (noise << 13) & 0xFFFFFFFFUL;
+    noise ^= noise >> 17;
+    noise ^= (noise << 5) & 0xFFFFFFFFUL;
+    return noise;
+}
+
+// One direction of the link
+// Each byte arrives 'latency' ms after it is written, unless it is lost
+// or damaged on the way. Rates are per ten thousand bytes.
+struct Pipe
+{
+    std::deque<unsigned long> times;
+    std::deque<byte> bytes;
+    unsigned long latency;
+    unsigned int lossRate;
+    unsigned int damageRate;
+};
+
+// One cube's end of the link
+class PipeEnd : public Stream
+{
+    public:
+
+        PipeEnd(Pipe &in, Pipe &out) : in(&in), out(&out) {}
+
+        size_t write(uint8_t value) {
+            if (nextNoise() % 10000 < this->out->lossRate) {
+                return 1;
+            }
+            if (nextNoise() % 10000 < this->out->damageRate) {
+                value ^= 1 << (nextNoise() & 7);
+            }
+            this->out->times.push_back(now + this->out->latency);
+            this->out->bytes.push_back(value);
+            return 1;
+        }
+
+        int available() {
+            return (!this->in->times.empty() && this->in->times.front() <= now) ? 1 : 0;
+        }
+
+        int read() {
+            if (!this->available()) {
+                return -1;
+            }
+            int value = this->in->bytes.front();
+            this->in->times.pop_front();
+            this->in->bytes.pop_front();
+            return value;
+        }
+
+        int peek() {
+            return this->available() ? this->in->bytes.front() : -1;
+        }
+
+    private:
+
+        Pipe *in, *out;
+};
+
+// A game with moving sprites, steered by both players and the shared
+// random numbers
+static void game(CubeEngine &engine, const byte *inputs) {
+
+    if (engine.getMillis() == 0) {
+        for (int i = 1; i < 10; i++) {
+            engine.setRandomSpritePosition(i);
+            engine.setRandomSpriteColour(i);
+            engine.setRandomSpriteDirection(i);
+            engine.setSpriteAttribute(i, engine.AN_MOVE, engine.AV_MOVE);
+            engine.setSpriteAttribute(i, engine.AN_SPEED, engine.AV_SPEED6);
+        }
+    }
+
+    for (int p = 0; p < 2; p++) {
+        if (inputs[p] != 0) {
+            engine.setSpriteAttribute(1 + p, engine.AN_DIRECTION, (inputs[p] % 14) << 3);
+        }
+    }
+
+    if (engine.getRandom(10) == 0) {
+        engine.setRandomSpriteDirection(3);
+    }
+
+    engine.autoMoveSprites(engine.getMillis());
+}
+
+static const unsigned long RUN_MILLIS = 60000;
+static const unsigned long TICK_MILLIS = 20;
+static const int MAX_TICKS = 4096;
+
+struct Result
+{
+    unsigned long ticks[2];
+    unsigned long resyncs[2];
+    unsigned long mismatches;
+    unsigned long desyncTick;
+    unsigned long resyncTick;
+    unsigned long resyncMillis;
+};
+
+// Runs two cubes for a minute of link time
+// 'desyncAt' is when player 1's game is damaged, or 0 for never. Ticks
+// are compared before that and from player 1's last resync on.
+static Result run(unsigned long latency, unsigned int lossRate, unsigned int damageRate, unsigned long desyncAt) {
+
+    static byte checks[2][MAX_TICKS];
+    static bool seen[2][MAX_TICKS];
+
+    for (int p = 0; p < 2; p++) {
+        for (int t = 0; t < MAX_TICKS; t++) {
+            seen[p][t] = false;
+        }
+    }
+
+    Pipe ab = { std::deque<unsigned long>(), std::deque<byte>(), latency, lossRate, damageRate };
+    Pipe ba = ab;
+    PipeEnd endA(ba, ab);
+    PipeEnd endB(ab, ba);
+
+    CubeEngine a(A1, A3, A2, 2, 3, 4, 5, 6, 7);
+    CubeEngine b(A1, A3, A2, 2, 3, 4, 5, 6, 7);
+    CubeLockstep cubes[2] = { CubeLockstep(a, endA, 0), CubeLockstep(b, endB, 1) };
+
+    for (int p = 0; p < 2; p++) {
+        cubes[p].begin(42, TICK_MILLIS, 2, game);
+    }
+
+    Result result = { { 0, 0 }, { 0, 0 }, 0, MAX_TICKS, 0, 0 };
+    unsigned long players = 1;
+    noise = 1;
+
+    for (now = 0; now < RUN_MILLIS; now++) {
+
+        // Player 1 is switched on a little later
+        if (now == 7) {
+            players = 2;
+        }
+
+        for (unsigned long p = 0; p < players; p++) {
+            byte input = (nextNoise() % 4 == 0) ? nextNoise() % 14 : 0;
+
+            if (cubes[p].update(input, now) && cubes[p].getTick() < MAX_TICKS) {
+                checks[p][cubes[p].getTick()] = cubes[p].getChecksum();
+                seen[p][cubes[p].getTick()]   = true;
+            }
+        }
+
+        if (cubes[1].getResyncs() != result.resyncs[1]) {
+            result.resyncs[1]   = cubes[1].getResyncs();
+            result.resyncTick   = cubes[1].getTick();
+            result.resyncMillis = now - desyncAt;
+        }
+
+        if (desyncAt != 0 && now == desyncAt) {
+            b.setLED(0, 0, 0, b.AV_RED);
+            b.setLED(5, 5, 5, b.AV_BLUE);
+            result.desyncTick = cubes[1].getTick();
+        }
+    }
+
+    for (int t = 0; t < MAX_TICKS; t++) {
+        bool compared = (unsigned long) t < result.desyncTick || (result.resyncs[1] > 0 && (unsigned long) t >= result.resyncTick);
+
+        if (compared && seen[0][t] && seen[1][t] && checks[0][t] != checks[1][t]) {
+            result.mismatches += 1;
+        }
+    }
+
+    for (int p = 0; p < 2; p++) {
+        result.ticks[p]   = cubes[p].getTick();
+        result.resyncs[p] = cubes[p].getResyncs();
+    }
+
+    printf("latency %lu ms, loss %u.%02u%%, damage %u.%02u%%: ticks %lu/%lu, resyncs %lu/%lu",
+           latency, lossRate / 100, lossRate % 100, damageRate / 100, damageRate % 100,
+           result.ticks[0], result.ticks[1], result.resyncs[0], result.resyncs[1]);
+    if (result.resyncs[1] > 0) {
+        printf(" (last %lu ms after the desync)", result.resyncMillis);
+    }
+    printf(", %lu mismatched\n", result.mismatches);
+
+    return result;
+}
+
+int main() {
+
+    unsigned long fullRun = RUN_MILLIS / TICK_MILLIS;
+
+    // A clean link never needs a resync
+    Result clean = run(3, 0, 0, 0);
+    check(clean.ticks[0] >= fullRun - 10 && clean.ticks[1] >= fullRun - 10, "a clean link keeps full speed");
+    check(clean.resyncs[0] == 0 && clean.resyncs[1] == 0, "a clean link never resyncs");
+    check(clean.mismatches == 0, "a clean link keeps the games the same");
+
+    // Lost bytes are sent again
+    Result lossy = run(5, 300, 0, 0);
+    check(lossy.ticks[0] >= fullRun / 2 && lossy.ticks[1] >= fullRun / 2, "3% loss doesn't stall the game");
+    check(lossy.mismatches == 0, "3% loss keeps the games the same");
+
+    // A damaged game is replaced by player 0's, over a lossy link
+    Result desync = run(5, 300, 0, 20000);
+    check(desync.resyncs[0] >= 1 && desync.resyncs[1] >= 1, "a desync is resynced");
+    check(desync.resyncTick > desync.desyncTick, "the resync comes after the desync");
+    check(desync.resyncMillis < 2000, "the resync is through within two seconds");
+    check(desync.ticks[1] > desync.resyncTick + 1000 && desync.ticks[0] > desync.resyncTick + 1000,
+          "the game carries on after a resync");
+    check(desync.mismatches == 0, "the games are the same after a resync");
+
+    // Damaged bytes are caught by the packet checks
+    Result damaged = run(5, 300, 50, 20000);
+    check(damaged.resyncs[1] >= 1, "a desync is resynced over a damaging link");
+    check(damaged.resyncMillis < 5000, "the last resync is through within five seconds");
+    check(damaged.ticks[1] > damaged.resyncTick + 1000, "the game carries on over a damaging link");
+    check(damaged.mismatches == 0, "the games are the same over a damaging link");
+
+    printf("test_lockstep: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+/*
+* test_particles.cpp - Particles clean up after themselves and nothing else.
+*/
+#include <stdio.h>
+#include "CubeEngine.h"
+#include "CubeParticles.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+// Returns the number of lit LEDs on the first cube
+static int countLit(CubeEngine &engine) {
+    int lit = 0;
+
+    for (int x = 0; x < 6; x++) {
+        for (int y = 0; y < 6; y++) {
+            for (int z = 0; z < 6; z++) {
+                if (engine.getLED(x, y, z) != engine.AV_OFF) {
+                    lit += 1;
+                }
+            }
+        }
+    }
+
+    return lit;
+}
+
+int main() {
+
+    CubeEngine engine(A1, A3, A2, 2, 3, 4, 5, 6, 7);
+    CubeParticle pool[16];
+    CubeParticles particles(engine, pool, 16);
+
+    // Two particles on one LED, in palette slot 0, which doesn't move
+    particles.emit(2, 2, 2, engine.AV_RED, 0, 7);
+    particles.emit(2, 2, 2, engine.AV_BLUE, 0, 7);
+    particles.render();
+    check(engine.getLED(2, 2, 2) == engine.AV_BLUE, "the later particle shows");
+
+    particles.step();
+    check(engine.getLED(2, 2, 2) == engine.AV_OFF, "step() takes both overlapping particles off");
+
+    particles.render();
+    particles.clear();
+    check(engine.getLED(2, 2, 2) == engine.AV_OFF, "clear() takes overlapping particles off");
+    check(countLit(engine) == 0, "nothing is left lit after clear()");
+
+    // Overlapping particles that die
+    particles.emit(3, 3, 3, engine.AV_GREEN, 0, 1);
+    particles.emit(3, 3, 3, engine.AV_RED, 0, 1);
+    particles.render();
+    particles.step();
+    particles.render();
+    check(particles.getCount() == 0 && engine.getLED(3, 3, 3) == engine.AV_OFF, "dead particles leave no trace");
+
+    // The game draws over a particle in the same colour, then the
+    // particle moves on (slot 4 is right, along x)
+    particles.emit(1, 1, 1, engine.AV_RED, 4, 7);
+    particles.render();
+    engine.setLED(1, 1, 1, engine.AV_RED);
+    particles.step();
+    particles.render();
+    check(engine.getLED(1, 1, 1) == engine.AV_RED, "a game LED drawn over a particle in its colour stays");
+    check(engine.getLED(2, 1, 1) == engine.AV_RED, "the particle moved on");
+
+    // The same, in another colour and through the batch writer
+    particles.clear();
+    engine.setLED(1, 1, 1, engine.AV_OFF);
+    particles.emit(4, 4, 4, engine.AV_GREEN, 0, 7);
+    particles.render();
+    unsigned int voxel = CubeEngine::getVoxel(4, 4, 4, engine.AV_GREEN);
+    engine.setLEDs(&voxel, 1);
+    particles.clear();
+    check(engine.getLED(4, 4, 4) == engine.AV_GREEN, "a batched LED drawn over a particle stays");
+    engine.setLED(4, 4, 4, engine.AV_OFF);
+
+    // A lit LED is never covered or cleared
+    engine.setLED(0, 5, 0, engine.AV_BLUE);
+    particles.emit(0, 5, 0, engine.AV_RED, 0, 7);
+    particles.render();
+    check(engine.getLED(0, 5, 0) == engine.AV_BLUE, "a particle doesn't cover a lit LED");
+    particles.clear();
+    check(engine.getLED(0, 5, 0) == engine.AV_BLUE, "a particle doesn't clear a lit LED");
+    engine.setLED(0, 5, 0, engine.AV_OFF);
+
+    // Many particles, stepped until they die
+    engine.setLED(5, 0, 5, engine.AV_GREEN);
+    for (int i = 0; i < 40; i++) {
+        particles.burst(2, 3, 2, (i & 1) ? engine.AV_RED : engine.AV_BLUE, 4, 1 + (i % 7));
+        particles.render();
+        particles.step();
+    }
+    for (int i = 0; i < 8; i++) {
+        particles.render();
+        particles.step();
+    }
+    check(particles.getCount() == 0, "every particle dies");
+    check(countLit(engine) == 1 && engine.getLED(5, 0, 5) == engine.AV_GREEN, "only the game's LED is left");
+
+    printf("test_particles: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
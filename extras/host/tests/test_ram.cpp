@@ -0,0 +1,32 @@
+/*
+* test_ram.cpp - An engine stays within its RAM budget.
+*
+* Built once for each sprite pool size the Makefile lists. The budget on
+* AVR is checked by CubeEngine::checkRamBudget(), this is the same check
+* for a 64-bit host, where longs and pointers are 8 bytes.
+*/
+#include <stdio.h>
+#include "CubeEngine.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+int main() {
+
+    unsigned long size = sizeof(CubeEngine);
+
+    if (sizeof(void *) == 8 && sizeof(long) == 8) {
+        // 464 bytes with 25 sprites, and 8 more for each extra sprite. The
+        // ports and masks of a runtime wiring aren't part of it.
+        check(size <= 464 + ((CUBE_SPRITE_COUNT - 25) * 8), "an engine fits its budget");
+    }
+
+    printf("test_ram: %s (%d sprites, %lu bytes)\n", failures ? "FAILED" : "ok", CUBE_SPRITE_COUNT, size);
+    return failures ? 1 : 0;
+}
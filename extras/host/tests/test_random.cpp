@@ -0,0 +1,64 @@
+/*
+* test_random.cpp - random() gives the same numbers as on a board.
+*/
+#include <stdio.h>
+#include "Arduino.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+// avr-libc's random() is x = 16807 * x mod (2^31 - 1), from 1 until
+// seeded. These are the first numbers from 1, and the 10000th, which
+// Park and Miller give as the check of a correct implementation.
+static const long MINIMAL_STANDARD[10] = {
+    16807L, 282475249L, 1622650073L, 984943658L, 1144108930L,
+    470211272L, 101027544L, 1457850878L, 1458777923L, 2007237709L
+};
+static const long MINIMAL_STANDARD_10000 = 1043618065L;
+
+// random(howbig) is random() % howbig, so anything above the largest
+// number returns it whole
+static const long WHOLE = 0x7FFFFFFFL;
+
+int main() {
+
+    // Unseeded, as after reset
+    bool same = true;
+    for (int i = 0; i < 10; i++) {
+        same = same && random(WHOLE) == MINIMAL_STANDARD[i];
+    }
+    check(same, "the sequence from reset matches avr-libc");
+
+    randomSeed(1);
+    long value = 0;
+    for (int i = 0; i < 10000; i++) {
+        value = random(WHOLE);
+    }
+    check(value == MINIMAL_STANDARD_10000, "the 10000th number matches avr-libc");
+
+    // The Arduino core's ranges
+    randomSeed(1);
+    check(random(100) == 7, "random(100) is the number mod 100");
+    check(random(1000) == 249, "random(1000) is the number mod 1000");
+    check(random(10, 20) == 13, "random(10, 20) adds the low end");
+    check(random(0) == 0, "random(0) is 0");
+    check(random(5, 5) == 5, "an empty range gives its low end");
+
+    // randomSeed(0) is ignored, as on a board
+    randomSeed(1);
+    randomSeed(0);
+    check(random(WHOLE) == MINIMAL_STANDARD[0], "randomSeed(0) leaves the generator alone");
+
+    // A seed starts the sequence from there
+    randomSeed(MINIMAL_STANDARD[4]);
+    check(random(WHOLE) == MINIMAL_STANDARD[5], "a seed carries on from that number");
+
+    printf("test_random: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
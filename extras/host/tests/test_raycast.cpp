@@ -0,0 +1,98 @@
+/*
+* test_raycast.cpp - Lines of sight are the same both ways round.
+*/
+#include <stdio.h>
+#include "CubeEngine.h"
+#include "CubeRaycast.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+int main() {
+
+    CubeEngine engine(A1, A3, A2, 2, 3, 4, 5, 6, 7);
+    CubeRaycast rays(engine);
+
+    // The voxels on each line, found by blocking one voxel at a time, must
+    // be the same from either end
+    unsigned long lines = 0;
+    unsigned long asymmetric = 0;
+
+    for (int a = 0; a < 216; a++) {
+        for (int b = a + 1; b < 216; b++) {
+            bool same = true;
+
+            for (int v = 0; v < 216 && same; v++) {
+                rays.clear();
+                rays.setOccupied(v / 36, (v / 6) % 6, v % 6, true);
+
+                byte forwards  = rays.castLine(a / 36, (a / 6) % 6, a % 6, b / 36, (b / 6) % 6, b % 6);
+                byte backwards = rays.castLine(b / 36, (b / 6) % 6, b % 6, a / 36, (a / 6) % 6, a % 6);
+                same = (forwards == rays.NO_HIT) == (backwards == rays.NO_HIT);
+            }
+
+            lines += 1;
+            if (!same) {
+                asymmetric += 1;
+            }
+        }
+    }
+
+    printf("%lu lines, %lu not the same both ways\n", lines, asymmetric);
+    check(asymmetric == 0, "every line crosses the same voxels both ways");
+
+    // In a cluttered cube, sight is mutual and each end sees the hit
+    // nearest it
+    unsigned long blocked = 0;
+    unsigned long mismatched = 0;
+    unsigned long misplaced = 0;
+
+    for (int trial = 0; trial < 20000; trial++) {
+        if (trial % 100 == 0) {
+            rays.clear();
+            for (int v = 0; v < 216; v++) {
+                rays.setOccupied(v / 36, (v / 6) % 6, v % 6, random(100) < 25);
+            }
+        }
+
+        byte x0 = random(6), y0 = random(6), z0 = random(6);
+        byte x1 = random(6), y1 = random(6), z1 = random(6);
+
+        bool there = rays.lineOfSight(x0, y0, z0, x1, y1, z1);
+        bool back  = rays.lineOfSight(x1, y1, z1, x0, y0, z0);
+        if (there != back) {
+            mismatched += 1;
+        }
+
+        // The first hit from either end is no further from it than the
+        // first hit from the other end
+        byte forwards  = rays.castLine(x0, y0, z0, x1, y1, z1);
+        byte backwards = rays.castLine(x1, y1, z1, x0, y0, z0);
+        if (forwards != rays.NO_HIT) {
+            blocked += 1;
+
+            byte fx, fy, fz, bx, by, bz;
+            CubeRaycast::getPosition(forwards, &fx, &fy, &fz);
+            CubeRaycast::getPosition(backwards, &bx, &by, &bz);
+
+            int fromStart = abs(fx - x0) + abs(fy - y0) + abs(fz - z0);
+            int backStart = abs(bx - x0) + abs(by - y0) + abs(bz - z0);
+            if (fromStart > backStart) {
+                misplaced += 1;
+            }
+        }
+    }
+
+    printf("20000 casts, %lu blocked, %lu not mutual, %lu hits not nearest\n", blocked, mismatched, misplaced);
+    check(mismatched == 0, "line of sight is mutual");
+    check(misplaced == 0, "a cast stops at the hit nearest its start");
+
+    printf("test_raycast: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
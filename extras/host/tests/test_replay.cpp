@@ -0,0 +1,113 @@
+/*
+* test_replay.cpp - A recorded game replays bit for bit, and bad recordings fail.
+*/
+#include <stdio.h>
+#include <vector>
+#include "CubeRecorder.h"
+#include "CubeReplayHost.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+// Keeps the recording in memory
+struct Recording : public Print
+{
+    std::vector<byte> bytes;
+
+    size_t write(uint8_t value) {
+        this->bytes.push_back(value);
+        return 1;
+    }
+};
+
+// A game that reads the engine's clock and random numbers itself, rather
+// than the 'now' it is passed
+static void setup(CubeEngine &engine) {
+    for (int i = 1; i < 6; i++) {
+        engine.setSpriteAttribute(i, engine.AN_X, i);
+        engine.setSpriteAttribute(i, engine.AN_COLOUR, engine.AV_GREEN);
+        engine.setSpriteAttribute(i, engine.AN_VISIBILITY, engine.AV_VISIBLE);
+        engine.setSpriteAttribute(i, engine.AN_STATE, engine.AV_LIVE);
+        engine.setSpriteAttribute(i, engine.AN_MOVE, engine.AV_MOVE);
+        engine.setSpriteAttribute(i, engine.AN_SPEED, engine.AV_SPEED4);
+    }
+}
+
+static void step(CubeEngine &engine, unsigned long) {
+    for (int i = 1; i < 6; i++) {
+        if (engine.getRandom(8) == 0) {
+            engine.setRandomSpriteDirection(i);
+        }
+    }
+
+    engine.autoMoveSprites(engine.getMillis());
+    engine.setLED(engine.getRandom(6), engine.getRandom(6), engine.getRandom(6), engine.getRandom(4) << 6);
+}
+
+int main() {
+
+    // Record 300 frames, 20ms apart
+    CubeEngine engine(A1, A3, A2, 2, 3, 4, 5, 6, 7);
+    setup(engine);
+
+    Recording recording;
+    CubeRecorder recorder(engine, recording);
+    recorder.begin();
+    recorder.seed(2024);
+
+    for (int frame = 0; frame < 300; frame++) {
+        hostMicros += 20000;
+        step(engine, engine.getMillis());
+        recorder.frame();
+
+        if (frame == 150) {
+            recorder.seed(77);
+        }
+    }
+
+    const byte *stream = recording.bytes.data();
+    unsigned long length = recording.bytes.size();
+
+    // The replay runs at another time and with random() moved on
+    hostMicros += 123456789;
+    random(1000);
+
+    CubeReplayHost replayer(setup, step);
+    check(replayer.replay(stream, length), "the recording replays");
+    check(replayer.getFrameCount() == 300 && replayer.getMismatches() == 0, "every frame matches");
+
+    // Through a file, as the host replayer is used
+    FILE *out = fopen("build/test_replay.rec", "wb");
+    fwrite(stream, 1, length, out);
+    fclose(out);
+    check(replayer.replay("build/test_replay.rec"), "the recording replays from a file");
+    check(!replayer.replay("build/missing.rec"), "a missing file fails");
+
+    // Bad recordings fail rather than pass with no frames checked
+    std::vector<byte> bad(recording.bytes);
+    bad[2] += 1;
+    check(!replayer.replay(bad.data(), bad.size()) && replayer.getMismatches() == 1, "a bad header fails");
+
+    check(!replayer.replay(stream, length - 1) && replayer.getFrameCount() == 299, "a stream cut short fails");
+
+    bad = recording.bytes;
+    bad[4] ^= 1;
+    check(!replayer.replay(bad.data(), bad.size()), "a changed seed fails");
+
+    CubeEngine other(A1, A3, A2, 2, 3, 4, 5, 6, 7);
+    CubeReplay replay(stream, length);
+    replay.run(other, step);
+    check(replay.getMismatches() > 0 && replay.getFirstMismatch() == 0, "a game not set up fails from the first frame");
+
+    replayer.replay(stream, length);
+    replayer.report(stdout);
+
+    printf("test_replay: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,59 @@
+/*
+* test_snapshot.cpp - CubeSnapshot restores the newest save as the slots go round.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "CubeEngine.h"
+#include "CubeSnapshot.h"
+#include "EEPROM.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+int main() {
+
+    // A blank EEPROM
+    memset(hostEeprom, 0xFF, sizeof(hostEeprom));
+
+    CubeHost host = {NULL, NULL, NULL, NULL, NULL};
+    CubeEngine engine(&host);
+    CubeSnapshot snapshot(engine, 16, 3);
+
+    check(!snapshot.hasSnapshot(), "a blank EEPROM has no snapshot");
+
+    // Enough saves to go round the slots a few times
+    for (byte i = 0; i < 10; i++) {
+        engine.setSpriteAttribute(1, engine.AN_X, i % 6);
+        engine.setSpriteAttribute(1, engine.AN_Y, i / 6);
+        snapshot.save();
+
+        CubeEngine restored(&host);
+        CubeSnapshot loader(restored, 16, 3);
+
+        check(loader.hasSnapshot(), "a save leaves a snapshot");
+        check(loader.restore(), "a save can be restored");
+        check(restored.getSpriteAttribute(1, restored.AN_X) == i % 6 &&
+              restored.getSpriteAttribute(1, restored.AN_Y) == i / 6, "the newest save is restored");
+    }
+
+    // Spoiling the newest slot falls back to the one before
+    int newest = 16 + (9 % 3) * CubeSnapshot::SLOT_SIZE;
+    hostEeprom[newest + CubeSnapshot::HEADER_SIZE] ^= 0x01;
+
+    CubeEngine older(&host);
+    CubeSnapshot loader(older, 16, 3);
+    check(loader.restore() && older.getSpriteAttribute(1, older.AN_X) == 8 % 6,
+          "a spoilt slot falls back to the save before");
+
+    snapshot.erase();
+    check(!snapshot.hasSnapshot(), "erase() spoils every slot");
+
+    printf("test_snapshot: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,69 @@
+/*
+* test_tween.cpp - Tweens last exactly as many ticks as they were given.
+*/
+#include <stdio.h>
+#include "CubeEngine.h"
+#include "CubeTween.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+int main() {
+
+    CubeHost host = {NULL, NULL, NULL, NULL, NULL};
+    CubeEngine engine(&host);
+    CubeTween pool[1];
+    CubeTweens tweens(engine, pool, 1);
+
+    // Lengths from one tick to the longest there is
+    unsigned int lengths[] = {1, 2, 3, 7, 100, 256, 300, 1000, 4097, 30000, 65535};
+    char what[80];
+
+    for (unsigned int n = 0; n < sizeof(lengths) / sizeof(lengths[0]); n++) {
+
+        unsigned int ticks = lengths[n];
+        byte value = 0;
+        byte tween = tweens.tweenValue(&value, 255, ticks, tweens.EASE_LINEAR);
+
+        // Progress is always the exact share of the ticks done
+        unsigned long done  = 0;
+        bool exact = true;
+        bool rising = true;
+        byte last = 0;
+
+        while (tweens.isActive(tween) && done <= ticks) {
+            tweens.step();
+            done += 1;
+
+            if (tweens.isActive(tween)) {
+                exact = exact && pool[0].progress == (done * 0xFFFFUL) / ticks;
+            }
+            rising = rising && value >= last;
+            last = value;
+        }
+
+        snprintf(what, sizeof(what), "a %u tick tween takes %u ticks", ticks, ticks);
+        check(done == ticks, what);
+        snprintf(what, sizeof(what), "a %u tick tween moves at an even rate", ticks);
+        check(exact, what);
+        snprintf(what, sizeof(what), "a %u tick tween ends on its value", ticks);
+        check(value == 255 && rising, what);
+    }
+
+    // Halfway through a linear tween is halfway there
+    byte value = 0;
+    tweens.tweenValue(&value, 200, 1000, tweens.EASE_LINEAR);
+    for (int i = 0; i < 500; i++) {
+        tweens.step();
+    }
+    check(value >= 99 && value <= 101, "a linear tween is halfway there halfway through");
+
+    printf("test_tween: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
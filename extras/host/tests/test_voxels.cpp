@@ -0,0 +1,97 @@
+/*
+* test_voxels.cpp - CubeVoxels' SSE2 code matches the fallback and the engine.
+*/
+#include <stdio.h>
+
+// The Makefile builds CubeVoxels.cpp a second time with CUBE_VOXELS_SCALAR
+// and the class renamed, so both versions can be called side by side
+#define CubeVoxels CubeVoxelsScalar
+#include "CubeVoxels.h"
+#undef CubeVoxels
+#undef CubeVoxels_h
+#include "CubeVoxels.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+static byte randomColour() {
+    return random(4) << 6;
+}
+
+int main() {
+
+    CubeHost host = {NULL, NULL, NULL, NULL, NULL};
+    static byte extraFrames[54 * 3];
+
+    byte colours[864], changed[864], back[864], backScalar[864];
+    byte from[216], to[216], fromScalar[216], toScalar[216];
+    unsigned int voxels[864], voxelsScalar[864];
+
+    for (int round = 0; round < 400; round++) {
+
+        // Whole cubes, and lengths that leave a tail for the fallback loop
+        int cubes = 1 + (round % 4);
+        int count = cubes * 216;
+        if (round % 3 == 0) {
+            count -= random(1, 64);
+        }
+        int bytes = (count + 3) / 4;
+
+        for (int i = 0; i < count; i++) {
+            colours[i] = randomColour();
+            changed[i] = colours[i];
+        }
+        for (int k = random(60); k > 0; k--) {
+            changed[random(count)] = randomColour();
+        }
+
+        CubeVoxels::pack(colours, from, count);
+        CubeVoxels::pack(changed, to, count);
+        CubeVoxelsScalar::pack(colours, fromScalar, count);
+        CubeVoxelsScalar::pack(changed, toScalar, count);
+        check(memcmp(from, fromScalar, bytes) == 0 && memcmp(to, toScalar, bytes) == 0, "pack matches the fallback");
+
+        CubeVoxels::unpack(from, back, count);
+        CubeVoxelsScalar::unpack(from, backScalar, count);
+        check(memcmp(back, colours, count) == 0, "unpack undoes pack");
+        check(memcmp(backScalar, colours, count) == 0, "the fallback unpack undoes pack");
+
+        int found = CubeVoxels::diff(from, to, voxels, count);
+        int foundScalar = CubeVoxelsScalar::diff(from, to, voxelsScalar, count);
+        check(found == foundScalar && memcmp(voxels, voxelsScalar, found * sizeof(unsigned int)) == 0, "diff matches the fallback");
+
+        int differ = 0;
+        for (int i = 0; i < count; i++) {
+            differ += (colours[i] != changed[i]);
+        }
+        check(found == differ, "diff finds every changed LED");
+
+        // Drawn LED by LED, the engine holds the same colours, and the diff
+        // takes it from one grid to the other
+        CubeEngine engine(&host);
+        engine.setCubeCount(cubes, extraFrames);
+
+        for (int i = 0; i < count; i++) {
+            int led = i % 216;
+            engine.setLED(led / 36, (led / 6) % 6, ((i / 216) * 6) + (led % 6), colours[i]);
+        }
+
+        engine.setLEDs(voxels, found);
+
+        bool same = true;
+        for (int i = 0; i < count; i++) {
+            int led = i % 216;
+            same = same && engine.getLED(led / 36, (led / 6) % 6, ((i / 216) * 6) + (led % 6)) == changed[i];
+        }
+        check(same, "setLEDs() applies the diff");
+    }
+
+    printf("test_voxels: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
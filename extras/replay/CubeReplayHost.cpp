@@ -0,0 +1,151 @@
+#include "CubeReplayHost.h"
+
+#include <chrono>
+#include <vector>
+
+/*
+ * The PC's clock in microseconds, for timing each step
+ *
+ * The stand-in's micros() is virtual and only moves when told to.
+ */
+static unsigned long hostTimer() {
+    return (unsigned long) std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * This constructor only stores the game, replay() runs it
+ */
+CubeReplayHost::CubeReplayHost(ReplaySetup setup, CubeReplay::ReplayStep step) {
+    this->setup         = setup;
+    this->step          = step;
+    this->readable      = false;
+    this->frameCount    = 0;
+    this->mismatches    = 0;
+    this->firstMismatch = -1;
+    this->minMicros     = 0;
+    this->maxMicros     = 0;
+    this->totalMicros   = 0;
+}
+
+/*
+ * Replays a recording file
+ */
+bool CubeReplayHost::replay(const char *path) {
+
+    std::vector<byte> stream;
+    FILE *in = fopen(path, "rb");
+
+    if (in != NULL) {
+        byte chunk[4096];
+        size_t count;
+
+        while ((count = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+            stream.insert(stream.end(), chunk, chunk + count);
+        }
+        fclose(in);
+    }
+
+    if (in == NULL || stream.empty()) {
+        this->readable   = false;
+        this->frameCount = 0;
+        this->mismatches = 1;
+        return false;
+    }
+
+    return this->replay(stream.data(), stream.size());
+}
+
+/*
+ * Replays a recording through a new engine on the stand-in's pins
+ */
+bool CubeReplayHost::replay(const byte *stream, unsigned long length) {
+
+    CubeEngine engine(A1, A3, A2, 2, 3, 4, 5, 6, 7);
+    this->setup(engine);
+
+    CubeReplay replay(stream, length);
+    replay.setTimer(hostTimer);
+    replay.run(engine, this->step);
+
+    this->readable      = replay.isValid();
+    this->frameCount    = replay.getFrameCount();
+    this->mismatches    = replay.getMismatches();
+    this->firstMismatch = replay.getFirstMismatch();
+    this->minMicros     = replay.getMinMicros();
+    this->maxMicros     = replay.getMaxMicros();
+    this->totalMicros   = replay.getTotalMicros();
+
+    return this->readable && this->mismatches == 0;
+}
+
+/*
+ * Prints the results of the last replay
+ */
+void CubeReplayHost::report(FILE *out) {
+
+    if (!this->readable) {
+        fprintf(out, "recording unreadable or cut short after %lu frames\n", this->frameCount);
+    }
+
+    fprintf(out, "%lu frames, %lu mismatched", this->frameCount, this->mismatches);
+    if (this->firstMismatch >= 0) {
+        fprintf(out, ", first at frame %ld", this->firstMismatch);
+    }
+    fprintf(out, "\n");
+
+    if (this->frameCount > 0) {
+        fprintf(out, "step: min %lu us, mean %.1f us, max %lu us\n",
+                this->minMicros, (double) this->totalMicros / this->frameCount, this->maxMicros);
+    }
+}
+
+/*
+ * Returns false if the last recording had a bad header or was cut short
+ */
+bool CubeReplayHost::isReadable() {
+    return this->readable;
+}
+
+/*
+ * Returns the number of frames replayed
+ */
+unsigned long CubeReplayHost::getFrameCount() {
+    return this->frameCount;
+}
+
+/*
+ * Returns the number of frames that didn't match, plus one for a bad
+ * recording
+ */
+unsigned long CubeReplayHost::getMismatches() {
+    return this->mismatches;
+}
+
+/*
+ * Returns the number of the first frame that didn't match, or -1
+ */
+long CubeReplayHost::getFirstMismatch() {
+    return this->firstMismatch;
+}
+
+/*
+ * Returns the quickest step
+ */
+unsigned long CubeReplayHost::getMinMicros() {
+    return this->minMicros;
+}
+
+/*
+ * Returns the slowest step
+ */
+unsigned long CubeReplayHost::getMaxMicros() {
+    return this->maxMicros;
+}
+
+/*
+ * Returns the time of every step added together
+ */
+unsigned long CubeReplayHost::getTotalMicros() {
+    return this->totalMicros;
+}
@@ -0,0 +1,80 @@
+/*
+* CubeReplayHost.h - Replays recorded CubeEngine sessions off the board.
+*
+* A session recorded with CubeRecorder, e.g. to an SD card, is replayed on
+* a PC against the stand-in core in extras/host. The game is the sketch's
+* own code built for the host: a setup function that puts a new engine
+* where the recording started, and the step CubeReplay::run() calls for
+* each frame.
+*
+*     void setup(CubeEngine &engine) { ...as the sketch's setup()... }
+*     void step(CubeEngine &engine, unsigned long now) { ...as loop()... }
+*
+*     int main(int argc, char **argv) {
+*         CubeReplayHost replayer(setup, step);
+*         bool passed = replayer.replay(argv[1]);
+*         replayer.report(stdout);
+*         return passed ? 0 : 1;
+*     }
+*
+* The engine drives the stand-in's pins with the default wiring, as on
+* the board, and reads the recorded time and seeds through the replay.
+* Every frame is checked bit for bit, and each step is timed with the
+* PC's clock, so a recording is both a test and a benchmark.
+*
+* This is host code, not part of the Arduino library. Build it with the
+* library sources and the stand-in:
+*
+*     g++ -O2 -std=gnu++11 -DARDUINO=10819 -I<library>/extras/host \
+*         -I<library> mygame.cpp CubeReplayHost.cpp \
+*         <library>/CubeEngine.cpp ... <library>/extras/host/Arduino.cpp
+*/
+#ifndef CubeReplayHost_h
+#define CubeReplayHost_h
+
+#include <stdio.h>
+#include "CubeEngine.h"
+#include "CubeRecorder.h"
+
+class CubeReplayHost
+{
+    public:
+
+        // Puts a new engine in the state it was in when recording began
+        typedef void (*ReplaySetup)(CubeEngine &engine);
+
+        // Replayer constructor
+        CubeReplayHost(ReplaySetup setup, CubeReplay::ReplayStep step);
+
+        // Replays a recording from a file or from memory through a new
+        // engine. Returns true if it could be read and every frame matched.
+        bool replay(const char *path);
+        bool replay(const byte *stream, unsigned long length);
+
+        // Prints the results of the last replay
+        void report(FILE *out);
+
+        // Results of the last replay
+        bool isReadable();
+        unsigned long getFrameCount();
+        unsigned long getMismatches();
+        long getFirstMismatch();
+        unsigned long getMinMicros();
+        unsigned long getMaxMicros();
+        unsigned long getTotalMicros();
+
+    private:
+
+        ReplaySetup setup;
+        CubeReplay::ReplayStep step;
+
+        bool readable;
+        unsigned long frameCount;
+        unsigned long mismatches;
+        long firstMismatch;
+        unsigned long minMicros;
+        unsigned long maxMicros;
+        unsigned long totalMicros;
+};
+
+#endif
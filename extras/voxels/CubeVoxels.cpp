@@ -0,0 +1,150 @@
+#include "CubeVoxels.h"
+
+// Defining CUBE_VOXELS_SCALAR builds the byte at a time fallback on an
+// SSE2 host, so the tests can check one against the other
+#if defined(__SSE2__) && !defined(CUBE_VOXELS_SCALAR)
+  #define CUBE_VOXELS_SSE2 1
+  #include <emmintrin.h>
+#else
+  #define CUBE_VOXELS_SSE2 0
+#endif
+
+#if CUBE_VOXELS_SSE2
+
+/*
+ * Packs 16 colours into the low bytes of four 32-bit lanes
+ *
+ * Each lane starts as four colours, c0 in the low byte. The codes are
+ * shifted down next to each other, c0 at bits 0-1 up to c3 at bits 6-7.
+ */
+static inline __m128i packLanes(const byte *colours) {
+    __m128i v = _mm_loadu_si128((const __m128i *) colours);
+
+    v = _mm_and_si128(_mm_srli_epi16(v, 6), _mm_set1_epi8(3));
+    v = _mm_or_si128(v, _mm_srli_epi32(v, 6));
+    v = _mm_and_si128(v, _mm_set1_epi32(0x000F000F));
+    v = _mm_or_si128(v, _mm_srli_epi32(v, 12));
+
+    return _mm_and_si128(v, _mm_set1_epi32(0xFF));
+}
+
+#endif
+
+/*
+ * Packs one frame byte from up to four colours
+ */
+static inline byte packByte(const byte *colours, int count) {
+    byte codes = 0;
+
+    for (int k = 0; k < count && k < 4; k++) {
+        codes |= (colours[k] >> 6) << (k * 2);
+    }
+
+    return codes;
+}
+
+/*
+ * Packs colours into frame bytes
+ *
+ * With SSE2, 64 colours at a time go to 16 frame bytes.
+ */
+void CubeVoxels::pack(const byte *colours, byte *frame, int ledCount) {
+
+    int led = 0;
+
+#if CUBE_VOXELS_SSE2
+    for (; led + 64 <= ledCount; led += 64) {
+        __m128i low  = _mm_packs_epi32(packLanes(colours + led), packLanes(colours + led + 16));
+        __m128i high = _mm_packs_epi32(packLanes(colours + led + 32), packLanes(colours + led + 48));
+
+        _mm_storeu_si128((__m128i *) (frame + (led >> 2)), _mm_packus_epi16(low, high));
+    }
+#endif
+
+    for (; led < ledCount; led += 4) {
+        frame[led >> 2] = packByte(colours + led, ledCount - led);
+    }
+}
+
+/*
+ * Unpacks frame bytes into colours
+ *
+ * With SSE2, 16 frame bytes at a time go to 64 colours. Each of the four
+ * codes in a byte is shifted to the top two bits, then the four results
+ * are interleaved back into LED order.
+ */
+void CubeVoxels::unpack(const byte *frame, byte *colours, int ledCount) {
+
+    int led = 0;
+
+#if CUBE_VOXELS_SSE2
+    const __m128i top = _mm_set1_epi8((char) 0xC0);
+
+    for (; led + 64 <= ledCount; led += 64) {
+        __m128i codes = _mm_loadu_si128((const __m128i *) (frame + (led >> 2)));
+
+        __m128i c0 = _mm_and_si128(_mm_slli_epi16(codes, 6), top);
+        __m128i c1 = _mm_and_si128(_mm_slli_epi16(codes, 4), top);
+        __m128i c2 = _mm_and_si128(_mm_slli_epi16(codes, 2), top);
+        __m128i c3 = _mm_and_si128(codes, top);
+
+        __m128i low01  = _mm_unpacklo_epi8(c0, c1);
+        __m128i high01 = _mm_unpackhi_epi8(c0, c1);
+        __m128i low23  = _mm_unpacklo_epi8(c2, c3);
+        __m128i high23 = _mm_unpackhi_epi8(c2, c3);
+
+        _mm_storeu_si128((__m128i *) (colours + led),      _mm_unpacklo_epi16(low01, low23));
+        _mm_storeu_si128((__m128i *) (colours + led + 16), _mm_unpackhi_epi16(low01, low23));
+        _mm_storeu_si128((__m128i *) (colours + led + 32), _mm_unpacklo_epi16(high01, high23));
+        _mm_storeu_si128((__m128i *) (colours + led + 48), _mm_unpackhi_epi16(high01, high23));
+    }
+#endif
+
+    for (; led < ledCount; led++) {
+        colours[led] = ((frame[led >> 2] >> ((led & 3) * 2)) & 3) << 6;
+    }
+}
+
+/*
+ * Lists the LEDs that differ between two frames
+ *
+ * With SSE2, 16 bytes that match are passed over in one compare. Only the
+ * bytes that differ are looked at LED by LED.
+ */
+int CubeVoxels::diff(const byte *from, const byte *to, unsigned int *voxels, int ledCount) {
+
+    int count = 0;
+    int bytes = (ledCount + 3) / 4;
+    int index = 0;
+
+    while (index < bytes) {
+
+#if CUBE_VOXELS_SSE2
+        if (index + 16 <= bytes) {
+            __m128i a = _mm_loadu_si128((const __m128i *) (from + index));
+            __m128i b = _mm_loadu_si128((const __m128i *) (to + index));
+
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) == 0xFFFF) {
+                index += 16;
+                continue;
+            }
+        }
+#endif
+
+        byte changed = from[index] ^ to[index];
+
+        for (byte k = 0; changed != 0 && k < 4; k++) {
+            int led = (index * 4) + k;
+
+            if ((changed & (3 << (k * 2))) != 0 && led < ledCount) {
+                unsigned int code = (to[index] >> (k * 2)) & 3;
+                voxels[count] = led | (code << 14);
+                count += 1;
+            }
+        }
+
+        index += 1;
+    }
+
+    return count;
+}
@@ -0,0 +1,49 @@
+/*
+* CubeVoxels.h - Packs voxel grids into CubeEngine frames, off the board.
+*
+* Tools that build animations (encoders, converters, the batch runner)
+* work on a grid of one AV_ colour byte per LED, numbered the way
+* setLEDs() numbers them: cube * 216 + layer * 36 + row * 6 + column.
+* These turn grids into the 54 byte frames the engine stores, four LEDs
+* to a byte, and into the voxel lists setLEDs() takes. With SSE2 they
+* work 16 bytes at a time, elsewhere a byte at a time.
+*
+* This is host code, not part of the Arduino library. Build it with the
+* library sources and the stand-in for the Arduino core in extras/host:
+*
+*     g++ -O2 -DARDUINO=10819 -I<library>/extras/host -I<library> \
+*         mytool.cpp CubeVoxels.cpp <library>/CubeEngine.cpp ... \
+*         <library>/extras/host/Arduino.cpp
+*
+* extras/host/tests/test_voxels.cpp checks the SSE2 code against the
+* fallback and the engine.
+*
+* e.g. sending only the LEDs that changed between two frames:
+*
+*     unsigned int voxels[216];
+*     int count = CubeVoxels::diff(lastFrame, nextFrame, voxels, 216);
+*     engine.setLEDs(voxels, count);
+*/
+#ifndef CubeVoxels_h
+#define CubeVoxels_h
+
+#include "CubeEngine.h"
+
+class CubeVoxels
+{
+    public:
+
+        // Packs 'ledCount' colours into frame bytes
+        // 'frame' needs (ledCount + 3) / 4 bytes.
+        static void pack(const byte *colours, byte *frame, int ledCount);
+
+        // Unpacks frame bytes into one AV_ colour per LED
+        static void unpack(const byte *frame, byte *colours, int ledCount);
+
+        // Lists the LEDs that differ between two packed frames
+        // Each is a voxel, the LED number packed with its colour in 'to'.
+        // 'voxels' needs room for 'ledCount'. Returns how many there are.
+        static int diff(const byte *from, const byte *to, unsigned int *voxels, int ledCount);
+};
+
+#endif